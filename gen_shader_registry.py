@@ -1,28 +1,85 @@
+# Packs every .spv of the shader directory into one blob and generates shader_registry.cpp, which embeds the blob with
+# .incbin and looks shaders up in a constexpr sorted index. Nothing is built at static-init time.
+#
+# usage: gen_shader_registry.py <output directory> [shader directory, shadercache by default]
 import os
+import sys
 
-os.makedirs("shadercache", exist_ok=True)
-print("// Auto-generated shader registry")
-print("#include \"shader_registry.hpp\"")
-for file in os.listdir("shadercache"):
-    if file.endswith(".spv"):
-        name = file.replace(".spv", "")
-        print(f'constexpr unsigned char {name}_spv[] = {{')
-        with open(os.path.join("shadercache", file), "rb") as f:
-            byte = f.read(1)
-            count = 0
-            while byte:
-                print(f'    0x{byte.hex()},', end="")
-                count += 1
-                if count % 12 == 0:
-                    print()
-                byte = f.read(1)
-        print("\n};")
-        print(f"constexpr size_t {name}_spv_len = sizeof({name}_spv);")
+out_dir = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else ".")
+blob_path = os.path.join(out_dir, "shader_blob.bin")
+source_path = os.path.join(out_dir, "shader_registry.cpp")
+shader_dir = sys.argv[2] if len(sys.argv) > 2 else "shadercache"
 
-print("\nstd::unordered_map<std::string, ShaderData> g_shaders = {")
-for file in os.listdir("shadercache"):
-    if file.endswith(".spv"):
-        name = file.replace(".spv", "")
-        name2 = name.replace(".", "_")
-        print(f'    {{"{name}.spv", {{{name2}_spv, {name2}_spv_len}}}},')
-print("};")
+os.makedirs(shader_dir, exist_ok=True)
+os.makedirs(out_dir, exist_ok=True)
+
+names = sorted(
+    (file for file in os.listdir(shader_dir) if file.endswith(".spv")),
+    key=lambda name: name.encode(),
+)
+
+entries = []
+blob = bytearray()
+for name in names:
+    with open(os.path.join(shader_dir, name), "rb") as f:
+        data = f.read()
+    # SPIR-V is read as 32-bit words
+    blob.extend(b"\0" * (-len(blob) % 4))
+    entries.append((name, len(blob), len(data)))
+    blob.extend(data)
+
+with open(blob_path, "wb") as f:
+    f.write(blob)
+
+lines = [
+    "// Auto-generated shader registry",
+    '#include "shader_registry.hpp"',
+    "#include <algorithm>",
+    "#include <iterator>",
+    "",
+]
+if entries:
+    incbin_path = blob_path.replace("\\", "/")
+    lines += [
+        "__asm__(",
+        "#ifdef _WIN32",
+        '\t".section .rdata,\\"dr\\"\\n"',
+        "#else",
+        '\t".section .rodata\\n"',
+        "#endif",
+        '\t".balign 16\\n"',
+        '\t".globl fxed_shader_blob\\n"',
+        '\t"fxed_shader_blob:\\n"',
+        f'\t".incbin \\"{incbin_path}\\"\\n"',
+        '\t".text\\n");',
+        "",
+        'extern "C" const unsigned char fxed_shader_blob[];',
+        "",
+        "namespace {",
+        "struct ShaderEntry {",
+        "\tstd::string_view name;",
+        "\tsize_t\t\t\t offset;",
+        "\tsize_t\t\t\t length;",
+        "};",
+        "",
+        "constexpr ShaderEntry shaderIndex[] = {",
+    ]
+    lines += [f'\t{{"{name}", {offset}, {length}}},' for name, offset, length in entries]
+    lines += [
+        "};",
+        "static_assert(std::ranges::is_sorted(shaderIndex, {}, &ShaderEntry::name));",
+        "}\t  // namespace",
+        "",
+        "ShaderData findShader(std::string_view name) {",
+        "\tauto it = std::ranges::lower_bound(shaderIndex, name, {}, &ShaderEntry::name);",
+        "\tif (it == std::end(shaderIndex) || it->name != name) return {nullptr, 0};",
+        "\treturn {fxed_shader_blob + it->offset, it->length};",
+        "}",
+    ]
+else:
+    lines += [
+        "ShaderData findShader(std::string_view) { return {nullptr, 0}; }",
+    ]
+
+with open(source_path, "w") as f:
+    f.write("\n".join(lines) + "\n")
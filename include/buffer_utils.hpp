@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 #include "nri.hpp"
@@ -19,16 +20,18 @@ std::tuple<std::array<std::size_t, sizeof...(Buffers)>, nri::MemoryRequirements>
 	std::array<std::size_t, sizeof...(Buffers)> offsets;
 	return [&]<std::size_t... I>(std::index_sequence<I...>) {
 		std::size_t totalSize = 0;
+		std::size_t alignment = 1;
 		(
 			[&] {
 				auto req = buffers.getMemoryRequirements();
 				if (totalSize % req.alignment != 0) { totalSize += req.alignment - (totalSize % req.alignment); }
 				offsets[I] = totalSize;
 				totalSize += req.size;
+				alignment = std::max(alignment, req.alignment);
 			}(),
 			...);
-		return std::make_tuple(offsets,
-							   nri::MemoryRequirements(totalSize, nri::MemoryTypeRequest::MEMORY_TYPE_DEVICE, 0));
+		return std::make_tuple(
+			offsets, nri::MemoryRequirements(totalSize, nri::MemoryTypeRequest::MEMORY_TYPE_DEVICE, alignment));
 	}(std::index_sequence_for<Buffers...>{});
 }
 
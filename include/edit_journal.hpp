@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "text_editor.hpp"
+#include "utils.hpp"
+
+namespace fxed {
+
+/// Append-only record of the unsaved edits to one file, kept in the swap directory under the cache directory so the
+/// edits can be recovered after a crash. Every record is a LineEdit with the text of the inserted lines, written with a
+/// checksum so a record torn by the crash ends the replay instead of corrupting it. The main thread only encodes
+/// records into memory. A background thread writes them and syncs the file at most once per syncInterval. When the
+/// records outgrow the text they describe, the journal is compacted to one snapshot of the whole text, written to a
+/// temporary file and renamed over the old journal. Saving the file or closing it removes the journal. The journal
+/// names the process writing it, and is only recovered once that process is gone.
+class EditJournal {
+	std::filesystem::path filePath;
+	std::filesystem::path journalPath;	   /// empty if there is no cache directory to keep it in
+
+	// the main thread's state
+	std::size_t lineCount;					/// the lines of the text after the last record
+	uint64_t	bytesSinceSnapshot = 0;		/// of the records after the last snapshot, or after the file on disk
+	uint64_t	snapshotBytes;				/// what a snapshot of the text would take, roughly
+
+	// handed to the writing thread
+	std::mutex					mutex;
+	std::condition_variable_any wake;
+	std::string					pending;			   /// encoded records not written yet
+	bool						rewrite	  = false;	   /// pending replaces the journal instead of going after it
+	uint64_t					baseStamp = 0;		   /// hashFileStamp of the file the first record applies to
+	std::atomic<bool>			broken	  = false;	   /// a write failed and the journal was dropped
+	std::jthread				thread;
+
+	void run(std::stop_token stop);
+	void queue(std::string &&records, bool replace);
+
+   public:
+	struct Recovered {
+		std::filesystem::path filePath;
+		std::u32string		  text;
+	};
+
+	/// records written in this time are synced together
+	static constexpr std::chrono::milliseconds syncInterval{500};
+	/// the journal is compacted when its records take this many times the size of a snapshot, plus compactSlack
+	static constexpr uint64_t compactFactor = 4;
+	static constexpr uint64_t compactSlack	= 1 << 20;
+
+	/// starts a journal for the file, with the text read from it split into lineCount lines
+	EditJournal(const std::filesystem::path &filePath, std::size_t lineCount);
+	/// removes the journal, the edits are either saved or dropped
+	~EditJournal();
+	DELETE_COPY_AND_ASSIGNMENT(EditJournal);
+
+	/// Records an edit of text, taken with takeLineEdit. An edit that does not follow from the last one, like a text
+	/// replaced as a whole, is recorded as a snapshot.
+	void record(const TextStateBase &text, const LineEdit &edit);
+	/// records the whole text, so the journal no longer depends on the file on disk
+	void snapshot(const TextStateBase &text);
+	/// the file was saved with text, the records so far are not needed anymore
+	void saved(const TextStateBase &text);
+
+	/// where the journals are kept, empty if there is no cache directory
+	static std::filesystem::path getSwapDirectory();
+	/// journals left behind by a run that did not close its files, not the ones of an fxed still running
+	static std::vector<std::filesystem::path> findJournals();
+	/// replays a journal over the file it belongs to, nothing if it has no edits or the file changed under it
+	static std::optional<Recovered> recover(const std::filesystem::path &journalPath);
+};
+
+}	  // namespace fxed
@@ -18,6 +18,9 @@ class Editor {
 	std::unique_ptr<Pane> rootPane;
 
 	void setupCallbacks();
+	FileTreePane &getFileTreePane();
+	/// opens every file with a journal left by a crash in a tab, with the unsaved edits from the journal
+	void recoverFiles();
 
    public:
 	Editor(nri::NRI &nri, uint32_t width, uint32_t height);
@@ -27,9 +30,19 @@ class Editor {
 
 	void mainLoop();
 
-	void openFile(const std::filesystem::path &path);
+	/// the pane the files are opened in
+	TabsPane &getTabsPane();
+	/// opens the file in a new tab, or switches to the tab it is already open in
+	FileTextEditorPane *openFile(const std::filesystem::path &path);
+	/// opens a find in files tab for the folder shown in the file tree
+	void openFindInFiles();
 	void setFolder(const std::filesystem::path &path);
-	
+
+	/// Reopens the tabs of the folder shown in the file tree and expands its directories as they were when the folder
+	/// was last closed. Only the front tab reads its file, the others wait until they are switched to.
+	void restoreSession();
+	/// keeps the tabs and the expanded directories for restoreSession
+	void saveSession();
 };
 
 };	   // namespace fxed
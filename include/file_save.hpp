@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+
+#include "text_editor.hpp"
+#include "utils.hpp"
+
+namespace fxed {
+
+/// Saves a text to its file without holding up the frames around it. The lines are copied out of the text a slice
+/// per frame into one buffer, then encoded to UTF-8 and written on the thread pool in large aligned blocks, through a
+/// temporary file renamed over the old one with writeFileAtomic. The file gets the text as it was when the save
+/// started, so the copy has to be done before the text is edited: finishCopy copies the rest at once.
+class FileSave {
+	struct Job {
+		std::filesystem::path path;
+		std::u32string		  text;		/// the lines joined by '\n'
+		bool				  sync;
+	};
+
+	std::shared_ptr<Job>		 job;	   /// while the lines are copied
+	std::size_t					 nextLine = 0;
+	std::future<std::error_code> written;	  /// while the file is written
+
+	static std::error_code write(const Job &job);
+
+   public:
+	/// the encoded text goes to the file in blocks of this size, aligned for the kernel to copy them page by page
+	static constexpr std::size_t blockSize		= 4 << 20;
+	static constexpr std::size_t blockAlignment = 4096;
+
+	FileSave() = default;
+	/// waits for a file being written, closing its pane does not cancel the save
+	~FileSave();
+	DELETE_COPY_AND_ASSIGNMENT(FileSave);
+
+	/// starts saving text to path, with sync the save is only done when the file is on the disk
+	void start(const TextStateBase &text, const std::filesystem::path &path, bool sync);
+	/// copies lines until the budget runs out and starts writing after the last one, returns true if all are copied
+	bool copy(const TextStateBase &text, std::chrono::microseconds budget);
+	/// copies the rest of the lines now, call before the text is edited
+	void finishCopy(const TextStateBase &text);
+	/// the result of a save that was done since the last call, an empty error code if it succeeded
+	std::optional<std::error_code> poll();
+
+	bool isCopying() const { return job != nullptr; }
+	bool isSaving() const { return job != nullptr || written.valid(); }
+};
+
+}	  // namespace fxed
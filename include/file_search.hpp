@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "utils.hpp"
+
+namespace fxed {
+
+/// Searches every file under a directory on the shared thread pool. Each directory listed during the walk schedules
+/// its subdirectories and batches of its files as separate tasks, so idle workers steal whatever is left. Files are
+/// mapped, binary files are skipped and matching lines are collected until the owner takes them, once per frame.
+class FileSearch : public std::enable_shared_from_this<FileSearch> {
+   public:
+	struct Match {
+		std::filesystem::path path;
+		uint32_t			  line;
+		uint32_t			  column;	  /// in code points, like TextState
+		std::string			  text;		  /// the matching line, shortened if it is very long
+	};
+
+	/// stop recording matches after this many, a query that matches everything should not fill the memory
+	static constexpr std::size_t maxMatches = 20000;
+
+   private:
+	struct Job {
+		uint64_t				 generation;
+		std::string				 query;
+		std::atomic<std::size_t> pendingTasks = 0;
+		std::atomic<std::size_t> matchCount	  = 0;
+		std::atomic<std::size_t> fileCount	  = 0;
+	};
+
+	std::mutex			  mutex;
+	std::vector<Match>	  finished;
+	std::atomic<uint64_t> generation = 0;
+	std::shared_ptr<Job>  currentJob;
+
+	bool isCancelled(const Job &job) const { return job.generation != generation; }
+	void schedule(const std::shared_ptr<Job> &job, std::function<void()> &&task);
+	void searchDirectory(const std::shared_ptr<Job> &job, const std::filesystem::path &directory);
+	void searchFile(Job &job, const std::filesystem::path &path, std::vector<Match> &matches);
+
+   public:
+	/// cancels the running search, if any, and starts a new one
+	void start(const std::filesystem::path &root, std::string_view query);
+	void cancel() { ++generation; }
+
+	bool		isDone() const { return !currentJob || currentJob->pendingTasks == 0; }
+	std::size_t getMatchCount() const { return currentJob ? currentJob->matchCount.load() : 0; }
+	std::size_t getFileCount() const { return currentJob ? currentJob->fileCount.load() : 0; }
+
+	std::vector<Match> takeFinished();
+};
+
+}	  // namespace fxed
@@ -1,25 +1,99 @@
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
-#include <vector>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "utils.hpp"
 
 namespace fxed {
 
 std::string_view getIconForFile(const std::filesystem::path &path);
 
+struct DirectoryEntry {
+	std::string name;
+	bool		isDirectory;
+	bool		isSymlink = false;	   // isDirectory describes the link target
+};
+
+/// lists a directory without stat-ing every entry where the file system reports entry types, sorted directories
+/// first and then by name
+std::vector<DirectoryEntry> readDirectory(const std::filesystem::path &path);
+
+/// Lists directories on the shared thread pool. Finished listings are collected until the owner takes them.
+class DirectoryScanner : public std::enable_shared_from_this<DirectoryScanner> {
+   public:
+	struct Listing {
+		std::filesystem::path		path;
+		std::vector<DirectoryEntry> entries;
+	};
+
+   private:
+	std::mutex			 mutex;
+	std::vector<Listing> finished;
+
+   public:
+	void				 request(const std::filesystem::path &path);
+	std::vector<Listing> takeFinished();
+};
+
+/// Reports entries created in or removed from watched directories. Events are read on a background thread (inotify
+/// on Linux, nothing is reported elsewhere) and collected until the owner takes them, once per frame.
+class FileTreeWatcher {
+   public:
+	struct Event {
+		std::filesystem::path directory;
+		std::string			  name;
+		bool				  created;
+		bool				  isDirectory;
+		bool				  overflow;		// the kernel dropped events, watched directories need a rescan
+	};
+
+   private:
+	int											   inotifyFd = -1;
+	int											   wakeFd	 = -1;
+	std::mutex									   mutex;
+	std::unordered_map<int, std::filesystem::path> watchedPaths;
+	std::unordered_map<std::string, int>		   watchDescriptors;
+	std::vector<Event>							   pending;
+	std::jthread								   thread;
+
+	void readLoop(std::stop_token stop);
+
+   public:
+	FileTreeWatcher();
+	~FileTreeWatcher();
+	DELETE_COPY_AND_ASSIGNMENT(FileTreeWatcher);
+
+	void			   watch(const std::filesystem::path &directory);
+	void			   unwatch(const std::filesystem::path &directory);
+	std::vector<Event> takeEvents();
+};
+
 class FileTree {
    public:
 	class FileTreeNode {
 	   public:
 		std::filesystem::path path;
+		std::string			  name;
+		std::u32string		  label;			  // cached row text without indentation
+		std::size_t			  row = SIZE_MAX;	  // index in rows, only meaningful while rows[row].node is this node
 
 		virtual ~FileTreeNode()									   = default;
+		virtual bool isDirectory() const						   = 0;
 		virtual void print(std::ostream &os, int indent = 0) const = 0;
 	};
 
 	class FileNode : public FileTreeNode {
 	   public:
+		bool isDirectory() const override { return false; }
 		void print(std::ostream &os, int indent = 0) const override;
 	};
 
@@ -27,48 +101,70 @@ class FileTree {
 	   public:
 		std::vector<std::unique_ptr<FileTreeNode>> children;
 		bool									   opened  = false;
-		bool									   updated = false;
+		bool									   updated = false;		// children have been listed
+		bool									   loading = false;		// a listing is in flight
 
 		std::size_t getChildCount() const { return opened ? children.size() : 0; }
 
+		bool isDirectory() const override { return true; }
 		void print(std::ostream &os, int indent = 0) const override;
+	};
 
-		void toggleOpen();
-		void setOpen(bool open);
+	/// one visible line of the tree, the root has depth -1
+	struct Row {
+		FileTreeNode *node;
+		int			  depth;
 	};
 
    private:
-	std::unique_ptr<DirectoryNode> root;
+	std::unique_ptr<DirectoryNode>	  root;
+	std::shared_ptr<DirectoryScanner> scanner;
+	std::unique_ptr<FileTreeWatcher>  watcher;
+	std::vector<Row>				  rows;					   // flattened visible tree, kept in sync on every change
+	std::unordered_set<std::string>	  pendingOpen;			   // to expand once listed, relative to root
+	std::size_t						  firstChangedRow = 0;	   // see takeChangedRow
+
+	void		   requestListing(DirectoryNode &dir, bool force = false);
+	DirectoryNode *findDirectory(const std::filesystem::path &path, bool *visible = nullptr) const;
+	void		   applyListing(DirectoryNode &dir, std::vector<DirectoryEntry> &&entries);
+	void		   insertChild(DirectoryNode &dir, const std::string &name, bool isDirectory);
+	void		   removeChild(DirectoryNode &dir, const std::string &name, bool isDirectory);
+	void		   unwatchSubtree(FileTreeNode &node);
+	void		   rescanAll(DirectoryNode &dir);
+	std::size_t	   findRow(const FileTreeNode &node) const;
+	std::size_t	   subtreeEnd(std::size_t row) const;
+	void		   renumberRows(std::size_t from);
+	void		   refreshRows(const DirectoryNode &dir);
+	void		   collectRows(const DirectoryNode &dir, int depth, std::vector<Row> &out) const;
+	void		   collectOpen(const DirectoryNode &dir, std::vector<std::filesystem::path> &out) const;
+	void		   openPending(DirectoryNode &dir);
+
+	static std::unique_ptr<FileTreeNode> makeNode(const DirectoryNode &parent, const std::string &name,
+												  bool isDirectory);
 
    public:
 	FileTree(const std::filesystem::path &rootPath);
 
 	void print(std::ostream &os) const;
-
-	class iterator {
-		std::vector<std::pair<DirectoryNode *, size_t>> stack;
-
-	   public:
-		iterator(DirectoryNode *root);
-
-		bool operator!=(const iterator &other) const;
-		bool operator==(const iterator &other) const;
-
-		bool isBegin() const;
-		bool isBack() const;
-
-		FileTreeNode &operator*() const;
-
-		iterator &operator++();
-		iterator  operator++(int);
-		iterator &operator--();
-		iterator  operator--(int);
-
-		void printStack(std::ostream &os) const;
-	};
-
-	iterator begin() { return iterator(root.get()); }
-	iterator end() { return iterator(nullptr); }
+	bool empty() const { return root->getChildCount() == 0; }
+
+	const std::vector<Row> &getRows() const { return rows; }
+	/// the first row that was added, removed or changed since the last call, SIZE_MAX if none was
+	std::size_t takeChangedRow() { return std::exchange(firstChangedRow, SIZE_MAX); }
+	/// appends the text of a row (indentation, icon and label) without a line break
+	static void appendRowText(const Row &row, std::u32string &out);
+
+	/// expanding or collapsing only touches the rows of that directory's subtree
+	void toggleOpen(std::size_t row);
+	void setOpen(std::size_t row, bool open);
+	/// the expanded directories below the root, relative to it, parents before their children
+	std::vector<std::filesystem::path> getOpenDirectories() const;
+	/// expands directories relative to the root, each as soon as its parent is expanded and listed
+	void openDirectories(const std::vector<std::filesystem::path> &directories);
+
+	/// applies directory listings that finished in the background and batched file system events, returns true if the
+	/// visible tree changed
+	bool update();
 };
 
 }	  // namespace fxed
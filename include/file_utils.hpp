@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <span>
+#include <string_view>
+#include <system_error>
+
+#include "utils.hpp"
+
+namespace fxed {
+
+/// per-user cache directory for fxed ($XDG_CACHE_HOME/fxed, ~/.cache/fxed or %LOCALAPPDATA%/fxed), created on demand.
+/// Returns an empty path if no suitable location exists.
+const std::filesystem::path &getCacheDirectory();
+
+/// 64-bit FNV-1a, use the seed to chain multiple inputs into one hash
+constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+constexpr uint64_t FNV_PRIME		= 0x100000001b3ull;
+
+constexpr uint64_t hashBytes(const void *data, std::size_t size, uint64_t seed = FNV_OFFSET_BASIS) {
+	const unsigned char *bytes = (const unsigned char *)data;
+	for (std::size_t i = 0; i < size; ++i) {
+		seed ^= bytes[i];
+		seed *= FNV_PRIME;
+	}
+	return seed;
+}
+
+constexpr uint64_t hashString(std::string_view str, uint64_t seed = FNV_OFFSET_BASIS) {
+	for (char c : str) {
+		seed ^= (unsigned char)c;
+		seed *= FNV_PRIME;
+	}
+	return seed;
+}
+
+template <class T>
+	requires std::is_trivially_copyable_v<T>
+uint64_t hashValue(const T &value, uint64_t seed = FNV_OFFSET_BASIS) {
+	return hashBytes(&value, sizeof(T), seed);
+}
+
+/// id of this process
+uint32_t getProcessId();
+/// whether a process with the id is running, one that cannot be checked counts as running
+bool isProcessRunning(uint32_t pid);
+
+/// cheap fingerprint of a file on disk: path, size and modification time. Does not read the contents.
+uint64_t hashFileStamp(const std::filesystem::path &path, uint64_t seed = FNV_OFFSET_BASIS);
+
+/// Read-only view of a whole file. Uses mmap where available and falls back to reading the file into memory.
+class MappedFile {
+	const char *data = nullptr;
+	std::size_t size = 0;
+	bool		mapped = false;
+
+   public:
+	MappedFile() = default;
+	explicit MappedFile(const std::filesystem::path &path);
+	DELETE_COPY_AND_ASSIGNMENT(MappedFile);
+	MappedFile(MappedFile &&other) noexcept;
+	MappedFile &operator=(MappedFile &&other) noexcept;
+	~MappedFile();
+
+	bool				   isOpen() const { return data != nullptr; }
+	const char			  *getData() const { return data; }
+	std::size_t			   getSize() const { return size; }
+	std::span<const char> getBytes() const { return {data, size}; }
+
+	/// hint that the mapping will be read front to back
+	void adviseSequential() const;
+};
+
+/// flushes the stream and waits until its data is on the disk
+bool syncFile(std::FILE *file);
+/// waits until the entries of a directory, like a file renamed into it, are on the disk. Does nothing on Windows.
+void syncDirectory(const std::filesystem::path &dir);
+
+/// writes the whole file next to its destination and renames it into place, so readers never see a partial file
+bool writeFileAtomic(const std::filesystem::path &path, std::span<const char> bytes);
+/// Like writeFileAtomic above, with the temporary file filled by write. With sync the new file and the rename reach
+/// the disk before it returns, so a crash right after leaves the new file and not an empty one. Returns the error
+/// that stopped it, or an empty one.
+std::error_code writeFileAtomic(const std::filesystem::path &path,
+								const std::function<std::error_code(std::FILE *)> &write, bool sync);
+
+}	  // namespace fxed
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <filesystem>
 #include <memory>
 
 #include "nri.hpp"
@@ -26,6 +27,9 @@ class FontFallbackChain {
 	/// returns the GlyphBox and the index of the font in the fallback chain that contains the glyph for the given
 	/// codepoint, throws if not found
 	std::pair<GlyphBox, int> getGlyphBox(uint32_t c, uint32_t size) const;
+
+	/// identifies the set of font files in the chain, changes when any of them is replaced on disk
+	uint64_t getFingerprint() const;
 	friend class FontAtlas;
 };
 
@@ -49,10 +53,15 @@ class FontAtlas {
 	uint32_t		   fontSize		 = 48;
 	bool			   atlasChanged	 = false;
 	uint32_t		   maxGlyphCount = 0;
+	bool			   cacheDirty	 = false;
 
 	int	 addGlyphToAtlas(uint32_t c);
 	void uploadAtlasToGPU();
 
+	std::filesystem::path getAtlasCachePath() const;
+	bool				  loadAtlasCache();
+	void				  saveAtlasCache();
+
    public:
 	DELETE_COPY_AND_ASSIGNMENT(FontAtlas);
 	FontAtlas(FontAtlas &&other)
@@ -66,7 +75,10 @@ class FontAtlas {
 		  fallbackChain(std::move(other.fallbackChain)),
 		  nri(other.nri),
 		  q(other.q),
-		  fontSize(other.fontSize) {
+		  fontSize(other.fontSize),
+		  atlasChanged(other.atlasChanged),
+		  maxGlyphCount(other.maxGlyphCount),
+		  cacheDirty(other.cacheDirty) {
 		other.data = nullptr;
 	}
 	FontAtlas(nri::NRI &nri, nri::CommandQueue &q, FontFallbackChain &&fallbackChain, uint32_t atlasSize,
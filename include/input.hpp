@@ -1,13 +1,51 @@
 #pragma once
 #include <functional>
+#include <string_view>
 
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
 #include "glfw_window.hpp"
+#include "spsc_queue.hpp"
 
 namespace fxed {
+
+/// an input callback recorded by GLFW, dispatched later by InputQueue::dispatch()
+struct InputEvent {
+	enum class Type { KEY, CHAR, SCROLL, MOUSE_BUTTON, MOUSE_MOVE };
+	struct Key {
+		int key, scancode, action, mods;
+	};
+	struct Button {
+		int button, action, mods;
+	};
+	struct Offset {
+		double x, y;
+	};
+
+	Type		type;
+	GLFWwindow *window;
+	union {
+		Key			 key;
+		Button		 button;
+		Offset		 offset;	 /// scroll offset or cursor position
+		unsigned int codepoint;
+	};
+};
+
+/// GLFW callbacks only record events here. The main loop calls dispatch() once per frame, which runs the registered
+/// Mouse and Keyboard callbacks in order. The characters typed in a frame reach text callbacks as one string, so key
+/// repeat or an IME commit do not cost one edit per character. The run goes on across the key events of printable
+/// keys pressed without Ctrl, Alt or Super, which no shortcut handles, and those keys reach the key callbacks before
+/// the text. Any other key ends the run and keeps its place. Adjacent scroll and cursor move events are merged.
+class InputQueue {
+	inline static SPSCQueue<InputEvent, 4096> queue;
+
+   public:
+	static void push(const InputEvent &event);
+	static void dispatch();
+};
 // mouse will have different coordinates relative to different windows
 // so it cannot be static.
 class Mouse {
@@ -15,6 +53,7 @@ class Mouse {
 	Window	  &window;
 
 	Mouse();
+	friend class InputQueue;
 
 	static std::vector<std::function<void(GLFWwindow *, double, double)>> scrollCallbacks;
 	static std::vector<std::function<void(GLFWwindow *, int, int, int)>> mouseButtonCallbacks;
@@ -73,6 +112,8 @@ class Keyboard {
 
 	inline static std::vector<std::function<void(GLFWwindow *, int, int, int, int)>> callbacks;
 	inline static std::vector<std::function<void(GLFWwindow *, int)>> charCallbacks;
+	inline static std::vector<std::function<void(GLFWwindow *, std::u32string_view)>> textCallbacks;
+	friend class InputQueue;
 
 	static void handleInput(GLFWwindow *, int, int, int, int);
 	static void handleCharInput(GLFWwindow *, unsigned int);
@@ -113,6 +154,12 @@ class Keyboard {
 	 * @param callback - callback that will be called on every character input on every window.
 	 */
 	static void addCharCallback(const std::function<void(GLFWwindow *, int)> &callback);
+	/**
+	 * @brief Adds a callback to be called with every run of consecutive characters typed between two frames.
+	 *
+	 * @param callback - callback that will be called with the characters in the order they were typed.
+	 */
+	static void addTextCallback(const std::function<void(GLFWwindow *, std::u32string_view)> &callback);
 };
 
 }	  // namespace fxed
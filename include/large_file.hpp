@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "file_utils.hpp"
+#include "utils.hpp"
+
+namespace fxed {
+
+/// Read-only view of a file too large to load, kept mapped. A background thread records where every
+/// linesPerCheckpoint-th line starts, so finding a line scans at most that many lines of the mapping, and the file can
+/// be shown before the thread gets to its end. Only the lines asked for are decoded, into a small ring of recent lines.
+/// On Linux the thread then waits for the file to change through inotify and indexes whatever was appended, like
+/// tail -F. A file that shrinks, as logs do when they are truncated, is indexed again from the start, and so is a new
+/// file that takes the place of the old one, as when a log is rotated or a file is replaced by a rename.
+class LargeFile {
+	struct CachedLine {
+		std::size_t	   line	 = SIZE_MAX;
+		bool		   atEnd = false;	  /// ran to the end of the mapping, the file may add to it
+		std::u32string text;
+	};
+
+	std::filesystem::path path;
+
+	// written by the indexing thread
+	std::mutex						  mutex;
+	std::shared_ptr<const MappedFile> sharedFile;
+	std::vector<uint64_t>			  checkpoints;	   /// offset of every linesPerCheckpoint-th line
+	std::size_t						  newlineCount = 0;
+	uint64_t						  generation   = 0;	  /// counts the times the file was indexed from the start
+
+	int							  inotifyFd = -1;
+	int							  wakeFd	= -1;
+	int							  fileWatch = -1;
+	int							  dirWatch  = -1;		/// tells when a file takes the name of the one watched
+	std::pair<uint64_t, uint64_t> watchedFile;			/// device and inode of the file watched
+	std::jthread				  thread;
+
+	// the main thread's copies, taken in update()
+	std::shared_ptr<const MappedFile> file;
+	std::size_t						  lineCount		  = 1;
+	uint64_t						  knownGeneration = 0;
+	std::array<CachedLine, 1024>	  ring;							/// every line has one slot, line % ring.size()
+	std::pair<std::size_t, uint64_t>  lastFound		  = {0, 0};		/// the last line start found and its offset
+
+	void run(std::stop_token stop);
+	/// indexes the mapping from offset to its end, returns false if it was stopped
+	bool index(std::stop_token stop, const MappedFile &mapping, uint64_t offset);
+	/// watches the file at path now, returns false if there is none
+	bool	 watchFile();
+	/// waits for the file to change, returns false if it was stopped or cannot be watched. replaced is set when another
+	/// file took its place.
+	bool	 waitForChange(std::stop_token stop, bool &replaced);
+	uint64_t findLineStart(std::size_t line);
+
+   public:
+	static constexpr std::size_t linesPerCheckpoint = 1024;
+	/// longer lines are cut here, a file without line breaks should not be decoded whole
+	static constexpr std::size_t maxLineLength = 4096;
+
+	explicit LargeFile(const std::filesystem::path &path);
+	~LargeFile();
+	DELETE_COPY_AND_ASSIGNMENT(LargeFile);
+
+	/// takes what the indexing thread found since the last call, returns true if the file grew or was read again
+	bool update();
+
+	/// lines found so far, grows while the file is indexed and when lines are appended
+	std::size_t getLineCount() const { return lineCount; }
+	uint64_t	getSize() const { return file ? file->getSize() : 0; }
+	/// the line decoded to UTF-32, valid until the next call
+	const std::u32string &getLine(std::size_t line);
+};
+
+}	  // namespace fxed
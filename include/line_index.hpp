@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fxed {
+
+/// Code point offsets of the line starts of a text kept as separate lines, as if they were joined with '\n'. The line
+/// lengths are stored in blocks of a few hundred lines, with Fenwick trees over the line count and the length of every
+/// block. Looking up a line or an offset descends the trees and scans one block, O(log n + block size), and so does an
+/// edit that keeps the number of lines, which updates the trees in place. An edit that changes the number of lines
+/// splits again only the blocks it touches, but shifts the blocks after them and rebuilds both trees, which is linear
+/// in the number of blocks, a few thousand for a million lines. The lengths can also be any other count per line,
+/// VisualRows keeps rows in one.
+class LineIndex {
+	struct Block {
+		std::vector<uint32_t> lengths;	   /// of every line, counting its '\n'
+		uint64_t			  total = 0;
+	};
+
+	std::vector<Block>	  blocks;
+	std::vector<uint64_t> lineTree;		   /// Fenwick tree of the line counts of the blocks
+	std::vector<uint64_t> offsetTree;	   /// Fenwick tree of the totals of the blocks
+	std::size_t			  lineCount = 0;
+	uint64_t			  length	= 0;
+
+	void rebuildTrees();
+	void addToTrees(std::size_t block, uint64_t lengthDelta);
+	/// the block holding the line with this value in tree, and how far into the block it is
+	std::pair<std::size_t, uint64_t> descend(const std::vector<uint64_t> &tree, uint64_t value) const;
+
+   public:
+	/// blocks are split when they grow past this and merged with the next one when they shrink below a quarter of it
+	static constexpr std::size_t maxBlockSize = 512;
+
+	void assign(std::span<const std::u32string> lines);
+	void assign(std::span<const uint32_t> lengths);
+	/// replaces lines [first, first + removed) with lines
+	void replace(std::size_t first, std::size_t removed, std::span<const std::u32string> lines);
+	/// the same with the length of every line given directly and used as is
+	void replace(std::size_t first, std::size_t removed, std::span<const uint32_t> lengths);
+
+	std::size_t getLineCount() const { return lineCount; }
+	/// code points in all lines, with a '\n' after each
+	uint64_t getLength() const { return length; }
+
+	/// length of one line, counting its '\n'
+	uint32_t getLineLength(std::size_t line) const;
+
+	/// offset of the first code point of a line, getLength() past the last line
+	uint64_t	lineToOffset(std::size_t line) const;
+	/// line holding the code point at offset, the '\n' at the end belongs to the line, the last line past the end
+	std::size_t offsetToLine(uint64_t offset) const;
+};
+
+}	  // namespace fxed
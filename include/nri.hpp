@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstddef>
+#include <future>
 #include <memory>
 #include <glm/glm.hpp>
 #include <iostream>
@@ -462,6 +463,10 @@ class ProgramBuilder {
 	virtual std::unique_ptr<GraphicsProgram>   buildGraphicsProgram()							  = 0;
 	virtual std::unique_ptr<ComputeProgram>	   buildComputeProgram()							  = 0;
 	virtual std::unique_ptr<RayTracingProgram> buildRayTracingProgram(nri::CommandBuffer &cmdBuf) = 0;
+	virtual std::unique_ptr<ProgramBuilder>	   clone() const									  = 0;
+
+	/// builds a snapshot of the current state on the thread pool, the builder can be reused immediately
+	std::future<std::unique_ptr<GraphicsProgram>> buildGraphicsProgramAsync();
 };
 
 /// Program - represents a GPU program (shader)
@@ -533,6 +538,17 @@ class ImageAndAllocation {
 //	virtual ~Renderer() {}
 // };
 
+/// piece of a window's per-frame upload ring. Only valid until the frame that allocated it has finished on the GPU.
+struct UploadSlice {
+	Buffer	   *buffer;
+	std::size_t offset;	   /// offset of the slice within buffer
+	void	   *data;	   /// persistently mapped, write only
+};
+
+/// number of frames the CPU may record ahead of the GPU. Per-frame resources are indexed with
+/// Window::getCurrentFrameIndex() and must not be touched again until the same index comes around.
+constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+
 class Window {
    public:
 	using SurfaceSizeGetter = std::function<glm::uvec2(void)>;
@@ -546,14 +562,18 @@ class Window {
 	virtual ~Window() {}
 	Window(NRI &nri, SurfaceSizeGetter getter);
 
-	virtual bool			beginFrame()			  = 0;
-	virtual void			endFrame()				  = 0;
-	virtual ImageAndViewRef getCurrentRenderTarget()  = 0;
-	virtual CommandBuffer  &getCurrentCommandBuffer() = 0;
+	virtual bool			beginFrame()				 = 0;
+	virtual void			endFrame()					 = 0;
+	virtual ImageAndViewRef	getCurrentRenderTarget()	 = 0;
+	virtual CommandBuffer  &getCurrentCommandBuffer()	 = 0;
+	virtual uint32_t		getCurrentFrameIndex() const = 0;
 
 	virtual void beginRendering(CommandBuffer &cmdBuf, const ImageAndViewRef &renderTarget) = 0;
 	virtual void endRendering(CommandBuffer &cmdBuf)										= 0;
 
+	/// bump-allocates transient vertex/index data for the current frame, released when its frame slot is reused
+	virtual UploadSlice allocateUpload(std::size_t size, std::size_t alignment = 16) = 0;
+
 	virtual CommandQueue &getMainQueue() = 0;
 	glm::vec4			  clearColor	 = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
 
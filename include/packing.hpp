@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <optional>
@@ -39,6 +40,9 @@ class RowAtlasPacker : public AtlasPacker {
 	uint32_t			  rowHeight;
 
    public:
+	/// bump when the packing strategy changes, persisted atlases are keyed on it
+	static constexpr uint32_t VERSION = 1;
+
 	RowAtlasPacker(uint32_t width, uint32_t height, uint32_t rowHeight)
 		: AtlasPacker(width, height), rowHeight(rowHeight) {
 		assert(rowHeight > 0 && rowHeight <= height);
@@ -68,5 +72,18 @@ class RowAtlasPacker : public AtlasPacker {
 		rowOffsets.clear();
 		rowOffsets.resize(height / rowHeight, 0);
 	}
+
+	uint32_t					 getRowHeight() const { return rowHeight; }
+	const std::vector<uint32_t> &getRowOffsets() const { return rowOffsets; }
+
+	/// restores the fill state of every row, e.g. from a persisted atlas
+	bool restoreRowOffsets(const uint32_t *offsets, std::size_t count) {
+		if (count != rowOffsets.size()) return false;
+		for (std::size_t i = 0; i < count; ++i) {
+			if (offsets[i] > width) return false;
+		}
+		std::copy(offsets, offsets + count, rowOffsets.begin());
+		return true;
+	}
 };
 }	  // namespace fxed
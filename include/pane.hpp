@@ -1,14 +1,22 @@
 #pragma once
 
+#include "edit_journal.hpp"
+#include "file_save.hpp"
+#include "file_search.hpp"
 #include "file_tree.hpp"
+#include "large_file.hpp"
 #include "mesh.hpp"
 #include "nri.hpp"
 #include "resource_manager.hpp"
+#include "syntax_highlight.hpp"
 #include "text_editor.hpp"
 #include "text_rendering.hpp"
+#include "text_search.hpp"
 #include "utf8_convert.hpp"
+#include "visual_rows.hpp"
 
 #include <filesystem>
+#include <optional>
 #include <vector>
 #include <string>
 
@@ -48,10 +56,19 @@ class Pane {
 	virtual void mouseClick(fxed::Mouse &mouse, int button, int action, int mods);
 	virtual void mouseMove(fxed::Mouse &mouse, double deltaX, double deltaY);
 	virtual void charInput(unsigned int codepoint);
+	/// a run of characters typed since the last frame, calls charInput for each by default
+	virtual void textInput(std::u32string_view text);
 	virtual void keyInput(int key, int scancode, int action, int mods);
 
 	virtual void undo() {}
 	virtual void redo() {}
+	virtual void find() {}
+	virtual void replace() {}
+	virtual void goToLine() {}
+	/// called by TabsPane when the tab of the pane is switched to
+	virtual void tabActivated() {}
+	/// called by TabsPane every frame for each of its tabs, also the ones not shown, before the shown one renders
+	virtual void update() {}
 };
 
 class TextPane : public Pane {
@@ -64,6 +81,11 @@ class TextPane : public Pane {
 	std::u32string	text;
 	float			scrollSpeed = 2.f;
 
+	/// builds textMesh again, when the wrap width or the font atlas changed
+	virtual void rebuildMesh();
+	/// how far down the text goes in em, scrolling stops there
+	virtual float getTextHeight() const { return textMesh.getBounds().y; }
+
    public:
 	bool wordWrap = true;
 
@@ -79,7 +101,56 @@ class TextPane : public Pane {
 
 class TextEditorPane : public TextPane {
    protected:
-	DefaultTextEditor editor;
+	DefaultTextEditor		editor;
+	fxed::SyntaxHighlighter highlighter;
+
+	fxed::TextSearch				 search;
+	bool							 findActive		= false;
+	bool							 replaceActive	= false;
+	bool							 replaceFocused	= false;	 /// typing goes to the replacement instead of the query
+	bool							 replacePending	= false;	 /// replaceAll runs once the search has every match
+	std::u32string					 replacement;
+	bool							 goToActive = false;	 /// the find bar asks for a line to go to instead
+	std::u32string					 goToQuery;
+	TextMeshInstanced				 findBarMesh;
+	std::u32string					 findBarText;
+	std::vector<fxed::TextHighlight> highlights;
+
+	fxed::VisualRows rows;
+	std::size_t		 meshFirstRow = 0;	   /// textMesh holds the rows [meshFirstRow, meshLastRow) of the document
+	std::size_t		 meshLastRow  = 0;
+
+	/// Lays out the rows in view and a screen above and below them, the text in textMesh is only those lines. The
+	/// lines laid out are measured first, so the rows of the mesh match the ones in rows.
+	void  rebuildMesh() override;
+	float getTextHeight() const override;
+	/// visual rows [first, last) in view, with one more on each side as TextRenderer::queueText draws them
+	std::pair<std::size_t, std::size_t> getRowsInView() const;
+	/// runs change, which may change the number of rows of any line, and scrolls so the line at the top of the view
+	/// stays in place, returns what change returned
+	template <class F>
+	bool keepTopLine(F &&change);
+	void updateHighlights();
+	void renderFindBar();
+	/// hands the edits made since the last call to the highlighter, the rows and onEdit
+	void flushEdits();
+	/// called with every edit flushed, after the highlighter and the rows have it
+	virtual void onEdit(const LineEdit &) {}
+	/// called before the text changes, a pane that reads the text over several frames finishes with it here
+	virtual void beforeEdit() {}
+	/// the editor, for a change to its text, every edit goes through here so beforeEdit sees it
+	DefaultTextEditor &editText() {
+		beforeEdit();
+		return editor;
+	}
+	/// moves the cursor to the next match after it, or the previous one before it
+	void jumpToMatch(bool forward);
+	/// replaces every match with replacement, as one undo step, once the search is done
+	void replaceAll();
+	/// adds a cursor on the line above (dy = -1) or below (dy = 1) all cursors
+	void addCursor(int dy);
+	/// moves the cursor to goToQuery, "line", "line:column" or "#offset"
+	void goToQueryPosition();
 
    public:
 	TextEditorPane(nri::NRI &nri, nri::CommandQueue &queue, uint32_t width, uint32_t height, TextRenderer &textRenderer,
@@ -89,24 +160,91 @@ class TextEditorPane : public TextPane {
 
 	DefaultTextEditor &getEditor() { return editor; }
 
+	void mouseClick(fxed::Mouse &mouse, int button, int action, int mods) override;
 	void charInput(unsigned int codepoint) override;
+	void textInput(std::u32string_view text) override;
 	void keyInput(int key, int scancode, int action, int mods) override;
 
 	void undo() override;
 	void redo() override;
+	void find() override;
+	void replace() override;
+	void goToLine() override;
 };
 
+/// An editor for a file on disk. Files larger than largeFileSize are opened read-only instead: the editor stays empty
+/// and the lines in view are read from a LargeFile, which also picks up lines appended to the file. Saving runs in the
+/// background with a FileSave and the tab name shows how it went. A pane restored with a session can wait with reading
+/// its file until its tab is first switched to.
 class FileTextEditorPane : public TextEditorPane {
+   public:
+	/// where the tab was left, what a Session keeps of it
+	struct View {
+		glm::ivec2 cursor{0, 0};		  /// column and line
+		glm::vec2  translation{0, 1};	  /// scroll offset in em
+	};
+
    protected:
-	std::filesystem::path filePath;
+	std::filesystem::path			   filePath;
+	std::unique_ptr<fxed::LargeFile>   largeFile;					/// only in read-only mode
+	std::unique_ptr<fxed::EditJournal> journal;						/// started by the first edit to the file's text
+	bool							   recovered	   = false;		/// the text came from a journal, not from the disk
+	bool							   fileTextFlushed = false;		/// the text read from the file went through onEdit
+
+	fxed::FileSave save;
+	bool		   saveAgain		 = false;	  /// saved again while a save was running
+	bool		   editedWhileSaving = false;
+	std::string	   saveError;					  /// why the last save failed
+
+	bool				loaded = false;
+	std::optional<View> pendingView;	 /// set before the file was loaded, load applies it
+
+	void  rebuildMesh() override;
+	float getTextHeight() const override;
+	void  onEdit(const LineEdit &edit) override;
+	void  beforeEdit() override;
+	/// the file name with the state of the file, and the tab strip laid out again to show it
+	void updateName();
+	void finishSave(std::error_code error);
+	/// Reads the file, which is either edited or opened read-only depending on its size. Does nothing after the first
+	/// call, a restored tab reads it when it is first shown or given input and refuses to save before.
+	void load();
 
    public:
+	static constexpr std::uintmax_t largeFileSize = 128ull << 20;
+
 	FileTextEditorPane(nri::NRI &nri, nri::CommandQueue &queue, uint32_t width, uint32_t height,
-					   TextRenderer &textRenderer, const std::filesystem::path &filePath);
+					   TextRenderer &textRenderer, const std::filesystem::path &filePath, bool lazy = false);
+	/// a save that is running is still written
+	~FileTextEditorPane() override;
 
 	const std::filesystem::path &getFilePath() const;
+	bool						 isReadOnly() const { return largeFile != nullptr; }
+
+	View getView() const;
+	/// moves the cursor and scrolls, to a cursor clamped to the text as it is read from the file
+	void setView(const View &view);
+
+	/// wait for the file to reach the disk before a save counts as done
+	bool syncOnSave = true;
 
+	/// starts saving the text as it is now, the file is written in the background
 	void saveToFile();
+	/// replaces the text with one recovered from a journal, which stays unsaved until saveToFile, a lazy pane does not
+	/// read its file then
+	void restore(std::u32string_view text);
+
+	void render(nri::CommandBuffer &cmdBuf) override;
+	void charInput(unsigned int codepoint) override;
+	void textInput(std::u32string_view text) override;
+	void keyInput(int key, int scancode, int action, int mods) override;
+	void undo() override;
+	void redo() override;
+	void find() override;
+	void replace() override;
+	void goToLine() override;
+	void tabActivated() override;
+	void update() override;
 };
 
 class SplitPane : public Pane {
@@ -137,12 +275,16 @@ class SplitPane : public Pane {
 
 class FileTreePane : public TextPane {
    protected:
-	std::filesystem::path currentPath;
-	FileTree			  fileTree;
-	int					  selectedRow;
-	FileTree::iterator	  selectedIt;
+	std::filesystem::path		currentPath;
+	FileTree					fileTree;
+	int							selectedRow;
+	int							firstVisibleRow = 0;	 // rows of the tree currently laid out in textMesh
+	std::vector<std::u32string> rowTexts;				 // text of the rows laid out, from firstVisibleRow on
 
+	/// lays out the rows in view, only the rows that changed since the last call or came into view are read again
 	void refreshListing();
+	void selectRow(int row);
+	void activateRow(int row);
 
    public:
 	FileTreePane(nri::NRI &nri, nri::CommandQueue &queue, uint32_t width, uint32_t height, TextRenderer &textRenderer);
@@ -154,17 +296,67 @@ class FileTreePane : public TextPane {
 	void setPath(const std::filesystem::path &p);
 
 	const std::filesystem::path &getPath() const;
+	std::vector<std::filesystem::path> getOpenDirectories() const { return fileTree.getOpenDirectories(); }
+	/// expands the directories, relative to the path, as their listings arrive
+	void openDirectories(const std::vector<std::filesystem::path> &directories);
+};
+
+/// Searches the files under a folder for a string and lists the matching lines, see FileSearch. Typing edits the
+/// query, Enter searches, or opens the selected result when the query did not change since.
+class FindInFilesPane : public TextPane {
+   protected:
+	std::filesystem::path			 root;
+	std::u32string					 query;
+	std::u32string					 searchedQuery;	 /// the query of the results shown
+	std::u32string					 header;
+	std::shared_ptr<FileSearch>		 search;
+	std::vector<FileSearch::Match>	 results;
+	std::vector<fxed::TextHighlight> highlights;
+	int								 selectedResult	 = 0;
+	int								 firstVisibleRow = 0;
+	int								 visibleRowCount = 0;
+	bool							 rowsChanged	 = true;
+
+	/// lays out the header and the results in view, like FileTreePane
+	void refreshListing();
+	void startSearch();
+	void selectResult(int index);
+	void openResult(int index);
+
+   public:
+	FindInFilesPane(nri::NRI &nri, nri::CommandQueue &queue, uint32_t width, uint32_t height,
+					TextRenderer &textRenderer, const std::filesystem::path &root);
+	~FindInFilesPane() override;
+
+	void render(nri::CommandBuffer &cmdBuf) override;
+	void mouseClick(fxed::Mouse &mouse, int button, int action, int mods) override;
+
+	void charInput(unsigned int codepoint) override;
+	void textInput(std::u32string_view text) override;
+	void keyInput(int key, int scancode, int action, int mods) override;
 };
 
 class TabsPane : public Pane {
    protected:
+	/// cached position of a tab header, in pixels relative to the pane
+	struct TabHeader {
+		float x;
+		float width;
+	};
+
 	std::vector<std::shared_ptr<Pane>> tabs;
-	std::vector<TextMesh>			   tabMeshes;	  // TODO: optimize by using a single mesh for all tabs
-	uint32_t						   activeTab = 0;
+	std::vector<TabHeader>			   tabHeaders;
+	TextMeshInstanced				   headerMesh;	   /// every tab name, one row per tab
+	bool							   headersDirty = true;
+	uint32_t						   activeTab	= 0;
 	TextRenderer					  &textRenderer;
 	uint32_t						   textRendererVersion;
 
 	void placeTab(std::shared_ptr<Pane> &pane);
+	/// lays out the tab strip again, only needed when tabs are added, removed or renamed or the font size changes
+	void updateHeaders();
+	/// index of the tab header under x, -1 if there is none
+	int findTabAt(float x) const;
 
    public:
 	TabsPane(nri::NRI &nri, nri::CommandQueue &queue, uint32_t width, uint32_t height, TextRenderer &textRenderer);
@@ -179,7 +371,10 @@ class TabsPane : public Pane {
 	void mouseMove(fxed::Mouse &mouse, double deltaX, double deltaY) override;
 
 	void								setActiveTab(uint32_t index);
+	uint32_t							getActiveTab() const { return activeTab; }
 	std::vector<std::shared_ptr<Pane>> &getTabs() { return tabs; }
+	/// call after a tab's name changed
+	void invalidateHeaders() { headersDirty = true; }
 };
 
 }	  // namespace fxed
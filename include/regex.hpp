@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace fxed {
+
+/// code points [begin, end) of a line
+struct RegexMatch {
+	uint32_t begin;
+	uint32_t end;
+};
+
+/// Regular expressions over single lines: literals, ., [] classes, \d \w \s and their negations, groups, |, *, +, ?,
+/// {m,n}, ^ and $. The pattern is compiled to an NFA that runs as a DFA built lazily, each state the first time the
+/// text reaches it, so the cached states are bounded. Matches are leftmost-longest and do not overlap. Throws
+/// std::runtime_error when the pattern does not parse or its NFA would be too large.
+class Regex {
+   public:
+	/// sorted, disjoint, inclusive ranges
+	using CharSet = std::vector<std::pair<char32_t, char32_t>>;
+
+	struct NfaState {
+		enum Kind : uint8_t { CHARS, SPLIT, LINE_START, LINE_END, MATCH };
+
+		Kind	 kind;
+		uint32_t chars = 0;		 /// index into charSets, for CHARS
+		int32_t	 next  = -1;
+		int32_t	 next1 = -1;	 /// the other branch of a SPLIT, -1 if there is none
+	};
+
+	explicit Regex(std::u32string_view pattern);
+
+	/// Appends the matches in line that start at or after from to matches, and stops after the first match past about
+	/// budget characters stepped through. Returns where to continue with the same line, npos once it is done.
+	std::size_t findAll(std::u32string_view line, std::vector<RegexMatch> &matches, std::size_t from = 0,
+						std::size_t budget = SIZE_MAX);
+
+	/// a string every match contains, lines without it are skipped before running the DFA
+	const std::u32string &getRequiredLiteral() const { return requiredLiteral; }
+
+   private:
+	/// DFA states are sets of NFA states, with the transition for each character class filled in when first taken
+	struct Dfa {
+		std::vector<NfaState>					nfa;
+		int32_t									nfaStart	   = 0;
+		bool									unanchored	   = false;		/// a match may start anywhere
+		std::map<std::vector<int32_t>, int32_t>	stateIds;
+		std::vector<std::vector<int32_t>>		states;
+		std::vector<uint8_t>					accepting;					   /// bits: inside, at the end, empty line
+		std::vector<int32_t>					transitions;				   /// states x classes, -1 if not taken yet
+		int32_t									startStates[2] = {-1, -1};	   /// not at / at the line start
+		uint32_t								flushes		   = 0;			   /// times the cache was dropped
+		std::size_t								cachedSize	   = 0;			   /// NFA states in all cached sets
+	};
+
+	std::vector<CharSet>  charSets;
+	std::vector<char32_t> classBounds;	   /// character class k is [classBounds[k - 1], classBounds[k])
+	uint16_t			  asciiClasses[128];
+	std::u32string		  requiredLiteral;
+
+	Dfa	forward;	 /// anchored at the match start, finds where the longest match ends
+	Dfa	reverse;	 /// the reversed pattern run backwards over the line, finds where matches start
+
+	std::vector<uint8_t>  matchStarts;
+	/// per position of the line, the forward state an earlier scan had there and which scan it was
+	std::vector<int32_t>  scanStates;
+	std::vector<uint32_t> scanIds;
+	std::vector<int64_t>  scanEnds;			   /// last accepting position of each scan, -1 if it never accepted
+	uint32_t			  scanFlushes = 0;	   /// forward.flushes when scanStates was filled
+	std::vector<uint32_t> visited;			   /// NFA states already in the closure being built
+	uint32_t			  visitGeneration = 0;
+
+	std::size_t classCount() const { return classBounds.size() + 1; }
+	uint32_t	classOf(char32_t c) const;
+	bool		contains(uint32_t charSet, char32_t c) const;
+	bool		accepts(const Dfa &dfa, int32_t state, bool atLineEnd, bool emptyLine) const;
+
+	void	closure(const Dfa &dfa, std::vector<int32_t> &seeds, bool atLineStart, bool atLineEnd,
+					std::vector<int32_t> &out);
+	int32_t addState(Dfa &dfa, std::vector<int32_t> &&set);
+	int32_t startState(Dfa &dfa, bool atLineStart);
+	int32_t step(Dfa &dfa, int32_t state, char32_t c);
+};
+
+}	  // namespace fxed
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace fxed {
+
+/// What is open in a folder, kept in the cache directory when the editor closes and restored when it opens the folder
+/// again: the tabs with their cursors and scroll offsets and the directories expanded in the file tree. The file is a
+/// small header followed by the tabs and the directories, each with its path, and is replaced as a whole on every
+/// save.
+struct Session {
+	struct Tab {
+		std::filesystem::path path;
+		glm::ivec2			  cursor{0, 0};			/// column and line
+		glm::vec2			  translation{0, 1};	/// scroll offset in em, see TextRenderState
+	};
+
+	std::filesystem::path			   folder;
+	std::vector<std::filesystem::path> openDirectories;		/// relative to folder, parents before their children
+	std::vector<Tab>				   tabs;
+	uint32_t						   activeTab = 0;
+
+	/// where the session of folder is kept, empty if there is no cache directory
+	static std::filesystem::path getSessionPath(const std::filesystem::path &folder);
+	/// the session last saved for folder, nothing if there is none or it cannot be read
+	static std::optional<Session> load(const std::filesystem::path &folder);
+	bool						  save() const;
+};
+
+}	  // namespace fxed
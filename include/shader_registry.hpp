@@ -1,9 +1,12 @@
 #pragma once
-#include <unordered_map>
-#include <string>
+#include <cstddef>
+#include <string_view>
+
 struct ShaderData {
-	const unsigned char* data;
-	size_t length;
+	const unsigned char *data;
+	size_t				 length;
 };
 
-extern std::unordered_map<std::string, ShaderData> g_shaders;
+/// looks up an embedded SPIR-V binary by its shadercache file name, e.g. "text_hlsl_VSMain.spv". The registry is
+/// generated by gen_shader_registry.py for release builds. Returns {nullptr, 0} for unknown shaders.
+ShaderData findShader(std::string_view name);
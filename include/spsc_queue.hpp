@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+/// Bounded lock-free queue for exactly one producer thread and one consumer thread. Capacity must be a power of two.
+template <class T, std::size_t Capacity>
+class SPSCQueue {
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SPSCQueue capacity must be a power of two");
+
+	std::array<T, Capacity> items;
+	/// indices grow forever and wrap with the mask, head == tail means empty
+	alignas(64) std::atomic<std::size_t> head = 0;	   /// next item to read, written by the consumer
+	alignas(64) std::atomic<std::size_t> tail = 0;	   /// next slot to write, written by the producer
+
+   public:
+	/// returns false if the queue is full
+	bool push(const T &item) {
+		std::size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+		items[t & (Capacity - 1)] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	/// the oldest item without removing it, nullptr if the queue is empty. Consumer only.
+	const T *peek() const {
+		std::size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return nullptr;
+		return &items[h & (Capacity - 1)];
+	}
+
+	/// returns false if the queue is empty
+	bool pop(T &item) {
+		const T *front = peek();
+		if (front == nullptr) return false;
+		item = *front;
+		head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool empty() const { return peek() == nullptr; }
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "text_editor.hpp"
+#include "utils.hpp"
+
+namespace fxed {
+
+/// languages with a lexer, everything else is shown as plain text
+enum class Language : uint8_t { NONE, CPP };
+
+/// picks the lexer from the file extension, the same way getIconForFile picks an icon
+Language getLanguageForFile(const std::filesystem::path &path);
+
+enum class TokenKind : uint8_t { TEXT, KEYWORD, TYPE, NUMBER, STRING, COMMENT, PREPROCESSOR, PUNCTUATION };
+
+/// lexer state at the end of a line, the only thing a line needs from the lines before it
+enum class LexState : uint8_t {
+	NORMAL,
+	BLOCK_COMMENT,
+	LINE_COMMENT,	  /// a // comment ending with a backslash continues on the next line
+	STRING,			  /// so does a string literal
+	UNKNOWN = 0xff,	  /// line not tokenized yet
+};
+
+/// Tokenizes one line of C++ starting in the given state. Writes the kind of every character to kinds and returns
+/// the state at the end of the line.
+LexState tokenizeLine(std::u32string_view line, LexState state, std::vector<TokenKind> &kinds);
+
+glm::vec4 getTokenColor(TokenKind kind);
+
+/// Keeps a copy of the document's lines with the lexer state at the end of each one. After an edit only the edited
+/// lines are tokenized again, and the lines after them only until the end state matches the one from before the edit.
+/// Runs on the shared thread pool in short batches so a large reparse never holds up new edits.
+class HighlightWorker : public std::enable_shared_from_this<HighlightWorker> {
+   public:
+	struct LineTokens {
+		uint64_t			   generation;	   /// edit generation the line number refers to
+		uint32_t			   line;
+		std::vector<TokenKind> kinds;
+	};
+
+   private:
+	struct PendingEdit {
+		uint64_t					generation;
+		LineEdit					edit;
+		std::vector<std::u32string> lines;
+	};
+
+	std::mutex				 mutex;
+	std::vector<PendingEdit> pending;
+	std::vector<LineTokens>	 finished;
+	bool					 running   = false;
+	std::atomic<bool>		 cancelled = false;
+
+	// only touched by the running task
+	std::vector<std::u32string> lines;
+	std::vector<LexState>		endStates;
+	std::set<uint32_t>			dirtyLines;
+	uint64_t					generation = 0;
+
+	void applyEdit(PendingEdit &edit);
+	void run();
+
+   public:
+	void edit(uint64_t generation, const LineEdit &edit, std::vector<std::u32string> &&newLines);
+	void cancel() { cancelled = true; }
+
+	std::vector<LineTokens> takeFinished();
+};
+
+/// Token kinds of a document for the main thread. Lines keep their old colors until the worker catches up.
+class SyntaxHighlighter {
+	std::shared_ptr<HighlightWorker>	worker = std::make_shared<HighlightWorker>();
+	std::vector<std::vector<TokenKind>> lineTokens;
+	/// edits the worker may not have seen yet, to move its results to current line numbers
+	std::deque<std::pair<uint64_t, LineEdit>> unseenEdits;
+	uint64_t								  generation = 0;
+	Language								  language	 = Language::NONE;
+
+   public:
+	SyntaxHighlighter() = default;
+	~SyntaxHighlighter();
+	DELETE_COPY_AND_ASSIGNMENT(SyntaxHighlighter);
+
+	/// set before the first update, with NONE no line is ever sent to the worker
+	void setLanguage(Language language) { this->language = language; }
+	/// sends the lines changed by an edit, as taken from the text with takeLineEdit, to the worker
+	void update(const TextStateBase &text, const LineEdit &edit);
+	/// merges finished lines, returns true if any token changed
+	bool poll();
+
+	TokenKind getToken(std::size_t line, std::size_t column) const {
+		if (line >= lineTokens.size() || column >= lineTokens[line].size()) return TokenKind::TEXT;
+		return lineTokens[line][column];
+	}
+};
+
+}	  // namespace fxed
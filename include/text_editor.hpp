@@ -1,28 +1,71 @@
 #pragma once
 
+#include <optional>
 #include <ranges>
 #include <stack>
 #include <string_view>
+#include <utility>
+#include <vector>
 #include "any_range.hpp"
 #include "font.hpp"
 #include "input.hpp"
+#include "line_index.hpp"
 #include "ranges_join_with.hpp"
 
+/// lines [first, first + removed) were replaced by lines [first, first + inserted)
+struct LineEdit {
+	uint32_t first;
+	uint32_t removed;
+	uint32_t inserted;
+
+	/// a single edit with the same effect as this one followed by next, which is in the line numbers after this one
+	LineEdit then(const LineEdit &next) const;
+};
+
+/// Lines [first, first + count) of the text, and what they are in the version of the text before or after an edit.
+/// Swapping the two for every hunk of the edit undoes or redoes it.
+struct LineHunk {
+	uint32_t					first;
+	uint32_t					count;
+	std::vector<std::u32string> lines;
+};
+
 class TextStateBase {
    public:
-	virtual void		   insertChar(char32_t c)		   = 0;
-	virtual char32_t	   deleteChar()					   = 0;
-	virtual void		   moveCursor(int dx, int dy)	   = 0;
-	virtual void		   setCursor(glm::ivec2 pos)	   = 0;
-	virtual glm::ivec2	   getCursorPos() const			   = 0;
-	virtual char32_t	   getCharAt(glm::ivec2 pos) const = 0;
-	virtual std::u32string getText() const				   = 0;
+	virtual void				  insertChar(char32_t c)						= 0;
+	virtual void				  insertText(std::u32string_view text)			= 0;
+	virtual char32_t			  deleteChar()									= 0;
+	virtual void				  moveCursor(int dx, int dy)					= 0;
+	virtual void				  setCursor(glm::ivec2 pos)						= 0;
+	virtual glm::ivec2			  getCursorPos() const							= 0;
+	virtual char32_t			  getCharAt(glm::ivec2 pos) const				= 0;
+	virtual std::u32string		  getText() const								= 0;
+	virtual size_t				  getLineCount() const							= 0;
+	virtual const std::u32string &getLine(size_t line) const					= 0;
+	virtual void				  replaceLine(size_t line, std::u32string text)	= 0;
+
+	/// cursors besides the one at getCursorPos(), sorted, every edit is made at all of them
+	virtual const std::vector<glm::ivec2> &getExtraCursors() const							= 0;
+	virtual void						   setExtraCursors(std::vector<glm::ivec2> cursors)	= 0;
+	/// Inserts text at every cursor, or with deleteBefore removes the character before each, in one pass over the
+	/// lines. Returns the old versions of the changed lines, for swapHunks to put back.
+	virtual std::vector<LineHunk> editAtCursors(std::u32string_view text, bool deleteBefore) = 0;
+	/// Puts the other version of each hunk's lines in the text, moving every line at most once. The hunks are sorted,
+	/// do not overlap and are numbered as in the text before the swap, and after it as in the new text.
+	virtual void swapHunks(std::vector<LineHunk> &hunks) = 0;
+
+	/// code point offset in getText() where a line starts, and the line an offset is on, see fxed::LineIndex
+	virtual uint64_t lineToOffset(size_t line) const	 = 0;
+	virtual size_t	 offsetToLine(uint64_t offset) const = 0;
 
 	virtual bool hasCursorMoved() const = 0;
 	virtual bool hasTextChanged() const = 0;
 	virtual void resetCursorMoved()		= 0;
 	virtual void resetTextChanged()		= 0;
 
+	/// lines changed since the last call, merged into one range
+	virtual std::optional<LineEdit> takeLineEdit() = 0;
+
 	virtual size_t milisecondsSinceLastMove() const = 0;
 	virtual ~TextStateBase()						= default;
 };
@@ -68,27 +111,101 @@ class DeleteCharAction : public Action {
 	void print(std::ostream &os) const override;
 };
 
+/// a run of typed characters, undone and redone as one step
+class InsertTextAction : public Action {
+	glm::ivec2	   positionBefore;
+	glm::ivec2	   positionAfter;
+	std::u32string text;
+
+   public:
+	InsertTextAction(glm::ivec2 position, std::u32string_view text)
+		: positionBefore(position), positionAfter(0), text(text) {}
+
+	bool forward(TextStateBase &editor) override;
+	void backward(TextStateBase &editor) override;
+	void print(std::ostream &os) const override;
+};
+
+/// whole lines replaced at once, like by a replace all, undone and redone as one step
+class ReplaceLinesAction : public Action {
+	std::vector<uint32_t>		lineNumbers;
+	std::vector<std::u32string> otherLines;		/// what each line is not right now, swapped in by forward and backward
+
+	void swapLines(TextStateBase &editor);
+
+   public:
+	ReplaceLinesAction(std::vector<uint32_t> &&lineNumbers, std::vector<std::u32string> &&newLines)
+		: lineNumbers(std::move(lineNumbers)), otherLines(std::move(newLines)) {}
+
+	bool forward(TextStateBase &editor) override;
+	void backward(TextStateBase &editor) override;
+	void print(std::ostream &os) const override;
+};
+
+/// one keystroke made at every cursor, undone and redone as one step
+class MultiCursorAction : public Action {
+	std::u32string			text;
+	bool					deleteBefore;
+	glm::ivec2				cursorBefore;
+	std::vector<glm::ivec2> extraBefore;
+	glm::ivec2				cursorAfter{0, 0};
+	std::vector<glm::ivec2> extraAfter;
+	std::vector<LineHunk>	hunks;		/// empty until the first forward
+
+   public:
+	MultiCursorAction(glm::ivec2 cursor, std::vector<glm::ivec2> extraCursors, std::u32string_view text,
+					  bool deleteBefore)
+		: text(text), deleteBefore(deleteBefore), cursorBefore(cursor), extraBefore(std::move(extraCursors)) {}
+
+	bool forward(TextStateBase &editor) override;
+	void backward(TextStateBase &editor) override;
+	void print(std::ostream &os) const override;
+};
+
 class TextState : public TextStateBase {
 	glm::ivec2					cursorPos{0, 0};
+	std::vector<glm::ivec2>		extraCursors;
 	std::vector<std::u32string> lines;
 	int							currentMax = 0;
+	std::optional<LineEdit>		lineEdit;
+
+	/// brought up to date with the lines changed since, on the first lookup after an edit
+	mutable fxed::LineIndex			lineIndex;
+	mutable std::optional<LineEdit> indexEdit;
 
 	int32_t measureLineOffset(int line, int charOffset) const;
+	void	recordEdit(uint32_t first, uint32_t removed, uint32_t inserted);
+	void	updateLineIndex() const;
+	/// moves the extra cursors an edit left past the end of their line or of the text back inside it
+	void	clampExtraCursors();
 
 	bool										   cursorMoved	= false;
 	bool										   textChanged	= true;
 	std::chrono::high_resolution_clock::time_point lastMoveTime = std::chrono::high_resolution_clock::now();
 
    public:
-	TextState() { lines.emplace_back(); }
+	TextState() : lineEdit(LineEdit{0, 0, 1}), indexEdit(LineEdit{0, 0, 1}) { lines.emplace_back(); }
 	TextState(fxed::any_input_range<char32_t> &&text);
 	void		   insertChar(char32_t c) override;
+	void		   insertText(std::u32string_view text) override;
 	char32_t	   deleteChar() override;
 	void		   moveCursor(int dx, int dy) override;
 	void		   setCursor(glm::ivec2 pos) override;
 	char32_t	   getCharAt(glm::ivec2 pos) const override;
 	std::u32string getText() const override;
 
+	size_t				  getLineCount() const override { return lines.size(); }
+	const std::u32string &getLine(size_t line) const override { return lines[line]; }
+	void				  replaceLine(size_t line, std::u32string text) override;
+
+	const std::vector<glm::ivec2> &getExtraCursors() const override { return extraCursors; }
+	void						   setExtraCursors(std::vector<glm::ivec2> cursors) override;
+	std::vector<LineHunk>		   editAtCursors(std::u32string_view text, bool deleteBefore) override;
+	void						   swapHunks(std::vector<LineHunk> &hunks) override;
+
+	uint64_t lineToOffset(size_t line) const override;
+	size_t	 offsetToLine(uint64_t offset) const override;
+
 	auto getTextRange() const { return lines | fxed::join_with(U'\n'); }
 
 	glm::ivec2 getCursorPos() const override;
@@ -98,6 +215,8 @@ class TextState : public TextStateBase {
 	void resetCursorMoved() override;
 	void resetTextChanged() override;
 
+	std::optional<LineEdit> takeLineEdit() override { return std::exchange(lineEdit, std::nullopt); }
+
 	size_t milisecondsSinceLastMove() const override;
 };
 
@@ -108,11 +227,23 @@ class TextEditor : public TextStateBase {
 
 	TextStateType textState;
 
+	/// records a MultiCursorAction, what every edit becomes while there is more than one cursor
+	void editAllCursors(std::u32string_view text, bool deleteBefore) {
+		auto action = std::make_unique<MultiCursorAction>(textState.getCursorPos(), textState.getExtraCursors(), text,
+														  deleteBefore);
+		if (!action->forward(textState)) return;
+		undoStack.push(std::move(action));
+		while (!redoStack.empty()) {
+			redoStack.pop();
+		}
+	}
+
    public:
 	TextEditor() = default;
 	TextEditor(auto &&textState) : textState(std::forward<decltype(textState)>(textState)) {}
 
 	void insertChar(char32_t c) override {
+		if (!textState.getExtraCursors().empty()) return editAllCursors(std::u32string_view(&c, 1), false);
 		auto action = std::make_unique<InsertCharAction>(textState.getCursorPos(), c);
 		if (!action->forward(textState)) return;
 		undoStack.push(std::move(action));
@@ -121,7 +252,23 @@ class TextEditor : public TextStateBase {
 		}
 	}
 
+	void insertText(std::u32string_view text) override {
+		if (text.empty()) return;
+		if (!textState.getExtraCursors().empty()) return editAllCursors(text, false);
+		if (text.size() == 1) return insertChar(text.front());
+		auto action = std::make_unique<InsertTextAction>(textState.getCursorPos(), text);
+		if (!action->forward(textState)) return;
+		undoStack.push(std::move(action));
+		while (!redoStack.empty()) {
+			redoStack.pop();
+		}
+	}
+
 	char32_t deleteChar() override {
+		if (!textState.getExtraCursors().empty()) {
+			editAllCursors({}, true);
+			return U'\0';
+		}
 		auto action = std::make_unique<DeleteCharAction>(textState.getCursorPos());
 		if (!action->forward(textState)) return U'\0';
 		char32_t deletedChar = action->getDeletedChar();
@@ -139,6 +286,36 @@ class TextEditor : public TextStateBase {
 	std::u32string getText() const override { return textState.getText(); }
 	auto		   getTextRange() const { return textState.getTextRange(); }
 
+	size_t				  getLineCount() const override { return textState.getLineCount(); }
+	const std::u32string &getLine(size_t line) const override { return textState.getLine(line); }
+
+	void replaceLine(size_t line, std::u32string text) override {
+		std::vector<std::u32string> newLines;
+		newLines.push_back(std::move(text));
+		replaceLines({(uint32_t)line}, std::move(newLines));
+	}
+
+	const std::vector<glm::ivec2> &getExtraCursors() const override { return textState.getExtraCursors(); }
+	void setExtraCursors(std::vector<glm::ivec2> cursors) override { textState.setExtraCursors(std::move(cursors)); }
+	std::vector<LineHunk> editAtCursors(std::u32string_view text, bool deleteBefore) override {
+		return textState.editAtCursors(text, deleteBefore);
+	}
+	void swapHunks(std::vector<LineHunk> &hunks) override { textState.swapHunks(hunks); }
+
+	uint64_t lineToOffset(size_t line) const override { return textState.lineToOffset(line); }
+	size_t	 offsetToLine(uint64_t offset) const override { return textState.offsetToLine(offset); }
+
+	/// replaces each of lineNumbers with the matching new line, as one undo step
+	void replaceLines(std::vector<uint32_t> &&lineNumbers, std::vector<std::u32string> &&newLines) {
+		if (lineNumbers.empty()) return;
+		auto action = std::make_unique<ReplaceLinesAction>(std::move(lineNumbers), std::move(newLines));
+		if (!action->forward(textState)) return;
+		undoStack.push(std::move(action));
+		while (!redoStack.empty()) {
+			redoStack.pop();
+		}
+	}
+
 	void redo() {
 		if (redoStack.empty()) return;
 		auto action = std::move(redoStack.top());
@@ -155,11 +332,16 @@ class TextEditor : public TextStateBase {
 		redoStack.push(std::move(action));
 	}
 
+	/// false while the text is as it was given to the editor, with every edit made to it undone
+	bool canUndo() const { return !undoStack.empty(); }
+
 	bool hasCursorMoved() const override { return textState.hasCursorMoved(); }
 	bool hasTextChanged() const override { return textState.hasTextChanged(); }
 	void resetCursorMoved() override { textState.resetCursorMoved(); }
 	void resetTextChanged() override { textState.resetTextChanged(); }
 
+	std::optional<LineEdit> takeLineEdit() override { return textState.takeLineEdit(); }
+
 	size_t milisecondsSinceLastMove() const override { return textState.milisecondsSinceLastMove(); }
 };
 
@@ -1,12 +1,15 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <span>
+#include <vector>
 #include "any_range.hpp"
 #include "font.hpp"
 #include "mesh.hpp"
 #include "nri.hpp"
 #include "resource_manager.hpp"
-#include "static_vector.hpp"
 #include "utils.hpp"
 namespace fxed {
 
@@ -33,32 +36,79 @@ class TextMesh : public fxed::Mesh {
 	bool	  isOverflowed() const { return overflowed; }
 };
 
-class TextMeshInstanced {
-	std::unique_ptr<nri::Allocation> memory;
-	std::unique_ptr<nri::Buffer>	 indexBuffer;
-	std::unique_ptr<nri::Buffer>	 instanceBuffer;
+/// a colored quad behind a range of text on one row
+struct TextHighlight {
+	glm::vec2 position;		/// left end on the baseline, in em like glyph translations
+	float	  width;
+	glm::vec4 color;
+};
 
+/// glyph color by position in em, used when the text has no highlighting
+struct GradientGlyphColor {
+	glm::vec4 operator()(std::size_t, std::size_t, glm::vec2 position) const {
+		float p = position.x + position.y;
+		return glm::vec4(std::sin(p * 0.1f) * 0.5f + 0.5f, std::sin(p * 0.1f + 2) * 0.5f + 0.5f,
+						 std::sin(p * 0.1f + 4) * 0.5f + 0.5f, 1.0f);
+	}
+};
+
+/// Glyph instances of a block of text, kept on the CPU. TextRenderer copies the rows in view into its frame batch.
+class TextMeshInstanced {
+   public:
 	struct InstanceData {
 		glm::vec4 color;
 		glm::vec2 translation;
-		int32_t	  charIndex;
-		int32_t	  drawMode;
+		int32_t	  charIndex;	 /// glyph, or the quad width in em as float bits for HIGHLIGHT
+		uint16_t  drawMode;
+		uint16_t  drawIndex;	 /// entry in the frame's draw list, filled in by TextRenderer
 	};
-	StaticVector<InstanceData> instanceData;	 /// pointer to mapped instance buffer memory
-	glm::vec2				   bounds;
-	bool					   overflowed = false;
+
+   private:
+	std::vector<InstanceData> instanceData;
+	std::vector<uint32_t>	  rowStarts;	 /// index of the first instance on every visual row
+	std::vector<float>		  rowWidths;	 /// right edge of the last glyph on every visual row, in em
+	std::vector<uint32_t>	  lineRows;		 /// visual row every line of the text starts on
+	std::size_t				  maxInstanceCount;
+	glm::vec2				  bounds;
+	bool					  overflowed = false;
+	float					  wrapWidth	 = 0;	  /// in em, 0 if lines do not wrap
+	std::size_t				  firstLine	 = 0;	  /// the text laid out starts with this line of the document
+	std::size_t				  firstRow	 = 0;	  /// on this visual row, rowStarts and lineRows count from it
 
    public:
-	TextMeshInstanced(nri::NRI &nri, nri::CommandQueue &q, std::size_t maxInstanceCount);
+	explicit TextMeshInstanced(std::size_t maxInstanceCount);
 
-	glm::vec2 getBounds() const { return bounds; }
-	bool	  isOverflowed() const { return overflowed; }
+	glm::vec2	getBounds() const { return bounds; }
+	bool		isOverflowed() const { return overflowed; }
+	std::size_t getRowCount() const { return firstRow + rowStarts.size(); }
+	float		getRowWidth(std::size_t row) const {
+		return row >= firstRow && row - firstRow < rowWidths.size() ? rowWidths[row - firstRow] : 0.f;
+	}
+	/// line of the text shown on a visual row, the first or last line laid out for rows outside of them
+	std::size_t getLineAtRow(std::size_t row) const {
+		if (lineRows.empty() || row < firstRow) return firstLine;
+		return firstLine + (std::ranges::upper_bound(lineRows, row - firstRow) - lineRows.begin() - 1);
+	}
 
-	void bind(nri::CommandBuffer &cmdBuffer) const;
-	void draw(nri::CommandBuffer &cmdBuffer, nri::GraphicsProgram &program) const;
-
-	template <std::ranges::input_range R>
-	glm::vec2 updateText(R &&text, fxed::FontAtlas &font, glm::ivec2 cursorPos = {0, 0}, float lineWidth = 0);
+	/// instances on rows [firstRow, lastRow)
+	std::span<const InstanceData> getInstances(std::size_t firstRow, std::size_t lastRow) const;
+
+	/// Adds quads covering columns [begin, end) of a line, one for every visual row the range is wrapped onto. The
+	/// line must be the same text that was laid out by the last updateText.
+	void addHighlights(std::u32string_view line, std::size_t lineIndex, std::size_t begin, std::size_t end,
+					   fxed::FontAtlas &font, glm::vec4 color, std::vector<TextHighlight> &highlights) const;
+	/// where a column of a line is laid out, on the baseline in em, with the same wrapping as addHighlights
+	glm::vec2 getColumnPosition(std::u32string_view line, std::size_t lineIndex, std::size_t column,
+								fxed::FontAtlas &font) const;
+	/// the column of a line nearest to x on one of the visual rows the line is wrapped onto
+	std::size_t getColumnAt(std::u32string_view line, std::size_t lineIndex, std::size_t row, float x,
+							fxed::FontAtlas &font) const;
+
+	/// glyphColor(line, column, position) gives the color of every glyph. The text can be a part of a longer one, its
+	/// lines are then numbered from firstLine and laid out from the visual row firstRow on, the rows before stay empty.
+	template <std::ranges::input_range R, class ColorFn = GradientGlyphColor>
+	glm::vec2 updateText(R &&text, fxed::FontAtlas &font, glm::ivec2 cursorPos = {0, 0}, float lineWidth = 0,
+						 ColorFn &&glyphColor = {}, std::size_t firstLine = 0, std::size_t firstRow = 0);
 
 	static std::vector<nri::VertexBinding> getVertexBindings();
 };
@@ -66,18 +116,36 @@ class TextMeshInstanced {
 struct TextRenderState {
 	glm::vec2  translation{0, 0};
 	glm::ivec2 viewportSize;
+	glm::ivec2 viewportPosition{0, 0};	   /// top left corner of the viewport in window pixels, also the clip rect
 	glm::vec2  cursorPos;
 	bool	   showCursor = true;
+	/// drawn before the text, for selections and search matches
+	std::span<const TextHighlight> highlights;
 };
 
+/// Instanced text is not drawn right away. queueText() collects the visible glyphs of every pane for the frame, with
+/// each pane's position and clip rect stored once in a draw list, and flush() draws them all with a single draw call.
+/// Anything drawn with another program lands under the queued text, so a pane that draws over its own text flushes
+/// the batch first.
 class TextRenderer {
+   public:
+	/// one queued pane, matches TextDraw in text_instanced.hlsl
+	struct TextDraw {
+		glm::vec2 origin;		  /// viewport position in window pixels
+		glm::vec2 translation;	  /// scroll offset in em
+		glm::vec4 clipRect;		  /// min and max corners in window pixels
+	};
+
+   private:
 	fxed::FontAtlas	  font;
-	static ResourceID cursorMeshID;
 	static ResourceID shaderID;
-	static ResourceID cursorShaderID;
 	static ResourceID shader_TWO_ID;
 	uint32_t		  version;
 	float			  fontSize;
+	nri::Window		 *window = nullptr;
+
+	std::vector<TextMeshInstanced::InstanceData> frameInstances;
+	std::vector<TextDraw>						 frameDraws;
 
    public:
 	fxed::FontAtlas &getFont() { return font; }
@@ -88,13 +156,21 @@ class TextRenderer {
 	TextRenderer(nri::NRI &nri, nri::CommandQueue &queue, fxed::FontAtlas &&font);
 	DELETE_COPY_AND_ASSIGNMENT(TextRenderer);
 
+	/// starts a new batch, flush() uploads it to this window's current frame
+	void beginFrame(nri::Window &window);
+
 	void renderText(nri::CommandBuffer &cmdBuf, const fxed::TextMesh &textMesh, const TextRenderState &renderState);
 
-	void renderText(nri::CommandBuffer &cmdBuf, const fxed::TextMeshInstanced &textMesh,
-					const TextRenderState &renderState);
+	/// adds the rows of the mesh that are in view, and the cursor, to the frame batch
+	void queueText(const fxed::TextMeshInstanced &textMesh, const TextRenderState &renderState);
+	/// adds rows [firstRow, lastRow) only, for meshes that pack independent labels into separate rows
+	void queueText(const fxed::TextMeshInstanced &textMesh, const TextRenderState &renderState, std::size_t firstRow,
+				   std::size_t lastRow);
+	/// draws everything queued since beginFrame or the last flush, can be called more than once per frame
+	void flush(nri::CommandBuffer &cmdBuf);
 };
 
-enum class CharacterDrawMode { ALPHA = 0, COLOR = 1, MSDF = 2 };
+enum class CharacterDrawMode { ALPHA = 0, COLOR = 1, MSDF = 2, CURSOR = 3, HIGHLIGHT = 4 };
 
 template <std::ranges::input_range R>
 glm::vec2 TextMesh::updateText(R &&text, fxed::FontAtlas &font, glm::ivec2 cursorPos, float lineWidth) {
@@ -195,23 +271,30 @@ glm::vec2 TextMesh::updateText(R &&text, fxed::FontAtlas &font, glm::ivec2 curso
 	return cursorPosResult;
 }
 
-template <std::ranges::input_range R>
-glm::vec2 TextMeshInstanced::updateText(R &&text, fxed::FontAtlas &font, glm::ivec2 cursorPos, float lineWidth) {
+template <std::ranges::input_range R, class ColorFn>
+glm::vec2 TextMeshInstanced::updateText(R &&text, fxed::FontAtlas &font, glm::ivec2 cursorPos, float lineWidth,
+										ColorFn &&glyphColor, std::size_t firstLine, std::size_t firstRow) {
+	double	  lineHeight	  = 1.2;
 	bounds					  = glm::vec2(0, 0);
 	glm::vec2 cursorPosResult = cursorPos;
 	size_t	  offset		  = 0;
 	size_t	  indexCount	  = 0;
-	int		  advanceY		  = 0;
-	double	  advanceDY		  = 0.0;
+	int		  advanceY		  = firstLine;
+	double	  advanceDY		  = firstRow * lineHeight;
 	int		  advanceX		  = 0;
 	double	  advanceDX		  = 0.0;
-	double	  lineHeight	  = 1.2;
 	overflowed				  = false;
 
 	size_t j = 0;
 	instanceData.clear();
+	rowStarts.assign(1, 0);
+	rowWidths.assign(1, 0.f);
+	lineRows.assign(1, 0);
+	wrapWidth		= lineWidth > 0 ? lineWidth / font.getFontSize() : 0;
+	this->firstLine = firstLine;
+	this->firstRow	= firstRow;
 	for (auto i = text.begin(); i != text.end(); ++i) {
-		if (j >= instanceData.capacity()) {
+		if (j >= maxInstanceCount) {
 			dbLog(dbg::LOG_WARNING, "TextMesh max character count exceeded, truncating text");
 			break;
 		}
@@ -224,6 +307,9 @@ glm::vec2 TextMeshInstanced::updateText(R &&text, fxed::FontAtlas &font, glm::iv
 			advanceDX = 0.0;
 			advanceY += 1;
 			advanceX = 0;
+			rowStarts.push_back(instanceData.size());
+			rowWidths.push_back(0.f);
+			lineRows.push_back(rowStarts.size() - 1);
 
 			continue;
 		}
@@ -234,6 +320,8 @@ glm::vec2 TextMeshInstanced::updateText(R &&text, fxed::FontAtlas &font, glm::iv
 			advanceDY += lineHeight;
 			advanceDX  = 0.0;
 			overflowed = true;
+			rowStarts.push_back(instanceData.size());
+			rowWidths.push_back(0.f);
 		}
 		if (index == -1) {
 			dbLog(dbg::LOG_ERROR, "Failed to get glyph box for codepoint ", (int)*i);
@@ -254,19 +342,17 @@ glm::vec2 TextMeshInstanced::updateText(R &&text, fxed::FontAtlas &font, glm::iv
 			if (font.getFontSize() >= 32) { drawMode = CharacterDrawMode::MSDF; }
 
 			if (box.isBitmap) { drawMode = CharacterDrawMode::COLOR; }
-			float p = advanceDX + advanceDY;
 			instanceData.push_back(InstanceData{
-				//.color = glm::vec4(rand() / (float)RAND_MAX, rand() / (float)RAND_MAX, rand() /
-				//(float)RAND_MAX, 1.0f),
-				.color = glm::vec4(std::sin(p * 0.1f) * 0.5f + 0.5f, std::sin(p * 0.1f + 2) * 0.5f + 0.5f,
-								   std::sin(p * 0.1f + 4) * 0.5f + 0.5f, 1.0f),
+				.color		 = glyphColor(advanceY, advanceX, glm::vec2(advanceDX, advanceDY)),
 				.translation = glm::vec2(advanceDX, advanceDY),
 				.charIndex	 = index,
-				.drawMode	 = static_cast<int32_t>(drawMode),
+				.drawMode	 = static_cast<uint16_t>(drawMode),
+				.drawIndex	 = 0,
 			});
 
 			bounds.x = std::max({bounds.x, box_bound_0_x, box_bound_1_x, box_bound_2_x, box_bound_3_x});
 			bounds.y = std::max({bounds.y, box_bound_0_y, box_bound_1_y, box_bound_2_y, box_bound_3_y});
+			rowWidths.back() = std::max({rowWidths.back(), box_bound_0_x, box_bound_2_x});
 
 			offset += 4;
 			indexCount += 6;
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "regex.hpp"
+#include "text_editor.hpp"
+
+namespace fxed {
+
+struct TextMatch {
+	uint32_t line;
+	uint32_t column;
+	uint32_t length;
+
+	auto operator<=>(const TextMatch &) const = default;
+};
+
+/// Index of the first occurrence of needle in haystack at or after from, or npos. Compares the first and last
+/// character of the needle against 8 (AVX2) or 4 (SSE2) positions at once and checks the rest only where both match.
+std::size_t findInLine(std::u32string_view haystack, std::u32string_view needle, std::size_t from = 0);
+
+/// findInLine for UTF-8 or other byte strings, 32 (AVX2) or 16 (SSE2) positions at once
+std::size_t findBytes(std::string_view haystack, std::string_view needle, std::size_t from = 0);
+
+/// Incremental search over the lines of a TextStateBase. step() does a bounded amount of work, so the search runs a
+/// little every frame and matches show up while it is still going. A query that extends the previous one only checks
+/// the previous matches again instead of scanning the whole text. Regular expressions are matched line by line, see
+/// Regex.
+class TextSearch {
+	std::u32string			query;
+	bool					regexMode	  = false;
+	std::optional<Regex>	regex;	   /// the compiled query, if it is a valid regular expression
+	std::string				error;	   /// why the regular expression did not compile
+	std::vector<TextMatch>	matches;
+	std::vector<TextMatch>	candidates;		/// matches of a shorter query, still to be checked against this one
+	std::vector<RegexMatch>	lineMatches;
+	std::size_t				nextCandidate = 0;
+	std::size_t				nextLine	  = 0;
+	std::size_t				nextColumn	  = 0;	   /// where the regular expression continues in nextLine
+	bool					done		  = true;
+
+   public:
+	void setQuery(std::u32string_view query, bool isRegex = false);
+	/// searches again from the start, call when the text changed
+	void restart();
+
+	/// searches until the budget runs out, returns true if any match was added
+	bool step(const TextStateBase &text, std::chrono::microseconds budget);
+
+	bool				  isDone() const { return done; }
+	bool				  isRegex() const { return regexMode; }
+	const std::u32string &getQuery() const { return query; }
+	const std::string	 &getError() const { return error; }
+
+	std::span<const TextMatch> getMatches() const { return matches; }
+	/// matches on lines [firstLine, lastLine)
+	std::span<const TextMatch> getMatches(std::size_t firstLine, std::size_t lastLine) const;
+};
+
+}	  // namespace fxed
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "utils.hpp"
+
+namespace fxed {
+
+/// Fixed size work-stealing thread pool. Tasks submitted from a worker go to that worker's own queue, idle workers
+/// steal from the others. Used for background I/O and compilation, never for anything the frame waits on.
+class ThreadPool {
+	struct WorkQueue {
+		std::deque<std::function<void()>> tasks;
+		std::mutex						  mutex;
+	};
+
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	std::vector<std::jthread>				threads;
+	std::mutex								sleepMutex;
+	std::condition_variable					wakeUp;
+	std::atomic<std::size_t>				pendingCount = 0;
+	std::atomic<std::size_t>				nextQueue	 = 0;
+	bool									stopping	 = false;
+
+	void workerLoop(std::size_t index);
+	/// takes a task from the preferred queue, or with steal from any other one
+	bool popTask(std::size_t preferredQueue, std::function<void()> &task, bool steal = true);
+
+   public:
+	explicit ThreadPool(unsigned int threadCount = 0);
+	~ThreadPool();
+	DELETE_COPY_AND_ASSIGNMENT(ThreadPool);
+
+	static ThreadPool &getInstance();
+
+	std::size_t getThreadCount() const { return threads.size(); }
+
+	void execute(std::function<void()> &&task);
+
+	template <class F>
+	auto submit(F &&f) -> std::future<std::invoke_result_t<F>> {
+		using R	  = std::invoke_result_t<F>;
+		auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+		auto fut  = task->get_future();
+		execute([task]() { (*task)(); });
+		return fut;
+	}
+
+	/// runs one task from the calling worker's own queue, returns false if it is empty or the caller is no worker
+	bool runPendingTask();
+
+	/// waits for the future. A worker runs tasks from its own queue meanwhile, which holds the ones it submitted, so
+	/// workers can wait on tasks they submitted themselves. Any other thread, the UI thread too, only waits.
+	template <class T>
+	T await(std::future<T> &future) {
+		while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			if (!runPendingTask()) future.wait_for(std::chrono::microseconds(100));
+		}
+		return future.get();
+	}
+};
+
+}	  // namespace fxed
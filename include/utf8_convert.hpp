@@ -133,6 +133,8 @@ class ToUtf32 : public std::ranges::view_interface<ToUtf32<R>> {
 				codepoint = (codepoint << 6) | (c & 0x3F);
 				++it;
 			}
+			// a sequence that ends the input is still a codepoint
+			if (it == end) forceValid = true;
 		}
 	};
 
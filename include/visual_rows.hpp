@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "font.hpp"
+#include "line_index.hpp"
+#include "text_editor.hpp"
+#include "utils.hpp"
+
+namespace fxed {
+
+/// Number of visual rows every line of a document is wrapped onto, for one wrap width and font, kept in a LineIndex so
+/// lines and rows map to each other in logarithmic time. Edited lines are measured right away. When the width or the
+/// font changes, every line keeps its old count until it is measured again on the shared thread pool, in chunks of
+/// lines copied out of the document, and the caller measures the lines in view first. FontAtlas may add glyphs and is
+/// not safe to use from the workers, so they measure with a table of ASCII advances and leave other lines to the main
+/// thread.
+class VisualRows {
+	struct Chunk {
+		std::size_t					first;	   /// moved by edits made while it is measured, main thread only
+		std::vector<std::u32string> lines;
+		std::vector<uint32_t>		rows;	   /// 0 for lines the worker could not measure
+		std::atomic<bool>			cancelled = false;
+	};
+	struct Finished {
+		std::mutex							mutex;
+		std::vector<std::shared_ptr<Chunk>> chunks;
+	};
+	using AsciiAdvances = std::array<float, 128>;	  /// in em, negative for code points the workers do not measure
+
+	LineIndex										 rows;
+	float											 wrapWidth	 = 0;	  /// in em, 0 if lines do not wrap
+	uint32_t										 fontVersion = 0;
+	std::shared_ptr<const AsciiAdvances>			 asciiAdvances;
+	std::vector<std::pair<std::size_t, std::size_t>> stale;		/// sorted line ranges [first, last) not measured yet
+	std::vector<std::shared_ptr<Chunk>>				 inFlight;
+	std::shared_ptr<Finished>						 finished	 = std::make_shared<Finished>();
+
+	uint32_t countRows(std::u32string_view line, FontAtlas &font) const;
+	void	 reset(const TextStateBase &text, FontAtlas &font, float wrapWidth, uint32_t fontVersion);
+	bool	 collect(FontAtlas &font);
+	void	 dispatch(const TextStateBase &text);
+
+   public:
+	/// a chunk ends after this many lines or code points, whichever comes first
+	static constexpr std::size_t chunkLines		 = 4096;
+	static constexpr std::size_t chunkCodePoints = 1 << 17;
+	/// larger edits leave their lines to the workers
+	static constexpr std::size_t maxMeasuredEdit = 256;
+
+	VisualRows() = default;
+	~VisualRows();
+	DELETE_COPY_AND_ASSIGNMENT(VisualRows);
+
+	/// moves the counts to the line numbers after an edit and measures the edited lines
+	void edit(const TextStateBase &text, const LineEdit &edit, FontAtlas &font);
+	/// Starts measuring again if the width or the font changed, merges the chunks the workers finished and hands out
+	/// new ones. lineWidth is in pixels like for TextMeshInstanced::updateText. Returns true if any count changed.
+	bool update(const TextStateBase &text, FontAtlas &font, float lineWidth, uint32_t fontVersion);
+	/// measures lines [first, last) now if they are not yet, returns true if any count changed
+	bool measure(const TextStateBase &text, std::size_t first, std::size_t last, FontAtlas &font);
+
+	bool		isMeasuring() const { return !stale.empty() || !inFlight.empty(); }
+	std::size_t getRowCount() const { return rows.getLength(); }
+	std::size_t lineToRow(std::size_t line) const { return rows.lineToOffset(line); }
+	/// line shown on a visual row, the last line for rows past the end
+	std::size_t rowToLine(std::size_t row) const { return rows.offsetToLine(row); }
+
+	/// where a column of a line is laid out, on the baseline in em, like TextMeshInstanced::getColumnPosition but for
+	/// any line of the document
+	glm::vec2 getColumnPosition(std::u32string_view line, std::size_t lineIndex, std::size_t column,
+								FontAtlas &font) const;
+};
+
+}	  // namespace fxed
@@ -535,6 +535,41 @@ class PipelineLayout {
 	vk::PipelineLayout		 &operator*() { return pipelineLayout; }
 };
 
+class PipelineCache {
+	vk::PipelineCache pipelineCache;
+	vk::Device		  device;
+
+   public:
+	void clear() {
+		if (pipelineCache) {
+			vkDestroyPipelineCache(device, pipelineCache, nullptr);
+			pipelineCache = nullptr;
+		}
+	}
+
+	PipelineCache(std::nullptr_t) : pipelineCache(nullptr), device(nullptr) {}
+	PipelineCache(vk::Device device, vk::PipelineCache pipelineCache) : pipelineCache(pipelineCache), device(device) {}
+	~PipelineCache() { clear(); }
+	DELETE_COPY_AND_ASSIGNMENT(PipelineCache);
+	PipelineCache(PipelineCache &&other) noexcept : pipelineCache(other.pipelineCache), device(other.device) {
+		other.pipelineCache = nullptr;
+	}
+	PipelineCache &operator=(PipelineCache &&other) noexcept {
+		if (this != &other) {
+			clear();
+			pipelineCache		= other.pipelineCache;
+			device				= other.device;
+			other.pipelineCache = nullptr;
+		}
+		return *this;
+	}
+
+							 operator vk::PipelineCache() const { return pipelineCache; }
+							 operator VkPipelineCache() const { return pipelineCache; }
+	const vk::PipelineCache &operator*() const { return pipelineCache; }
+	vk::PipelineCache		&operator*() { return pipelineCache; }
+};
+
 class Semaphore {
 	vk::Semaphore semaphore;
 	vk::Device	  device;
@@ -1,8 +1,12 @@
 #pragma once
 #include <vulkan/vulkan_core.h>
+#include <array>
+#include <filesystem>
 #include <memory>
 #include <optional>
 #include <iostream>
+#include <map>
+#include <mutex>
 
 #include <variant>
 
@@ -72,16 +76,62 @@ class VulkanDescriptorAllocator {
 	const auto &getDescriptorSetLayout() const { return descriptorSetLayout; }
 };
 
+/// Hands out ranges of large vkDeviceMemory blocks, so meshes and atlases don't each need their own allocation.
+/// Host visible blocks are mapped once for their whole lifetime. Allocations keep the allocator alive.
+class VulkanMemoryAllocator {
+   public:
+	static constexpr std::size_t BLOCK_SIZE = 64 * 1024 * 1024;
+
+	struct Block {
+		uint32_t						   memoryTypeIndex;
+		vkraii::DeviceMemory			   memory	= nullptr;
+		std::size_t						   size		= 0;
+		std::size_t						   usedSize	= 0;
+		char							  *mapped	= nullptr;
+		std::map<std::size_t, std::size_t> freeRanges;	   /// offset -> size, neighbouring ranges are always merged
+	};
+
+	struct Range {
+		Block		*block	= nullptr;
+		std::size_t offset = 0;
+		std::size_t size   = 0;
+	};
+
+   private:
+	vk::Device							device;
+	vk::PhysicalDeviceMemoryProperties	memoryProperties;
+	std::size_t							granularity;
+	std::vector<std::unique_ptr<Block>> blocks;
+	std::mutex							mutex;
+
+	uint32_t findMemoryType(MemoryTypeRequest typeRequest) const;
+	Block	*createBlock(uint32_t memoryTypeIndex, std::size_t size);
+
+   public:
+	VulkanMemoryAllocator(VulkanNRI &nri);
+	DELETE_COPY_AND_ASSIGNMENT(VulkanMemoryAllocator);
+
+	Range allocate(const MemoryRequirements &memoryRequirements);
+	void  free(const Range &range);
+};
+
 class VulkanAllocation : public Allocation {
-	vkraii::DeviceMemory memory;
-	vk::Device			 device;
-	std::size_t			 size;
+	std::shared_ptr<VulkanMemoryAllocator> allocator;
+	VulkanMemoryAllocator::Range		   range;
+	vk::Device							   device;
+	std::size_t							   size;
 
    public:
-	VulkanAllocation(std::nullptr_t) : memory(nullptr), device(nullptr), size(0) {}
+	VulkanAllocation(std::nullptr_t) : device(nullptr), size(0) {}
 	VulkanAllocation(VulkanNRI &nri, MemoryRequirements memoryRequirements);
-
-	vk::DeviceMemory getMemory() { return memory; }
+	DELETE_COPY_AND_ASSIGNMENT(VulkanAllocation);
+	VulkanAllocation(VulkanAllocation &&other) noexcept;
+	VulkanAllocation &operator=(VulkanAllocation &&other) noexcept;
+	~VulkanAllocation();
+
+	vk::DeviceMemory getMemory() { return range.block->memory; }
+	/// where this allocation starts inside getMemory(), resources are bound relative to it
+	std::size_t		 getMemoryOffset() const { return range.offset; }
 	vk::Device		 getDevice() { return device; }
 	std::size_t		 getSize() const override { return size; }
 
@@ -272,6 +322,7 @@ class VulkanProgramBuilder : public ProgramBuilder {
 	std::unique_ptr<GraphicsProgram>   buildGraphicsProgram() override;
 	std::unique_ptr<ComputeProgram>	   buildComputeProgram() override;
 	std::unique_ptr<RayTracingProgram> buildRayTracingProgram(nri::CommandBuffer &cmdBuff) override;
+	std::unique_ptr<ProgramBuilder>	   clone() const override { return std::make_unique<VulkanProgramBuilder>(*this); }
 };
 
 class VulkanProgram : virtual Program {
@@ -336,16 +387,33 @@ class VulkanWindow : public Window {
 	vkb::Swapchain	   swapChain;
 	VulkanCommandQueue presentQueue;
 
-	vkraii::Semaphore imageAvailableSemaphore;
-	vkraii::Semaphore renderFinishedSemaphore;
-	vkraii::Fence	  inFlightFence;
+	struct UploadChunk {
+		std::unique_ptr<Allocation> allocation;
+		std::unique_ptr<Buffer>		buffer;
+		char					   *data = nullptr;
+		std::size_t					used = 0;
+	};
+	static constexpr std::size_t UPLOAD_CHUNK_SIZE = 1024 * 1024;
 
-	std::vector<ImageAndView<VulkanImage2D, VulkanRenderTarget>> swapChainImages;
+	struct FrameData {
+		vkraii::Semaphore					 imageAvailableSemaphore = nullptr;
+		vkraii::Fence						 inFlightFence			 = nullptr;
+		std::unique_ptr<VulkanCommandBuffer> commandBuffer;
+		std::vector<UploadChunk>			 uploadChunks;
+	};
+	std::array<FrameData, MAX_FRAMES_IN_FLIGHT> frames;
+	/// one per swapchain image, the presentation engine may hold it after the frame's fence has signaled
+	std::vector<vkraii::Semaphore> renderFinishedSemaphores;
 
-	std::unique_ptr<VulkanCommandBuffer> commandBuffer;
+	std::vector<ImageAndView<VulkanImage2D, VulkanRenderTarget>> swapChainImages;
 
 	uint32_t width = 0, height = 0;
 	uint32_t currentImageIndex = 0;
+	uint32_t currentFrame	   = 0;
+
+	vkraii::Semaphore createSemaphore();
+	UploadChunk		  createUploadChunk(std::size_t size);
+	void			  resetUploads(FrameData &frame);
 
 	vk::Format		  surfaceFormat;
 	vk::ColorSpaceKHR surfaceColorSpace;
@@ -360,10 +428,13 @@ class VulkanWindow : public Window {
 	void			endFrame() override;
 	ImageAndViewRef getCurrentRenderTarget() override;
 	CommandBuffer  &getCurrentCommandBuffer() override;
+	uint32_t		getCurrentFrameIndex() const override { return currentFrame; }
 
 	void beginRendering(CommandBuffer &cmdBuf, const ImageAndViewRef &renderTarget) override;
 	void endRendering(CommandBuffer &cmdBuf) override;
 
+	UploadSlice allocateUpload(std::size_t size, std::size_t alignment = 16) override;
+
 	const vkraii::SurfaceKHR									 &getSurface() { return surface; }
 	void														  setSurface(vkraii::SurfaceKHR &&surf);
 	vkb::Swapchain												 &getSwapChain() { return swapChain; }
@@ -382,11 +453,17 @@ class VulkanNRI : public NRI {
 
 	VulkanCommandPool						 defaultCommandPool;
 	std::optional<VulkanDescriptorAllocator> descriptorAllocator;
+	std::shared_ptr<VulkanMemoryAllocator>	 memoryAllocator;
+	vkraii::PipelineCache					 pipelineCache;
 
 	void createInstance();
 	void pickPhysicalDevice();
 	void createLogicalDevice();
 
+	std::filesystem::path getPipelineCachePath() const;
+	void				  createPipelineCache();
+	void				  savePipelineCache() const;
+
    public:
 	VulkanNRI(CreateBits createBits = CreateBits::DEFAULT);
 	~VulkanNRI();
@@ -413,6 +490,9 @@ class VulkanNRI : public NRI {
 		assert(descriptorAllocator.has_value());
 		return descriptorAllocator.value();
 	}
+	const std::shared_ptr<VulkanMemoryAllocator> &getMemoryAllocator() const { return memoryAllocator; }
+	/// shared by all pipeline builds, internally synchronized so worker threads can use it concurrently
+	const vkraii::PipelineCache &getPipelineCache() const { return pipelineCache; }
 	auto getDispatchTable() const { return disp; }
 	auto getInstanceDispatchTable() const { return inst_disp; }
 
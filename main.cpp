@@ -45,8 +45,11 @@ int main(int argc, char *argv[]) {
 			editor.openFile(path);
 		}
 	}
+	// the tabs left open in the folder, a file given on the command line stays in front
+	editor.restoreSession();
 
 	editor.mainLoop();
+	editor.saveSession();
 
 	nri->synchronize();
 
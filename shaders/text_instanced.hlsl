@@ -5,7 +5,8 @@ struct VSInput
 {
 	float4 color : COLOR;
 	float2 translation : TRANSLATION;
-	int2 charIndexDrawMode : CHAR_INDEX_DRAW_MODE;
+	int charIndex : CHAR_INDEX;
+	uint2 drawModeIndex : DRAW_MODE_INDEX;
 };
 
 struct VSOutput
@@ -13,19 +14,31 @@ struct VSOutput
 	float4 position : SV_POSITION;
 	float4 color : COLOR;
 	float2 texCoord : TEXCOORD0;
-	nointerpolation uint glyphKind : SV_InstanceID;
+	nointerpolation uint glyphKind : GLYPH_KIND;
+	nointerpolation float4 clipRect : CLIP_RECT;
 };
 
 struct PushConstants
 {
 	int2 viewportSize;
-	float2 translation;
-	TextureHandle texture;
+	uint drawBase;
 	float textSize;
-	float time;
+	TextureHandle texture;
 	ArrayBufferHandle glyphDataBuffer;
+	ArrayBufferHandle drawBuffer;
+};
+
+// one pane of the frame's batch, matches TextRenderer::TextDraw
+struct TextDraw
+{
+	float2 origin;
+	float2 translation;
+	float4 clipRect;
 };
 
+#define DRAW_MODE_CURSOR 3
+#define DRAW_MODE_HIGHLIGHT 4
+
 struct Rectangle
 {
 	int x, y, w, h;
@@ -50,9 +63,32 @@ PushConstants pushConstants : register(b0);
 [shader("vertex")]
 VSOutput VSMain(VSInput input, uint vertexID : SV_VertexID, uint instanceID : SV_InstanceID)
 {
-	float2 scale = 2.f * pushConstants.textSize / float2(pushConstants.viewportSize);
-
-	GlyphBox glyphBox = pushConstants.glyphDataBuffer.Load<GlyphBox>(input.charIndexDrawMode.x);
+	TextDraw draw = pushConstants.drawBuffer.Load<TextDraw>(pushConstants.drawBase + input.drawModeIndex.y);
+
+	GlyphBox glyphBox;
+	if (input.drawModeIndex.x == DRAW_MODE_CURSOR) {
+		// a thin bar from the ascender to below the baseline, drawn untextured
+		glyphBox.bounds.l = -0.05;
+		glyphBox.bounds.b = -0.2;
+		glyphBox.bounds.r = 0.05;
+		glyphBox.bounds.t = 0.8;
+		glyphBox.rect.x = 0;
+		glyphBox.rect.y = 0;
+		glyphBox.rect.w = 0;
+		glyphBox.rect.h = 0;
+	} else if (input.drawModeIndex.x == DRAW_MODE_HIGHLIGHT) {
+		// a full row behind the text, charIndex holds the width
+		glyphBox.bounds.l = 0.0;
+		glyphBox.bounds.b = -0.3;
+		glyphBox.bounds.r = asfloat(input.charIndex);
+		glyphBox.bounds.t = 0.9;
+		glyphBox.rect.x = 0;
+		glyphBox.rect.y = 0;
+		glyphBox.rect.w = 0;
+		glyphBox.rect.h = 0;
+	} else {
+		glyphBox = pushConstants.glyphDataBuffer.Load<GlyphBox>(input.charIndex);
+	}
 
 	float2 position = float2(0.0, 0.0);
 	float2 positions[4] = {
@@ -70,12 +106,15 @@ VSOutput VSMain(VSInput input, uint vertexID : SV_VertexID, uint instanceID : SV
 		float2(glyphBox.rect.x + glyphBox.rect.w, glyphBox.rect.y + glyphBox.rect.h)
 	};
 
+	float2 pixel = draw.origin + pushConstants.textSize * (position + input.translation + draw.translation);
+
 	VSOutput output;
-	output.position = float4(-1.f + scale * (position + input.translation + pushConstants.translation), 1.0, 1.0);
+	output.position = float4(-1.f + 2.f * pixel / float2(pushConstants.viewportSize), 1.0, 1.0);
 	output.color = input.color;
 	output.texCoord = abs(texCoords[vertexID % 4] / float2(512.0, 512.0));
 
-	output.glyphKind = input.charIndexDrawMode.y;
+	output.glyphKind = input.drawModeIndex.x;
+	output.clipRect = draw.clipRect;
 	return output;
 }
 
@@ -85,12 +124,24 @@ struct PSInput
 	float4 position : SV_POSITION;
 	float4 color : COLOR;
 	float2 texCoord : TEXCOORD0;
-	nointerpolation uint glyphKind : SV_InstanceID;
+	nointerpolation uint glyphKind : GLYPH_KIND;
+	nointerpolation float4 clipRect : CLIP_RECT;
 };
 
 [shader("pixel")]
 float4 PSMain(PSInput input) : SV_TARGET
 {
+	// every pane of the batch shares one scissor, clip to the pane here
+	if (any(input.position.xy < input.clipRect.xy) || any(input.position.xy >= input.clipRect.zw)) {
+		discard;
+	}
+	if (input.glyphKind == DRAW_MODE_CURSOR) {
+		return float4(input.color.rgb, 1.0);
+	}
+	if (input.glyphKind == DRAW_MODE_HIGHLIGHT) {
+		return float4(input.color.rgb * input.color.a, input.color.a);
+	}
+
 	float4 texColor;
 	if(pushConstants.texture.IsValid()) {
 		texColor = pushConstants.texture.Sample2D<float4>(input.texCoord);
@@ -1,5 +1,7 @@
 #include "buffer_utils.hpp"
 
+#include <algorithm>
+
 namespace fxed {
 
 std::tuple<std::vector<std::size_t>, nri::MemoryRequirements> getBufferOffsets(
@@ -10,14 +12,17 @@ std::tuple<std::vector<std::size_t>, nri::MemoryRequirements> getBufferOffsets(
 	}
 
 	std::size_t				 totalSize = 0;
+	std::size_t				 alignment = 1;
 	std::vector<std::size_t> offsets;
 	for (const auto &req : memReqs) {
 		if (totalSize % req.alignment != 0) { totalSize += req.alignment - (totalSize % req.alignment); }
 		offsets.push_back(totalSize);
 
 		totalSize += req.size;
+		alignment = std::max(alignment, req.alignment);
 	}
-	return {offsets, nri::MemoryRequirements(totalSize, nri::MemoryTypeRequest::MEMORY_TYPE_DEVICE, 0)};
+	// the allocation itself has to satisfy the strictest buffer, offsets are only relative to its start
+	return {offsets, nri::MemoryRequirements(totalSize, nri::MemoryTypeRequest::MEMORY_TYPE_DEVICE, alignment)};
 }
 
 std::unique_ptr<nri::Allocation> allocateBindMemory(nri::NRI &nri, const std::vector<nri::Buffer *> &buffers,
@@ -0,0 +1,333 @@
+#include "edit_journal.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <string_view>
+#include <system_error>
+
+#include "file_utils.hpp"
+#include "utf8_convert.hpp"
+
+using namespace fxed;
+
+// Layout: header, the path of the file, then records. A record is its header followed by the inserted lines, each a
+// uint32_t length and that many bytes of UTF-8.
+struct JournalHeader {
+	char	 magic[8];
+	uint32_t formatVersion;
+	uint32_t pathSize;
+	uint64_t baseStamp;
+	uint64_t ownerPid;	   /// of the fxed writing it, its journals are not left behind while it runs
+};
+
+struct JournalRecord {
+	uint32_t size;	   /// of the lines after the header
+	uint32_t first;
+	uint32_t removed;	  /// journalSnapshot if the lines replace the whole text
+	uint32_t inserted;
+	uint64_t checksum;
+};
+
+static constexpr char	  journalMagic[8]		= {'F', 'X', 'J', 'O', 'U', 'R', 'N', '\0'};
+static constexpr uint32_t journalFormatVersion = 2;
+static constexpr uint32_t journalSnapshot	   = UINT32_MAX;
+
+static uint64_t recordChecksum(const JournalRecord &record, const char *lines) {
+	uint64_t seed = hashValue(record.inserted, hashValue(record.removed, hashValue(record.first)));
+	return hashBytes(lines, record.size, seed);
+}
+
+/// encodes lines [begin, end) of text as a record replacing removed lines at first
+static void appendRecord(std::string &out, uint32_t first, uint32_t removed, const TextStateBase &text,
+						 std::size_t begin, std::size_t end) {
+	std::size_t	  start = out.size();
+	JournalRecord record{0, first, removed, uint32_t(end - begin), 0};
+	out.append(sizeof(record), '\0');
+	for (std::size_t line = begin; line < end; ++line) {
+		std::size_t lengthAt = out.size();
+		out.append(sizeof(uint32_t), '\0');
+		std::ranges::copy(text.getLine(line) | fxed::to_utf8, std::back_inserter(out));
+		uint32_t length = out.size() - lengthAt - sizeof(uint32_t);
+		std::memcpy(out.data() + lengthAt, &length, sizeof(length));
+	}
+	record.size		= out.size() - start - sizeof(record);
+	record.checksum = recordChecksum(record, out.data() + start + sizeof(record));
+	std::memcpy(out.data() + start, &record, sizeof(record));
+}
+
+static std::string encodeHeader(const std::filesystem::path &filePath, uint64_t baseStamp) {
+	std::string	  path = filePath.string();
+	JournalHeader header;
+	std::memcpy(header.magic, journalMagic, sizeof(journalMagic));
+	header.formatVersion = journalFormatVersion;
+	header.pathSize		 = path.size();
+	header.baseStamp	 = baseStamp;
+	header.ownerPid		 = getProcessId();
+	std::string out((const char *)&header, sizeof(header));
+	return out + path;
+}
+
+static bool writeAll(std::FILE *file, std::string_view bytes) {
+	return std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+}
+
+/// writes a new journal next to the old one and renames it into place, returns it opened for appending
+static std::FILE *createJournal(const std::filesystem::path &journalPath, std::string_view header,
+								std::string_view records) {
+	std::error_code ec;
+	std::filesystem::create_directories(journalPath.parent_path(), ec);
+	auto tmpPath = journalPath;
+	tmpPath += ".tmp";
+
+	std::FILE *tmp = std::fopen(tmpPath.string().c_str(), "wb");
+	if (tmp == nullptr) return nullptr;
+	bool written = writeAll(tmp, header) && writeAll(tmp, records) && syncFile(tmp);
+	std::fclose(tmp);
+	if (written) std::filesystem::rename(tmpPath, journalPath, ec);
+	if (!written || ec) {
+		std::filesystem::remove(tmpPath, ec);
+		return nullptr;
+	}
+	syncDirectory(journalPath.parent_path());
+	return std::fopen(journalPath.string().c_str(), "ab");
+}
+
+EditJournal::EditJournal(const std::filesystem::path &filePath, std::size_t lineCount)
+	: filePath(filePath), lineCount(lineCount) {
+	std::error_code ec;
+	auto			size = std::filesystem::file_size(filePath, ec);
+	snapshotBytes		 = ec ? 0 : size;
+	baseStamp			 = hashFileStamp(filePath);
+
+	auto dir = getSwapDirectory();
+	if (dir.empty()) {
+		dbLog(dbg::LOG_WARNING, "No cache directory, edits to ", filePath, " cannot be recovered after a crash");
+		return;
+	}
+	journalPath = dir / std::format("{:016x}.journal", hashString(filePath.string()));
+	thread		= std::jthread([this](std::stop_token stop) { run(stop); });
+}
+
+EditJournal::~EditJournal() {
+	thread.request_stop();
+	if (thread.joinable()) thread.join();
+	std::error_code ec;
+	if (!journalPath.empty()) std::filesystem::remove(journalPath, ec);
+}
+
+void EditJournal::run(std::stop_token stop) {
+	std::FILE *file = nullptr;
+	while (true) {
+		std::string records;
+		bool		replace;
+		uint64_t	stamp;
+		{
+			std::unique_lock lock(mutex);
+			if (!wake.wait(lock, stop, [&] { return !pending.empty() || rewrite; })) break;
+			// edits made shortly after each other are written and synced together
+			wake.wait_for(lock, stop, syncInterval, [] { return false; });
+			if (stop.stop_requested()) break;
+			records.swap(pending);
+			replace = std::exchange(rewrite, false);
+			stamp	= baseStamp;
+		}
+
+		bool written = true;
+		if (replace || file == nullptr) {
+			// the first records after a save start a new journal, which applies to the file as it was saved
+			if (file != nullptr) std::fclose(file);
+			file = nullptr;
+			std::error_code ec;
+			if (records.empty()) std::filesystem::remove(journalPath, ec);
+			else written = (file = createJournal(journalPath, encodeHeader(filePath, stamp), records)) != nullptr;
+		} else {
+			written = writeAll(file, records) && syncFile(file);
+		}
+		if (!written) {
+			dbLog(dbg::LOG_ERROR, "Failed to write journal ", journalPath, " of ", filePath);
+			if (file != nullptr) std::fclose(file);
+			file = nullptr;
+			// a journal with records missing would recover the wrong text
+			std::error_code ec;
+			std::filesystem::remove(journalPath, ec);
+			broken = true;
+		}
+	}
+	if (file != nullptr) std::fclose(file);
+}
+
+void EditJournal::queue(std::string &&records, bool replace) {
+	{
+		std::lock_guard lock(mutex);
+		if (replace) {
+			pending = std::move(records);
+			rewrite = true;
+		} else {
+			pending += records;
+		}
+	}
+	wake.notify_one();
+}
+
+void EditJournal::record(const TextStateBase &text, const LineEdit &edit) {
+	if (journalPath.empty()) return;
+	if (broken.exchange(false) || lineCount + edit.inserted != text.getLineCount() + edit.removed) {
+		return snapshot(text);
+	}
+	std::string records;
+	appendRecord(records, edit.first, edit.removed, text, edit.first, edit.first + edit.inserted);
+	lineCount = text.getLineCount();
+	bytesSinceSnapshot += records.size();
+	if (bytesSinceSnapshot > compactFactor * snapshotBytes + compactSlack) return snapshot(text);
+	queue(std::move(records), false);
+}
+
+void EditJournal::snapshot(const TextStateBase &text) {
+	if (journalPath.empty()) return;
+	std::string records;
+	appendRecord(records, 0, journalSnapshot, text, 0, text.getLineCount());
+	lineCount		   = text.getLineCount();
+	snapshotBytes	   = records.size();
+	bytesSinceSnapshot = 0;
+	queue(std::move(records), true);
+}
+
+void EditJournal::saved(const TextStateBase &text) {
+	if (journalPath.empty()) return;
+	std::error_code ec;
+	auto			size = std::filesystem::file_size(filePath, ec);
+	lineCount			 = text.getLineCount();
+	snapshotBytes		 = ec ? 0 : size;
+	bytesSinceSnapshot	 = 0;
+	uint64_t stamp		 = hashFileStamp(filePath);
+	{
+		std::lock_guard lock(mutex);
+		baseStamp = stamp;
+	}
+	queue({}, true);
+}
+
+std::filesystem::path EditJournal::getSwapDirectory() {
+	const auto &cacheDir = getCacheDirectory();
+	if (cacheDir.empty()) return {};
+	return cacheDir / "swap";
+}
+
+/// whether the journal is still being written by another fxed, which has the file open
+static bool isJournalInUse(const std::filesystem::path &journalPath) {
+	JournalHeader header;
+	std::ifstream file(journalPath, std::ios::binary);
+	if (!file.read((char *)&header, sizeof(header))) return false;
+	// a journal that cannot be read is left to recover, which drops it
+	if (std::memcmp(header.magic, journalMagic, sizeof(journalMagic)) != 0 ||
+		header.formatVersion != journalFormatVersion) {
+		return false;
+	}
+	// this process is new, a journal with its id was left by an earlier one that had the same id
+	return header.ownerPid != getProcessId() && isProcessRunning(header.ownerPid);
+}
+
+std::vector<std::filesystem::path> EditJournal::findJournals() {
+	std::vector<std::filesystem::path> journals;
+	auto							   dir = getSwapDirectory();
+	std::error_code					   ec;
+	if (dir.empty() || !std::filesystem::is_directory(dir, ec)) return journals;
+	for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+		if (entry.path().extension() != ".journal") continue;
+		if (isJournalInUse(entry.path())) {
+			dbLog(dbg::LOG_INFO, "Not recovering ", entry.path(), ", the fxed writing it is still running");
+			continue;
+		}
+		journals.push_back(entry.path());
+	}
+	std::ranges::sort(journals);
+	return journals;
+}
+
+/// splits UTF-8 text into lines the way TextState does
+static std::vector<std::u32string> splitLines(std::string_view bytes) {
+	std::vector<std::u32string> lines(1);
+	for (char32_t c : bytes | fxed::to_utf32) {
+		if (c == U'\n') lines.emplace_back();
+		else lines.back().push_back(c);
+	}
+	return lines;
+}
+
+std::optional<EditJournal::Recovered> EditJournal::recover(const std::filesystem::path &journalPath) {
+	MappedFile journal(journalPath);
+	if (!journal.isOpen() || journal.getSize() < sizeof(JournalHeader)) return std::nullopt;
+	JournalHeader header;
+	std::memcpy(&header, journal.getData(), sizeof(header));
+	if (std::memcmp(header.magic, journalMagic, sizeof(journalMagic)) != 0 ||
+		header.formatVersion != journalFormatVersion || journal.getSize() < sizeof(header) + header.pathSize) {
+		dbLog(dbg::LOG_WARNING, "Ignoring unreadable journal ", journalPath);
+		return std::nullopt;
+	}
+
+	Recovered	recovered;
+	const char *data   = journal.getData();
+	std::size_t size   = journal.getSize();
+	std::size_t offset = sizeof(header) + header.pathSize;
+	recovered.filePath = std::string(data + sizeof(header), header.pathSize);
+
+	std::vector<std::u32string> lines;
+	bool						haveText = false;
+	std::size_t					applied	 = 0;
+	while (offset + sizeof(JournalRecord) <= size) {
+		JournalRecord record;
+		std::memcpy(&record, data + offset, sizeof(record));
+		const char *linesData = data + offset + sizeof(record);
+		// the crash may have cut the last record short, what is before it is still good
+		if (record.size > size - offset - sizeof(record) || recordChecksum(record, linesData) != record.checksum) break;
+
+		if (!haveText && record.removed != journalSnapshot) {
+			if (hashFileStamp(recovered.filePath) != header.baseStamp) {
+				dbLog(dbg::LOG_WARNING, "Not recovering ", recovered.filePath, ", it changed after ", journalPath,
+					  " was written");
+				return std::nullopt;
+			}
+			MappedFile file(recovered.filePath);
+			lines = splitLines(std::string_view(file.getData(), file.getSize()));
+		}
+		haveText = true;
+
+		std::vector<std::u32string> inserted;
+		inserted.reserve(record.inserted);
+		for (std::size_t at = 0; inserted.size() < record.inserted;) {
+			uint32_t length;
+			if (record.size - at < sizeof(length)) break;
+			std::memcpy(&length, linesData + at, sizeof(length));
+			at += sizeof(length);
+			if (record.size - at < length) break;
+			inserted.emplace_back();
+			std::ranges::copy(std::string_view(linesData + at, length) | fxed::to_utf32,
+							  std::back_inserter(inserted.back()));
+			at += length;
+		}
+		if (record.removed == journalSnapshot) {
+			lines = std::move(inserted);
+		} else if (inserted.size() == record.inserted && record.first + record.removed <= lines.size()) {
+			lines.erase(lines.begin() + record.first, lines.begin() + record.first + record.removed);
+			lines.insert(lines.begin() + record.first, std::make_move_iterator(inserted.begin()),
+						 std::make_move_iterator(inserted.end()));
+		} else {
+			dbLog(dbg::LOG_WARNING, "Journal ", journalPath, " does not match its file after ", applied, " edits");
+			break;
+		}
+		++applied;
+		offset += sizeof(record) + record.size;
+	}
+	if (applied == 0) return std::nullopt;
+	if (lines.empty()) lines.emplace_back();
+
+	for (std::size_t i = 0; i < lines.size(); ++i) {
+		if (i > 0) recovered.text.push_back(U'\n');
+		recovered.text += lines[i];
+	}
+	dbLog(dbg::LOG_INFO, "Recovered ", applied, " edits to ", recovered.filePath, " from ", journalPath);
+	return recovered;
+}
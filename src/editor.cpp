@@ -1,9 +1,12 @@
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 #include <memory>
 
 #include "editor.hpp"
+#include "edit_journal.hpp"
 #include "nri.hpp"
+#include "session.hpp"
 
 using namespace fxed;
 
@@ -27,23 +30,29 @@ void Editor::setupCallbacks() {
 					}
 				} else if (key == GLFW_KEY_Z && !(mods & GLFW_MOD_SHIFT)) fxed::Pane::activePane->undo();
 				else if (key == GLFW_KEY_R && !(mods & GLFW_MOD_SHIFT)) fxed::Pane::activePane->redo();
+				else if (key == GLFW_KEY_F && (mods & GLFW_MOD_SHIFT)) openFindInFiles();
+				else if (key == GLFW_KEY_F && fxed::Pane::activePane) fxed::Pane::activePane->find();
+				else if (key == GLFW_KEY_H && fxed::Pane::activePane) fxed::Pane::activePane->replace();
+				else if (key == GLFW_KEY_G && fxed::Pane::activePane) fxed::Pane::activePane->goToLine();
 			}
 		}
 		if (fxed::Pane::activePane) { fxed::Pane::activePane->keyInput(key, 0, action, mods); }
 	});
 
-	fxed::Keyboard::addCharCallback([&](GLFWwindow *, unsigned int codepoint) {
-		if (fxed::Pane::activePane) { fxed::Pane::activePane->charInput(codepoint); }
+	fxed::Keyboard::addTextCallback([&](GLFWwindow *, std::u32string_view text) {
+		if (fxed::Pane::activePane) { fxed::Pane::activePane->textInput(text); }
 	});
 
 	fxed::Mouse::addScrollCallback([&](GLFWwindow *, double, double yOffset) {
+		// scroll events of one frame arrive summed, keep at least one step per frame like a single wheel notch
+		float steps = std::copysign(std::max(1.0, std::round(std::abs(yOffset))), yOffset);
 		if (fxed::Keyboard::getKey(GLFW_KEY_LEFT_CONTROL) || fxed::Keyboard::getKey(GLFW_KEY_RIGHT_CONTROL)) {
 			auto fontSize = textRenderer.getFontSize();
-			fontSize += std::copysign(1.f, (float)yOffset) * 1.0f;
+			fontSize += steps;
 			fontSize = std::max(2.f, fontSize);
 			textRenderer.setFontSize(fontSize);
 		} else {
-			rootPane->scroll(mouse, 0, std::copysign(1.f, yOffset) * 1.0f);
+			rootPane->scroll(mouse, 0, steps);
 		}
 	});
 	fxed::Mouse::addMouseButtonCallback(
@@ -82,6 +91,8 @@ Editor::Editor(nri::NRI &nri, uint32_t width, uint32_t height)
 	} else {
 		THROW_RUNTIME_ERR("Multiple instances of Editor created!");
 	}
+
+	recoverFiles();
 }
 
 Editor *Editor::instance = nullptr;
@@ -95,6 +106,7 @@ void Editor::mainLoop() {
 	auto &win = window.getNativeWindow();
 	while (!window.shouldClose()) {
 		window.beginFrame();
+		fxed::InputQueue::dispatch();
 		mouse.update();
 		bool res = win->beginFrame();
 		if (!res) {
@@ -102,19 +114,23 @@ void Editor::mainLoop() {
 			continue;
 		}
 
+		textRenderer.beginFrame(*win);
 		auto &cmdBuf = win->getCurrentCommandBuffer();
 		win->beginRendering(cmdBuf, win->getCurrentRenderTarget());
 
 		rootPane->render(cmdBuf);
+		textRenderer.flush(cmdBuf);
 
 		win->endRendering(cmdBuf);
 		win->endFrame();
 
 		window.swapBuffers();
 	}
+	// panes and their meshes are destroyed after this, let the frames in flight finish first
+	nri.synchronize();
 }
 
-void Editor::openFile(const std::filesystem::path &path) {
+FileTextEditorPane *Editor::openFile(const std::filesystem::path &path) {
 	auto *splitPane = dynamic_cast<SplitPane *>(rootPane.get());
 	assert(splitPane && "Root pane is not a SplitPane");
 
@@ -128,15 +144,77 @@ void Editor::openFile(const std::filesystem::path &path) {
 		auto *textEditorPane = dynamic_cast<FileTextEditorPane *>(tabsPane->getTabs()[i].get());
 		if (textEditorPane && textEditorPane->getFilePath() == canonicalPath) {
 			tabsPane->setActiveTab(i);
-			return;
+			return textEditorPane;
 		}
 	}
 
 	auto textEditorPane =
 		std::make_unique<FileTextEditorPane>(nri, window.getMainQueue(), 100, 100, textRenderer, canonicalPath);
+	auto *result = textEditorPane.get();
 
 	auto index = tabsPane->addTab(std::move(textEditorPane));
 	tabsPane->setActiveTab(index);
+	return result;
+}
+
+TabsPane &Editor::getTabsPane() {
+	auto *splitPane = dynamic_cast<SplitPane *>(rootPane.get());
+	assert(splitPane && "Root pane is not a SplitPane");
+
+	auto *tabsPane = dynamic_cast<TabsPane *>(splitPane->getChild(1).get());
+	assert(tabsPane && "Right child of root pane is not a TabsPane");
+	return *tabsPane;
+}
+
+FileTreePane &Editor::getFileTreePane() {
+	auto *splitPane = dynamic_cast<SplitPane *>(rootPane.get());
+	assert(splitPane && "Root pane is not a SplitPane");
+
+	auto *fileTreePane = dynamic_cast<FileTreePane *>(splitPane->getChild(0).get());
+	assert(fileTreePane && "Left child of root pane is not a FileTreePane");
+	return *fileTreePane;
+}
+
+void Editor::recoverFiles() {
+	auto &tabsPane = getTabsPane();
+	for (const auto &journalPath : EditJournal::findJournals()) {
+		auto recovered = EditJournal::recover(journalPath);
+		if (!recovered) {
+			// no edits in it, or they were made to a version of the file that is gone
+			std::error_code ec;
+			std::filesystem::remove(journalPath, ec);
+			continue;
+		}
+		std::error_code ec;
+		auto			size = std::filesystem::file_size(recovered->filePath, ec);
+		if (!ec && size > FileTextEditorPane::largeFileSize) {
+			dbLog(dbg::LOG_WARNING, "Cannot recover edits to ", recovered->filePath, ", it is too large to edit now");
+			continue;
+		}
+		// the file is not read, the recovered text replaces it right away and only goes to the disk when it is saved,
+		// closing the tab drops it
+		auto textEditorPane = std::make_unique<FileTextEditorPane>(nri, window.getMainQueue(), 100, 100, textRenderer,
+																   recovered->filePath, true);
+		textEditorPane->restore(recovered->text);
+		dbLog(dbg::LOG_WARNING, "Recovered unsaved edits to ", recovered->filePath,
+			  ", save to keep them or close the tab to drop them");
+		tabsPane.setActiveTab(tabsPane.addTab(std::move(textEditorPane)));
+	}
+}
+
+void Editor::openFindInFiles() {
+	auto *splitPane = dynamic_cast<SplitPane *>(rootPane.get());
+	assert(splitPane && "Root pane is not a SplitPane");
+
+	auto *fileTreePane = dynamic_cast<FileTreePane *>(splitPane->getChild(0).get());
+	assert(fileTreePane && "Left child of root pane is not a FileTreePane");
+
+	auto *tabsPane = dynamic_cast<TabsPane *>(splitPane->getChild(1).get());
+	assert(tabsPane && "Right child of root pane is not a TabsPane");
+
+	auto index = tabsPane->addTab(std::make_unique<FindInFilesPane>(nri, window.getMainQueue(), 100, 100, textRenderer,
+																	fileTreePane->getPath()));
+	tabsPane->setActiveTab(index);
 }
 
 void Editor::setFolder(const std::filesystem::path &path) {
@@ -148,3 +226,55 @@ void Editor::setFolder(const std::filesystem::path &path) {
 
 	fileTreePane->setPath(std::filesystem::canonical(path));
 }
+
+void Editor::restoreSession() {
+	auto &fileTreePane = getFileTreePane();
+	auto &tabsPane	   = getTabsPane();
+	auto  session	   = Session::load(fileTreePane.getPath());
+	if (!session) return;
+	fileTreePane.openDirectories(session->openDirectories);
+
+	bool		hadTabs	 = !tabsPane.getTabs().empty();
+	std::size_t restored = 0;
+	uint32_t	active	 = 0;
+	for (std::size_t i = 0; i < session->tabs.size(); ++i) {
+		const auto	   &tab = session->tabs[i];
+		std::error_code ec;
+		if (!std::filesystem::is_regular_file(tab.path, ec)) continue;	   // removed since
+		// files opened from the command line or recovered from a journal already have a tab
+		bool open = std::ranges::any_of(tabsPane.getTabs(), [&](const auto &pane) {
+			auto *textEditorPane = dynamic_cast<FileTextEditorPane *>(pane.get());
+			return textEditorPane && textEditorPane->getFilePath() == tab.path;
+		});
+		if (open) continue;
+
+		auto textEditorPane = std::make_unique<FileTextEditorPane>(nri, window.getMainQueue(), 100, 100, textRenderer,
+																   tab.path, true);
+		textEditorPane->setView({tab.cursor, tab.translation});
+		auto index = tabsPane.addTab(std::move(textEditorPane));
+		if (i == session->activeTab) active = index;
+		++restored;
+	}
+	// a tab that was opened before stays in front
+	if (!hadTabs && restored > 0) tabsPane.setActiveTab(active);
+	dbLog(dbg::LOG_INFO, "Restored ", restored, " tabs of ", session->folder);
+}
+
+void Editor::saveSession() {
+	auto   &fileTreePane = getFileTreePane();
+	auto   &tabsPane	 = getTabsPane();
+	Session session;
+	session.folder			= fileTreePane.getPath();
+	session.openDirectories = fileTreePane.getOpenDirectories();
+
+	const auto &tabs = tabsPane.getTabs();
+	for (std::size_t i = 0; i < tabs.size(); ++i) {
+		// find in files tabs are not kept, their results would be stale anyway
+		auto *textEditorPane = dynamic_cast<FileTextEditorPane *>(tabs[i].get());
+		if (!textEditorPane) continue;
+		if (i == tabsPane.getActiveTab()) session.activeTab = session.tabs.size();
+		auto view = textEditorPane->getView();
+		session.tabs.push_back({textEditorPane->getFilePath(), view.cursor, view.translation});
+	}
+	session.save();
+}
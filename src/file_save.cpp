@@ -0,0 +1,81 @@
+#include "file_save.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <new>
+#include <string_view>
+
+#include "file_utils.hpp"
+#include "thread_pool.hpp"
+#include "utf8_convert.hpp"
+
+using namespace fxed;
+
+struct AlignedDelete {
+	void operator()(char *block) const { ::operator delete[](block, std::align_val_t(FileSave::blockAlignment)); }
+};
+
+FileSave::~FileSave() {
+	if (written.valid()) written.wait();
+}
+
+void FileSave::start(const TextStateBase &text, const std::filesystem::path &path, bool sync) {
+	job		  = std::make_shared<Job>();
+	job->path = path;
+	job->sync = sync;
+	// every line and its '\n', so the buffer is allocated once
+	job->text.reserve(text.lineToOffset(text.getLineCount()));
+	nextLine = 0;
+}
+
+bool FileSave::copy(const TextStateBase &text, std::chrono::microseconds budget) {
+	if (!job) return true;
+	auto start	   = std::chrono::steady_clock::now();
+	auto outOfTime = [&]() { return std::chrono::steady_clock::now() - start >= budget; };
+
+	std::size_t lineCount = text.getLineCount();
+	while (nextLine < lineCount) {
+		std::size_t batchEnd = std::min(lineCount, nextLine + 1024);
+		for (; nextLine < batchEnd; ++nextLine) {
+			if (nextLine > 0) job->text.push_back(U'\n');
+			job->text += text.getLine(nextLine);
+		}
+		if (nextLine < lineCount && outOfTime()) return false;
+	}
+	written = ThreadPool::getInstance().submit([job = std::move(job)]() { return write(*job); });
+	return true;
+}
+
+void FileSave::finishCopy(const TextStateBase &text) {
+	// every call copies at least one batch, the frame waits for all of them
+	while (!copy(text, std::chrono::seconds(1))) {}
+}
+
+std::optional<std::error_code> FileSave::poll() {
+	if (!written.valid() || written.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+		return std::nullopt;
+	}
+	return written.get();
+}
+
+/// encodes the text to UTF-8 and writes it in whole blocks
+static std::error_code writeBlocks(std::FILE *file, std::u32string_view text) {
+	// the blocks go to the file as they are, without the stream copying them into a buffer of its own
+	std::setvbuf(file, nullptr, _IONBF, 0);
+	std::unique_ptr<char[], AlignedDelete> block(new (std::align_val_t(FileSave::blockAlignment))
+													 char[FileSave::blockSize]);
+	std::size_t							   used = 0;
+	for (char c : text | fxed::to_utf8) {
+		block[used++] = c;
+		if (used < FileSave::blockSize) continue;
+		if (std::fwrite(block.get(), 1, used, file) != used) return std::error_code(errno, std::generic_category());
+		used = 0;
+	}
+	if (std::fwrite(block.get(), 1, used, file) != used) return std::error_code(errno, std::generic_category());
+	return {};
+}
+
+std::error_code FileSave::write(const Job &job) {
+	return writeFileAtomic(job.path, [&](std::FILE *file) { return writeBlocks(file, job.text); }, job.sync);
+}
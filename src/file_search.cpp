@@ -0,0 +1,123 @@
+#include "file_search.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "file_tree.hpp"
+#include "file_utils.hpp"
+#include "text_search.hpp"
+#include "thread_pool.hpp"
+
+using namespace fxed;
+
+// files searched by one task, enough to amortize scheduling without leaving one worker with a huge directory
+static constexpr std::size_t filesPerTask = 16;
+// matches per file and characters per line kept for display
+static constexpr std::size_t maxMatchesPerFile = 1000;
+static constexpr std::size_t maxLineLength	   = 200;
+
+void FileSearch::start(const std::filesystem::path &root, std::string_view query) {
+	auto job		= std::make_shared<Job>();
+	job->generation = ++generation;
+	job->query		= query;
+	currentJob		= job;
+	{
+		std::lock_guard lock(mutex);
+		finished.clear();
+	}
+	if (query.empty()) return;
+	schedule(job, [this, job, root]() { searchDirectory(job, root); });
+}
+
+void FileSearch::schedule(const std::shared_ptr<Job> &job, std::function<void()> &&task) {
+	++job->pendingTasks;
+	ThreadPool::getInstance().execute([self = shared_from_this(), job, task = std::move(task)]() {
+		if (!self->isCancelled(*job)) task();
+		--job->pendingTasks;
+	});
+}
+
+void FileSearch::searchDirectory(const std::shared_ptr<Job> &job, const std::filesystem::path &directory) {
+	std::vector<std::filesystem::path> files;
+	for (auto &entry : readDirectory(directory)) {
+		// hidden files and directories like .git are skipped, as most search tools do by default
+		if (entry.name.starts_with('.')) continue;
+		// a link back up the tree (ln -s .. x) would be searched forever, linked directories are left out like ripgrep
+		// does by default
+		if (entry.isDirectory && entry.isSymlink) continue;
+		auto path = directory / entry.name;
+		if (entry.isDirectory) {
+			schedule(job, [this, job, path]() { searchDirectory(job, path); });
+			continue;
+		}
+		files.push_back(std::move(path));
+		if (files.size() == filesPerTask) {
+			schedule(job, [this, job, batch = std::move(files)]() {
+				std::vector<Match> matches;
+				for (const auto &file : batch) {
+					searchFile(*job, file, matches);
+				}
+				std::lock_guard lock(mutex);
+				if (!isCancelled(*job)) std::ranges::move(matches, std::back_inserter(finished));
+			});
+			files.clear();
+		}
+	}
+	// the rest of the directory is searched right here
+	std::vector<Match> matches;
+	for (const auto &file : files) {
+		searchFile(*job, file, matches);
+	}
+	std::lock_guard lock(mutex);
+	if (!isCancelled(*job)) std::ranges::move(matches, std::back_inserter(finished));
+}
+
+void FileSearch::searchFile(Job &job, const std::filesystem::path &path, std::vector<Match> &matches) {
+	if (isCancelled(job) || job.matchCount >= maxMatches) return;
+	MappedFile file(path);
+	if (!file.isOpen()) return;
+	std::string_view bytes(file.getData(), file.getSize());
+
+	// a NUL byte near the start means the file is binary
+	if (bytes.substr(0, 8192).find('\0') != std::string_view::npos) return;
+	file.adviseSequential();
+	++job.fileCount;
+
+	std::size_t found	  = 0;
+	std::size_t line	  = 0;
+	std::size_t countedTo = 0;	   // newlines before this offset are already in line
+	for (std::size_t pos = findBytes(bytes, job.query); pos != std::string_view::npos;) {
+		std::size_t lineStart = bytes.rfind('\n', pos);
+		lineStart			  = lineStart == std::string_view::npos ? 0 : lineStart + 1;
+		std::size_t lineEnd	  = bytes.find('\n', pos);
+		if (lineEnd == std::string_view::npos) lineEnd = bytes.size();
+
+		line += std::count(bytes.begin() + countedTo, bytes.begin() + lineStart, '\n');
+		countedTo = lineStart;
+
+		// count code points, not UTF-8 continuation bytes
+		auto column = std::ranges::count_if(bytes.substr(lineStart, pos - lineStart),
+											[](char c) { return ((unsigned char)c & 0xc0) != 0x80; });
+		// a line cut short ends before the code point the cut would split, the preview stays valid UTF-8
+		std::size_t length = std::min(lineEnd - lineStart, maxLineLength);
+		if (length < lineEnd - lineStart) {
+			while (length > 0 && ((unsigned char)bytes[lineStart + length] & 0xc0) == 0x80) {
+				--length;
+			}
+		}
+		auto text = bytes.substr(lineStart, length);
+		if (text.ends_with('\r')) text.remove_suffix(1);
+		matches.push_back({path, (uint32_t)line, (uint32_t)column, std::string(text)});
+		++found;
+
+		// one match per line is enough to find it
+		if (++job.matchCount >= maxMatches || found == maxMatchesPerFile || lineEnd == bytes.size()) break;
+		pos = findBytes(bytes, job.query, lineEnd + 1);
+	}
+}
+
+std::vector<FileSearch::Match> FileSearch::takeFinished() {
+	std::lock_guard lock(mutex);
+	return std::exchange(finished, {});
+}
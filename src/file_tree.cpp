@@ -1,9 +1,23 @@
 #include "file_tree.hpp"
+#include <algorithm>
 #include <cassert>
 #include <filesystem>
 #include <iostream>
+#include <utility>
+#include "thread_pool.hpp"
+#include "utf8_convert.hpp"
 #include "utils.hpp"
 
+#ifndef _WIN32
+	#include <dirent.h>
+#endif
+#ifdef __linux__
+	#include <poll.h>
+	#include <sys/eventfd.h>
+	#include <sys/inotify.h>
+	#include <unistd.h>
+#endif
+
 using namespace fxed;
 
 std::string_view fxed::getIconForFile(const std::filesystem::path &path) {
@@ -42,136 +56,480 @@ void FileTree::DirectoryNode::print(std::ostream &os, int indent) const {
 		child->print(os, indent + 1);
 }
 
-void FileTree::DirectoryNode::toggleOpen() {
-	opened = !opened;
-	if (!updated) {
-		updated = true;
-		children.clear();
-		for (const auto &entry : std::filesystem::directory_iterator(path)) {
-			if (entry.is_directory()) {
-				auto dirNode  = std::make_unique<DirectoryNode>();
-				dirNode->path = entry.path();
-				children.push_back(std::move(dirNode));
-			} else if (entry.is_regular_file()) {
-				auto fileNode  = std::make_unique<FileNode>();
-				fileNode->path = entry.path();
-				children.push_back(std::move(fileNode));
+static void appendUtf32(std::u32string &out, std::string_view utf8) {
+	std::ranges::copy(utf8 | fxed::to_utf32, std::back_inserter(out));
+}
+
+void FileTree::appendRowText(const Row &row, std::u32string &out) {
+	if (row.depth >= 0) out.append(3 * row.depth, U' ');
+	if (row.depth >= 0 && row.node->isDirectory()) {
+		out += static_cast<const DirectoryNode *>(row.node)->opened ? U"  " : U"  ";
+	}
+	out += row.node->label;
+}
+
+std::vector<DirectoryEntry> fxed::readDirectory(const std::filesystem::path &path) {
+	std::vector<DirectoryEntry> entries;
+#ifdef _WIN32
+	// directory_iterator already caches the entry attributes on Windows
+	std::error_code ec;
+	for (const auto &entry : std::filesystem::directory_iterator(path, ec)) {
+		bool isSymlink = entry.is_symlink(ec);
+		if (entry.is_directory(ec)) entries.push_back({entry.path().filename().string(), true, isSymlink});
+		else if (entry.is_regular_file(ec)) entries.push_back({entry.path().filename().string(), false, isSymlink});
+	}
+#else
+	DIR *dir = opendir(path.c_str());
+	if (dir == nullptr) {
+		dbLog(dbg::LOG_WARNING, "Failed to list directory ", path);
+		return entries;
+	}
+	while (dirent *entry = readdir(dir)) {
+		std::string_view name = entry->d_name;
+		if (name == "." || name == "..") continue;
+
+		switch (entry->d_type) {
+			case DT_DIR: entries.push_back({std::string(name), true}); break;
+			case DT_REG: entries.push_back({std::string(name), false}); break;
+			case DT_LNK:
+			case DT_UNKNOWN: {
+				// only symlinks and file systems without d_type need a stat
+				std::error_code ec;
+				auto			linkStatus = std::filesystem::symlink_status(path / name, ec);
+				auto			status	   = std::filesystem::status(path / name, ec);
+				bool			isSymlink  = std::filesystem::is_symlink(linkStatus);
+				if (std::filesystem::is_directory(status)) entries.push_back({std::string(name), true, isSymlink});
+				else if (std::filesystem::is_regular_file(status))
+					entries.push_back({std::string(name), false, isSymlink});
+			} break;
+			default: break;
+		}
+	}
+	closedir(dir);
+#endif
+
+	std::sort(entries.begin(), entries.end(), [](const DirectoryEntry &a, const DirectoryEntry &b) {
+		if (a.isDirectory != b.isDirectory) return a.isDirectory > b.isDirectory;	  // Directories first
+		return a.name < b.name;															  // Then sort by name
+	});
+	return entries;
+}
+
+void DirectoryScanner::request(const std::filesystem::path &path) {
+	ThreadPool::getInstance().execute([self = shared_from_this(), path]() {
+		auto			entries = readDirectory(path);
+		std::lock_guard lock(self->mutex);
+		self->finished.push_back({path, std::move(entries)});
+	});
+}
+
+std::vector<DirectoryScanner::Listing> DirectoryScanner::takeFinished() {
+	std::lock_guard lock(mutex);
+	return std::exchange(finished, {});
+}
+
+#ifdef __linux__
+FileTreeWatcher::FileTreeWatcher() {
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	wakeFd	  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (inotifyFd < 0 || wakeFd < 0) {
+		dbLog(dbg::LOG_WARNING, "File system watching is not available, the file tree will not update on changes");
+		return;
+	}
+	thread = std::jthread([this](std::stop_token stop) { readLoop(stop); });
+}
+
+FileTreeWatcher::~FileTreeWatcher() {
+	if (thread.joinable()) {
+		thread.request_stop();
+		uint64_t one = 1;
+		if (::write(wakeFd, &one, sizeof(one)) < 0) { dbLog(dbg::LOG_WARNING, "Failed to wake file watcher thread"); }
+		thread.join();
+	}
+	if (inotifyFd >= 0) ::close(inotifyFd);
+	if (wakeFd >= 0) ::close(wakeFd);
+}
+
+void FileTreeWatcher::watch(const std::filesystem::path &directory) {
+	if (inotifyFd < 0) return;
+	int wd = inotify_add_watch(inotifyFd, directory.c_str(),
+							   IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_EXCL_UNLINK);
+	if (wd < 0) {
+		dbLog(dbg::LOG_WARNING, "Failed to watch directory ", directory);
+		return;
+	}
+	std::lock_guard lock(mutex);
+	watchedPaths[wd]					 = directory;
+	watchDescriptors[directory.string()] = wd;
+}
+
+void FileTreeWatcher::unwatch(const std::filesystem::path &directory) {
+	if (inotifyFd < 0) return;
+	std::lock_guard lock(mutex);
+	auto			it = watchDescriptors.find(directory.string());
+	if (it == watchDescriptors.end()) return;
+	inotify_rm_watch(inotifyFd, it->second);
+	watchedPaths.erase(it->second);
+	watchDescriptors.erase(it);
+}
+
+void FileTreeWatcher::readLoop(std::stop_token stop) {
+	alignas(inotify_event) char buffer[64 * 1024];
+	pollfd						fds[2] = {{inotifyFd, POLLIN, 0}, {wakeFd, POLLIN, 0}};
+
+	while (!stop.stop_requested()) {
+		if (::poll(fds, 2, -1) < 0) continue;
+		if (fds[1].revents & POLLIN) break;
+
+		// drain everything that is queued so a burst of changes lands in one batch
+		std::vector<Event> events;
+		while (true) {
+			ssize_t length = ::read(inotifyFd, buffer, sizeof(buffer));
+			if (length <= 0) break;
+
+			std::lock_guard lock(mutex);
+			for (char *ptr = buffer; ptr < buffer + length;) {
+				auto *event = (inotify_event *)ptr;
+				ptr += sizeof(inotify_event) + event->len;
+
+				if (event->mask & IN_Q_OVERFLOW) {
+					events.push_back(
+						{.directory = {}, .name = {}, .created = false, .isDirectory = true, .overflow = true});
+					continue;
+				}
+				if (event->mask & IN_IGNORED) {
+					// the directory itself was removed, its parent reports the deletion
+					if (auto it = watchedPaths.find(event->wd); it != watchedPaths.end()) {
+						watchDescriptors.erase(it->second.string());
+						watchedPaths.erase(it);
+					}
+					continue;
+				}
+				auto it = watchedPaths.find(event->wd);
+				if (it == watchedPaths.end() || event->len == 0) continue;
+
+				events.push_back({.directory   = it->second,
+								  .name		   = event->name,
+								  .created	   = (event->mask & (IN_CREATE | IN_MOVED_TO)) != 0,
+								  .isDirectory = (event->mask & IN_ISDIR) != 0,
+								  .overflow	   = false});
 			}
 		}
 
-		std::sort(children.begin(), children.end(),
-				  [](const std::unique_ptr<FileTreeNode> &a, const std::unique_ptr<FileTreeNode> &b) {
-					  bool aIsDir = dynamic_cast<DirectoryNode *>(a.get()) != nullptr;
-					  bool bIsDir = dynamic_cast<DirectoryNode *>(b.get()) != nullptr;
-					  if (aIsDir != bIsDir) return aIsDir > bIsDir;		  // Directories first
-					  return a->path.filename() < b->path.filename();	  // Then sort by name
-				  });
+		if (!events.empty()) {
+			std::lock_guard lock(mutex);
+			std::ranges::move(events, std::back_inserter(pending));
+		}
 	}
 }
 
-void FileTree::DirectoryNode::setOpen(bool open) {
-	if (opened != open) { toggleOpen(); }
+std::vector<FileTreeWatcher::Event> FileTreeWatcher::takeEvents() {
+	std::lock_guard lock(mutex);
+	return std::exchange(pending, {});
+}
+#else
+FileTreeWatcher::FileTreeWatcher() {}
+FileTreeWatcher::~FileTreeWatcher() {}
+
+void FileTreeWatcher::watch(const std::filesystem::path &) {}
+void FileTreeWatcher::unwatch(const std::filesystem::path &) {}
+void FileTreeWatcher::readLoop(std::stop_token) {}
+
+std::vector<FileTreeWatcher::Event> FileTreeWatcher::takeEvents() { return {}; }
+#endif
+
+/// more events than this for one directory in a single batch trigger a relisting instead of per-entry updates
+static constexpr std::ptrdiff_t MAX_INCREMENTAL_EVENTS = 256;
+
+/// same order readDirectory produces: directories first, then by name
+static bool entryLess(bool aIsDirectory, std::string_view a, bool bIsDirectory, std::string_view b) {
+	if (aIsDirectory != bIsDirectory) return aIsDirectory > bIsDirectory;
+	return a < b;
 }
 
 FileTree::FileTree(const std::filesystem::path &rootPath) {
 	if (!std::filesystem::is_directory(rootPath)) { throw std::invalid_argument("Root path must be a directory"); }
 
-	root	   = std::make_unique<DirectoryNode>();
-	root->path = rootPath;
-	root->toggleOpen();
+	scanner		 = std::make_shared<DirectoryScanner>();
+	watcher		 = std::make_unique<FileTreeWatcher>();
+	root		 = std::make_unique<DirectoryNode>();
+	root->path	 = rootPath;
+	root->opened = true;
+	appendUtf32(root->label, rootPath.string() + "/");
+	rows.push_back({root.get(), -1});
+	renumberRows(0);
+	requestListing(*root);
 }
 
-void FileTree::print(std::ostream &os) const {
-	os << root->path.string() << "/\n";
-	auto *rootDir = dynamic_cast<DirectoryNode *>(root.get());
-	assert(rootDir);
-	if (!rootDir->opened) return;
-	for (const auto &child : rootDir->children)
-		child->print(os, 0);
+std::size_t FileTree::findRow(const FileTreeNode &node) const {
+	// a node that left the rows keeps its old index, which then points at another node or past the end
+	if (node.row < rows.size() && rows[node.row].node == &node) return node.row;
+	return rows.size();
 }
 
-FileTree::iterator::iterator(DirectoryNode *root) {
-	if (root) stack.push_back({root, 0});
+void FileTree::renumberRows(std::size_t from) {
+	for (std::size_t i = from; i < rows.size(); ++i) {
+		rows[i].node->row = i;
+	}
 }
 
-bool FileTree::iterator::operator!=(const iterator &other) const { return !stack.empty() || !other.stack.empty(); }
-bool FileTree::iterator::operator==(const iterator &other) const { return stack.empty() && other.stack.empty(); }
+std::size_t FileTree::subtreeEnd(std::size_t row) const {
+	std::size_t end = row + 1;
+	while (end < rows.size() && rows[end].depth > rows[row].depth)
+		++end;
+	return end;
+}
 
-bool FileTree::iterator::isBegin() const { return stack.size() == 1 && stack.back().second == 0; }
-bool FileTree::iterator::isBack() const {
-	if (stack.empty()) return true;
-	for (const auto &[dir, index] : stack) {
-		if (index != dir->getChildCount() - 1) return false;
-		if (auto *subdir = dynamic_cast<DirectoryNode *>(dir->children[index].get())) {
-			if (subdir->getChildCount() > 0) return false;
-		}
+void FileTree::collectRows(const DirectoryNode &dir, int depth, std::vector<Row> &out) const {
+	for (const auto &child : dir.children) {
+		out.push_back({child.get(), depth});
+		if (child->isDirectory() && static_cast<const DirectoryNode &>(*child).opened)
+			collectRows(static_cast<const DirectoryNode &>(*child), depth + 1, out);
+	}
+}
+
+void FileTree::refreshRows(const DirectoryNode &dir) {
+	std::size_t row = findRow(dir);
+	if (row == rows.size()) return;		// not visible
+	firstChangedRow = std::min(firstChangedRow, row + 1);
+
+	// only reads depths, nodes in the old range may already be gone
+	rows.erase(rows.begin() + row + 1, rows.begin() + subtreeEnd(row));
+	if (dir.opened) {
+		std::vector<Row> subtree;
+		collectRows(dir, rows[row].depth + 1, subtree);
+		rows.insert(rows.begin() + row + 1, subtree.begin(), subtree.end());
 	}
-	return true;
+	renumberRows(row + 1);
+}
+
+std::unique_ptr<FileTree::FileTreeNode> FileTree::makeNode(const DirectoryNode &parent, const std::string &name,
+														   bool isDirectory) {
+	std::unique_ptr<FileTreeNode> node;
+	if (isDirectory) node = std::make_unique<DirectoryNode>();
+	else node = std::make_unique<FileNode>();
+	node->path = parent.path / name;
+	node->name = name;
+
+	if (!isDirectory) appendUtf32(node->label, getIconForFile(node->path));
+	appendUtf32(node->label, name);
+	if (isDirectory) node->label += U'/';
+	return node;
 }
 
-FileTree::FileTreeNode &FileTree::iterator::operator*() const {
-	if (stack.empty()) throw std::out_of_range("Iterator out of range");
-	auto &[dir, index] = stack.back();
-	if (index >= dir->getChildCount()) throw std::out_of_range("Iterator out of range");
-	return *dir->children[index];
+void FileTree::requestListing(DirectoryNode &dir, bool force) {
+	if ((dir.updated && !force) || dir.loading) return;
+	dir.loading = true;
+	scanner->request(dir.path);
 }
 
-FileTree::iterator &FileTree::iterator::operator++() {
-	if (stack.empty()) throw std::out_of_range("Iterator out of range");
-	auto &[dir, index] = stack.back();
-	if (index >= dir->getChildCount()) throw std::out_of_range("Iterator out of range");
+void FileTree::unwatchSubtree(FileTreeNode &node) {
+	if (!node.isDirectory()) return;
+	auto &dir = static_cast<DirectoryNode &>(node);
+	if (dir.updated) watcher->unwatch(dir.path);
+	for (auto &child : dir.children) {
+		unwatchSubtree(*child);
+	}
+}
 
-	auto *node = dir->children[index].get();
+void FileTree::applyListing(DirectoryNode &dir, std::vector<DirectoryEntry> &&entries) {
+	// merge with the current children so nodes that still exist keep their state (opened, listed subtrees)
+	std::vector<std::unique_ptr<FileTreeNode>> children;
+	children.reserve(entries.size());
 
-	auto *subdir = dynamic_cast<DirectoryNode *>(node);
-	if (subdir && subdir->getChildCount() > 0) {
-		stack.push_back({subdir, 0});
-	} else {
-		++index;
-		while (!stack.empty() && stack.back().second >= stack.back().first->getChildCount()) {
-			stack.pop_back();
-			if (!stack.empty()) ++stack.back().second;
+	auto oldIt = dir.children.begin();
+	for (auto &entry : entries) {
+		while (oldIt != dir.children.end() &&
+			   entryLess((*oldIt)->isDirectory(), (*oldIt)->name, entry.isDirectory, entry.name)) {
+			unwatchSubtree(**oldIt);
+			++oldIt;
+		}
+		if (oldIt != dir.children.end() && (*oldIt)->isDirectory() == entry.isDirectory &&
+			(*oldIt)->name == entry.name) {
+			children.push_back(std::move(*oldIt++));
+		} else {
+			children.push_back(makeNode(dir, entry.name, entry.isDirectory));
 		}
 	}
-	return *this;
+	for (; oldIt != dir.children.end(); ++oldIt) {
+		unwatchSubtree(**oldIt);
+	}
+
+	dir.children = std::move(children);
+	if (!dir.updated) watcher->watch(dir.path);
+	dir.loading = false;
+	dir.updated = true;
+}
+
+void FileTree::insertChild(DirectoryNode &dir, const std::string &name, bool isDirectory) {
+	auto it = std::lower_bound(dir.children.begin(), dir.children.end(), 0, [&](const auto &child, int) {
+		return entryLess(child->isDirectory(), child->name, isDirectory, name);
+	});
+	if (it != dir.children.end() && (*it)->isDirectory() == isDirectory && (*it)->name == name) return;
+	dir.children.insert(it, makeNode(dir, name, isDirectory));
+}
+
+void FileTree::removeChild(DirectoryNode &dir, const std::string &name, bool isDirectory) {
+	auto it = std::lower_bound(dir.children.begin(), dir.children.end(), 0, [&](const auto &child, int) {
+		return entryLess(child->isDirectory(), child->name, isDirectory, name);
+	});
+	if (it == dir.children.end() || (*it)->isDirectory() != isDirectory || (*it)->name != name) return;
+	unwatchSubtree(**it);
+	dir.children.erase(it);
+}
+
+void FileTree::rescanAll(DirectoryNode &dir) {
+	if (!dir.updated) return;
+	requestListing(dir, true);
+	for (auto &child : dir.children) {
+		if (child->isDirectory()) rescanAll(static_cast<DirectoryNode &>(*child));
+	}
 }
 
-FileTree::iterator FileTree::iterator::operator++(int) {
-	iterator temp = *this;
-	++(*this);
-	return temp;
+void FileTree::toggleOpen(std::size_t row) {
+	if (row >= rows.size() || !rows[row].node->isDirectory()) return;
+	auto &dir = static_cast<DirectoryNode &>(*rows[row].node);
+	// the row itself changes its icon
+	firstChangedRow = std::min(firstChangedRow, row);
+
+	dir.opened = !dir.opened;
+	if (!dir.opened) {
+		rows.erase(rows.begin() + row + 1, rows.begin() + subtreeEnd(row));
+		renumberRows(row + 1);
+		return;
+	}
+
+	std::vector<Row> subtree;
+	collectRows(dir, rows[row].depth + 1, subtree);
+	rows.insert(rows.begin() + row + 1, subtree.begin(), subtree.end());
+	renumberRows(row + 1);
+
+	requestListing(dir);
+	// prefetch one level ahead so opening a subdirectory is usually instant
+	for (auto &child : dir.children) {
+		if (child->isDirectory()) requestListing(static_cast<DirectoryNode &>(*child));
+	}
 }
 
-FileTree::iterator &FileTree::iterator::operator--() {
-	if (stack.empty()) throw std::out_of_range("Iterator out of range");
+void FileTree::setOpen(std::size_t row, bool open) {
+	if (row >= rows.size() || !rows[row].node->isDirectory()) return;
+	if (static_cast<DirectoryNode &>(*rows[row].node).opened != open) { toggleOpen(row); }
+}
 
-	auto &[dir, index] = stack.back();
-	if (index == 0) {
-		stack.pop_back();
-		return *this;
+void FileTree::collectOpen(const DirectoryNode &dir, std::vector<std::filesystem::path> &out) const {
+	for (const auto &child : dir.children) {
+		if (!child->isDirectory() || !static_cast<const DirectoryNode &>(*child).opened) continue;
+		out.push_back(child->path.lexically_relative(root->path));
+		collectOpen(static_cast<const DirectoryNode &>(*child), out);
 	}
+}
 
-	--index;
-	auto *node = dir->children[index].get();
+std::vector<std::filesystem::path> FileTree::getOpenDirectories() const {
+	std::vector<std::filesystem::path> open;
+	collectOpen(*root, open);
+	return open;
+}
 
-	while (auto *subdir = dynamic_cast<DirectoryNode *>(node)) {
-		if (subdir->getChildCount() == 0) break;
-		stack.push_back({subdir, subdir->getChildCount() - 1});
-		node = subdir->children.back().get();
+void FileTree::openPending(DirectoryNode &dir) {
+	for (auto &child : dir.children) {
+		if (pendingOpen.empty()) return;
+		if (!child->isDirectory()) continue;
+		auto &subdir = static_cast<DirectoryNode &>(*child);
+		if (pendingOpen.erase(subdir.path.lexically_relative(root->path).generic_string())) {
+			setOpen(findRow(subdir), true);
+		}
+		// directories below it wait for its listing if it is not there yet
+		if (subdir.opened && subdir.updated) openPending(subdir);
 	}
+}
 
-	return *this;
+void FileTree::openDirectories(const std::vector<std::filesystem::path> &directories) {
+	for (const auto &directory : directories) {
+		pendingOpen.insert(directory.generic_string());
+	}
+	if (root->updated) openPending(*root);
 }
 
-FileTree::iterator FileTree::iterator::operator--(int) {
-	iterator temp = *this;
-	--(*this);
-	return temp;
+FileTree::DirectoryNode *FileTree::findDirectory(const std::filesystem::path &path, bool *visible) const {
+	auto relative = path.lexically_relative(root->path);
+	if (relative.empty() || *relative.begin() == "..") return nullptr;
+
+	DirectoryNode *dir = root.get();
+	if (visible) *visible = true;
+	for (const auto &part : relative) {
+		if (part == ".") continue;
+		auto it = std::find_if(dir->children.begin(), dir->children.end(), [&](const auto &child) {
+			return child->isDirectory() && child->path.filename() == part;
+		});
+		if (it == dir->children.end()) return nullptr;
+		if (visible) *visible = *visible && dir->opened;
+		dir = static_cast<DirectoryNode *>(it->get());
+	}
+	if (visible) *visible = *visible && dir->opened;
+	return dir;
 }
 
-void FileTree::iterator::printStack(std::ostream &os) const {
-	for (const auto &[dir, index] : stack) {
-		os << dir->path.filename().string() << " ( " << dir->children[index]->path.filename().string() << " ) ";
+bool FileTree::update() {
+	bool visibleChange = false;
+
+	for (auto &listing : scanner->takeFinished()) {
+		bool		   visible = false;
+		DirectoryNode *dir	   = findDirectory(listing.path, &visible);
+		if (dir == nullptr) continue;	  // the directory went away while it was being listed
+
+		applyListing(*dir, std::move(listing.entries));
+
+		if (visible) {
+			refreshRows(*dir);
+			visibleChange = true;
+			for (auto &child : dir->children) {
+				if (child->isDirectory()) requestListing(static_cast<DirectoryNode &>(*child));
+			}
+			openPending(*dir);
+		}
+	}
+
+	auto events = watcher->takeEvents();
+	if (events.empty()) return visibleChange;
+
+	if (std::ranges::any_of(events, [](const auto &event) { return event.overflow; })) {
+		rescanAll(*root);
+		return visibleChange;
+	}
+
+	// group by directory so each node is looked up and patched once per batch
+	std::ranges::stable_sort(events, {}, [](const FileTreeWatcher::Event &event) -> const std::filesystem::path & {
+		return event.directory;
+	});
+	for (auto begin = events.begin(); begin != events.end();) {
+		auto end = std::find_if(begin, events.end(),
+								[&](const auto &event) { return event.directory != begin->directory; });
+
+		bool		   visible = false;
+		DirectoryNode *dir	   = findDirectory(begin->directory, &visible);
+		if (dir != nullptr && dir->updated) {
+			if (end - begin > MAX_INCREMENTAL_EVENTS) {
+				// a build directory churning files, one merged relisting is cheaper than thousands of inserts
+				requestListing(*dir, true);
+			} else {
+				for (auto it = begin; it != end; ++it) {
+					if (it->created) insertChild(*dir, it->name, it->isDirectory);
+					else removeChild(*dir, it->name, it->isDirectory);
+				}
+				if (visible) {
+					refreshRows(*dir);
+					visibleChange = true;
+				}
+			}
+		}
+		begin = end;
 	}
-	os << std::endl;
+	return visibleChange;
+}
+
+void FileTree::print(std::ostream &os) const {
+	os << root->path.string() << "/\n";
+	if (!root->opened) return;
+	for (const auto &child : root->children)
+		child->print(os, 0);
 }
@@ -0,0 +1,215 @@
+#include "file_utils.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+
+#ifdef _WIN32
+	#include <io.h>
+	#include <process.h>
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <signal.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+using namespace fxed;
+
+static std::filesystem::path findCacheDirectory() {
+	std::filesystem::path base;
+#ifdef _WIN32
+	if (const char *localAppData = std::getenv("LOCALAPPDATA")) base = localAppData;
+#else
+	if (const char *xdgCache = std::getenv("XDG_CACHE_HOME"); xdgCache && *xdgCache) base = xdgCache;
+	else if (const char *home = std::getenv("HOME"); home && *home) base = std::filesystem::path(home) / ".cache";
+#endif
+	if (base.empty()) return {};
+
+	std::error_code ec;
+	auto			dir = base / "fxed";
+	std::filesystem::create_directories(dir, ec);
+	if (ec) {
+		dbLog(dbg::LOG_WARNING, "Could not create cache directory ", dir, ": ", ec.message());
+		return {};
+	}
+	return dir;
+}
+
+const std::filesystem::path &fxed::getCacheDirectory() {
+	static const std::filesystem::path dir = findCacheDirectory();
+	return dir;
+}
+
+uint32_t fxed::getProcessId() {
+#ifdef _WIN32
+	return _getpid();
+#else
+	return ::getpid();
+#endif
+}
+
+bool fxed::isProcessRunning(uint32_t pid) {
+#ifdef _WIN32
+	HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, pid);
+	if (process == NULL) return GetLastError() == ERROR_ACCESS_DENIED;
+	bool running = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+	CloseHandle(process);
+	return running;
+#else
+	// a process of another user cannot be signalled, but it is there
+	return ::kill(pid_t(pid), 0) == 0 || errno == EPERM;
+#endif
+}
+
+uint64_t fxed::hashFileStamp(const std::filesystem::path &path, uint64_t seed) {
+	std::error_code ec;
+	seed = hashString(path.string(), seed);
+
+	auto size = std::filesystem::file_size(path, ec);
+	if (ec) size = 0;
+	seed = hashValue(size, seed);
+
+	auto time = std::filesystem::last_write_time(path, ec);
+	auto ticks = ec ? 0 : time.time_since_epoch().count();
+	return hashValue(ticks, seed);
+}
+
+MappedFile::MappedFile(const std::filesystem::path &path) {
+#ifdef _WIN32
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file) return;
+	size = file.tellg();
+	if (size == 0) return;
+	char *buffer = new char[size];
+	file.seekg(0);
+	if (!file.read(buffer, size)) {
+		delete[] buffer;
+		size = 0;
+		return;
+	}
+	data = buffer;
+#else
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return;
+
+	struct stat st;
+	if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return;
+	}
+
+	void *ptr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (ptr == MAP_FAILED) {
+		dbLog(dbg::LOG_WARNING, "Failed to mmap ", path);
+		return;
+	}
+	data   = (const char *)ptr;
+	size   = st.st_size;
+	mapped = true;
+#endif
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept : data(other.data), size(other.size), mapped(other.mapped) {
+	other.data = nullptr;
+	other.size = 0;
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+	if (this != &other) {
+		this->~MappedFile();
+		data	   = other.data;
+		size	   = other.size;
+		mapped	   = other.mapped;
+		other.data = nullptr;
+		other.size = 0;
+	}
+	return *this;
+}
+
+MappedFile::~MappedFile() {
+	if (data == nullptr) return;
+#ifndef _WIN32
+	if (mapped) {
+		::munmap((void *)data, size);
+		data = nullptr;
+		return;
+	}
+#endif
+	delete[] data;
+	data = nullptr;
+}
+
+void MappedFile::adviseSequential() const {
+#ifndef _WIN32
+	if (mapped) ::madvise((void *)data, size, MADV_SEQUENTIAL);
+#endif
+}
+
+bool fxed::syncFile(std::FILE *file) {
+	if (std::fflush(file) != 0) return false;
+#ifdef _WIN32
+	return _commit(_fileno(file)) == 0;
+#else
+	return ::fdatasync(::fileno(file)) == 0;
+#endif
+}
+
+void fxed::syncDirectory(const std::filesystem::path &dir) {
+#ifndef _WIN32
+	int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) return;
+	::fsync(fd);
+	::close(fd);
+#else
+	(void)dir;
+#endif
+}
+
+static std::error_code lastError() { return std::error_code(errno, std::generic_category()); }
+
+std::error_code fxed::writeFileAtomic(const std::filesystem::path &path,
+									  const std::function<std::error_code(std::FILE *)> &write, bool sync) {
+	// pid and counter keep concurrent writers of the same file, in this process or another, off each other's temp file
+	static std::atomic<unsigned int> writeCounter = 0;
+
+	auto tmpPath = path;
+	tmpPath += ".tmp" + std::to_string(getProcessId()) + "_" + std::to_string(writeCounter++);
+
+	std::FILE *file = std::fopen(tmpPath.string().c_str(), "wb");
+	if (file == nullptr) return lastError();
+	std::error_code ec = write(file);
+	if (!ec && sync && !syncFile(file)) ec = lastError();
+	if (std::fclose(file) != 0 && !ec) ec = lastError();
+
+	// a file written over keeps its permissions, the temporary one was created with the defaults
+	std::error_code ignored;
+	if (auto status = std::filesystem::status(path, ignored); !ec && std::filesystem::exists(status)) {
+		std::filesystem::permissions(tmpPath, status.permissions(), ec);
+	}
+	if (!ec) std::filesystem::rename(tmpPath, path, ec);
+	if (ec) {
+		std::filesystem::remove(tmpPath, ignored);
+		return ec;
+	}
+	// the rename itself is only durable once the directory is written
+	if (sync) syncDirectory(path.parent_path());
+	return {};
+}
+
+bool fxed::writeFileAtomic(const std::filesystem::path &path, std::span<const char> bytes) {
+	auto ec = writeFileAtomic(
+		path,
+		[&](std::FILE *file) {
+			return std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size() ? std::error_code() : lastError();
+		},
+		false);
+	if (ec) dbLog(dbg::LOG_ERROR, "Failed to write ", path, ": ", ec.message());
+	return !ec;
+}
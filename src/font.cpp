@@ -1,7 +1,14 @@
 #include "font.hpp"
+#include <algorithm>
+#include <cstring>
 #include <format>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
 
 #include "buffer_utils.hpp"
+#include "file_utils.hpp"
 #include "nri.hpp"
 #include "packing.hpp"
 #include "static_vector.hpp"
@@ -170,7 +177,9 @@ class ImageAtlasStorage {
 		return (void *)((T *)data + (y * width * N + x * N));
 	}
 
-	uint32_t getStride() const { return width * N * sizeof(T); }
+	uint32_t	getStride() const { return width * N * sizeof(T); }
+	std::size_t getSize() const { return std::size_t(width) * height * N * sizeof(T); }
+	void	   *getData() const { return data; }
 };
 
 struct FontAtlas::FontData {
@@ -187,9 +196,91 @@ struct FontAtlas::FontData {
 };
 
 struct FontFallbackChain::FontFallbackChainData {
-	std::vector<FT_Face> fontFaces;
+	std::vector<std::string> fontPaths;
+	std::vector<FT_Face>	 fontFaces;		// nullptr until the face is first needed
+	std::vector<bool>		 faceOpened;
+	FT_Library				 ft = nullptr;
+
+	// faces are opened one by one the first time the faces before them miss a codepoint, so fallbacks like the emoji
+	// font are never loaded for plain text
+	FT_Face getFace(std::size_t i) {
+		if (faceOpened[i]) return fontFaces[i];
+		faceOpened[i] = true;
+
+		if (ft == nullptr && FT_Init_FreeType(&ft)) { THROW_RUNTIME_ERR("Could not initialize FreeType library!"); }
+		if (FT_New_Face(ft, fontPaths[i].c_str(), 0, &fontFaces[i])) {
+			dbLog(dbg::LOG_ERROR, "Failed to load font face from path: ", fontPaths[i]);
+			fontFaces[i] = nullptr;
+			return nullptr;
+		}
+		dbLog(dbg::LOG_INFO, "Loaded font face from path: ", fontPaths[i]);
+		return fontFaces[i];
+	}
+};
+
+// On-disk copy of a rasterized atlas. Layout: header, glyph boxes, codepoint map, packer rows, atlas pixels.
+struct AtlasCacheHeader {
+	char	 magic[8];
+	uint32_t formatVersion;
+	uint32_t packerVersion;
+	uint64_t fontFingerprint;
+	uint32_t fontSize;
+	uint32_t atlasSize;
+	uint32_t glyphCount;
+	uint32_t codepointCount;
+	uint32_t rowCount;
+	uint32_t glyphEntrySize;
 };
 
+struct AtlasCacheCodepoint {
+	uint32_t codepoint;
+	int32_t	 glyphIndex;
+};
+
+static constexpr char	  atlasCacheMagic[8]	  = {'F', 'X', 'A', 'T', 'L', 'A', 'S', '\0'};
+static constexpr uint32_t atlasCacheFormatVersion = 1;
+// atlas caches past this total are evicted, the least recently used first
+static constexpr std::uintmax_t maxAtlasCacheBytes = 64ull << 20;
+
+/// Removes the caches kept replaces, of the same fonts and size at another atlas size, then the least recently used
+/// ones until all of them fit in maxAtlasCacheBytes. kept itself is never removed.
+static void evictAtlasCaches(const std::filesystem::path &kept) {
+	std::string keptName = kept.filename().string();
+	std::string sameFont = keptName.substr(0, keptName.rfind('_') + 1);
+
+	struct Entry {
+		std::filesystem::path			path;
+		std::filesystem::file_time_type time;
+		std::uintmax_t					size;
+	};
+	std::vector<Entry> entries;
+	std::uintmax_t	   total = 0;
+	std::error_code	   ec;
+	for (const auto &entry : std::filesystem::directory_iterator(kept.parent_path(), ec)) {
+		std::string name = entry.path().filename().string();
+		if (!name.starts_with("atlas_") || !name.ends_with(".bin") || name == keptName) continue;
+		std::error_code statError;
+		if (name.starts_with(sameFont)) {
+			std::filesystem::remove(entry.path(), statError);
+			continue;
+		}
+		auto size = entry.file_size(statError);
+		auto time = entry.last_write_time(statError);
+		if (statError) continue;
+		entries.push_back({entry.path(), time, size});
+		total += size;
+	}
+	total += std::filesystem::file_size(kept, ec);
+
+	std::ranges::sort(entries, {}, &Entry::time);
+	for (const auto &entry : entries) {
+		if (total <= maxAtlasCacheBytes) break;
+		if (!std::filesystem::remove(entry.path, ec)) continue;
+		total -= entry.size;
+		dbLog(dbg::LOG_INFO, "Evicted glyph atlas cache ", entry.path);
+	}
+}
+
 int FontAtlas::addGlyphToAtlas(uint32_t c) {
 	try {
 		auto *added = data->glyphBoxes.push_back(this->fallbackChain.getGlyphBox(c, fontSize));
@@ -200,7 +291,7 @@ int FontAtlas::addGlyphToAtlas(uint32_t c) {
 
 		auto &box	= added->first;
 		auto &index = added->second;
-		auto &face	= this->fallbackChain.data->fontFaces[index];
+		auto  face	= this->fallbackChain.data->getFace(index);
 
 		auto result						  = data->glyphBoxes.size() - 1;
 		data->codepointToGlyphBoxIndex[c] = result;
@@ -312,24 +403,145 @@ FontAtlas::FontAtlas(nri::NRI &nri, nri::CommandQueue &q, FontFallbackChain &&fa
 
 	data = new FontData(atlasSize, fontSize, uploadData + offsets[0], uploadData + offsets[1], maxGlyphCount);
 
+	loadAtlasCache();
 	uploadAtlasToGPU();
 }
 
-FontAtlas::~FontAtlas() { delete data; }
+FontAtlas::~FontAtlas() {
+	if (data == nullptr) return;
+	saveAtlasCache();
+	delete data;
+}
+
+std::filesystem::path FontAtlas::getAtlasCachePath() const {
+	const auto &cacheDir = getCacheDirectory();
+	if (cacheDir.empty()) return {};
+	return cacheDir / std::format("atlas_{:016x}_{}_{}.bin", fallbackChain.getFingerprint(), fontSize,
+								  (uint32_t)getAtlasSize());
+}
+
+bool FontAtlas::loadAtlasCache() {
+	auto path = getAtlasCachePath();
+	if (path.empty()) return false;
+
+	MappedFile file(path);
+	if (!file.isOpen() || file.getSize() < sizeof(AtlasCacheHeader)) return false;
+
+	AtlasCacheHeader header;
+	std::memcpy(&header, file.getData(), sizeof(header));
+
+	const std::size_t glyphBytes	 = std::size_t(header.glyphCount) * sizeof(std::pair<GlyphBox, int>);
+	const std::size_t codepointBytes = std::size_t(header.codepointCount) * sizeof(AtlasCacheCodepoint);
+	const std::size_t rowBytes		 = std::size_t(header.rowCount) * sizeof(uint32_t);
+
+	if (std::memcmp(header.magic, atlasCacheMagic, sizeof(atlasCacheMagic)) != 0 ||
+		header.formatVersion != atlasCacheFormatVersion || header.packerVersion != RowAtlasPacker::VERSION ||
+		header.fontFingerprint != fallbackChain.getFingerprint() || header.fontSize != fontSize ||
+		header.atlasSize != (uint32_t)getAtlasSize() || header.glyphCount > maxGlyphCount ||
+		header.glyphEntrySize != sizeof(std::pair<GlyphBox, int>) ||
+		header.rowCount != data->atlasPacker.getRowOffsets().size() ||
+		file.getSize() != sizeof(header) + glyphBytes + codepointBytes + rowBytes + data->atlasStorage.getSize()) {
+		dbLog(dbg::LOG_INFO, "Ignoring stale glyph atlas cache ", path);
+		return false;
+	}
+
+	const char *glyphs	   = file.getData() + sizeof(header);
+	const char *codepoints = glyphs + glyphBytes;
+	const char *rows	   = codepoints + codepointBytes;
+	const char *pixels	   = rows + rowBytes;
+
+	std::vector<uint32_t> rowOffsets(header.rowCount);
+	std::memcpy(rowOffsets.data(), rows, rowBytes);
+	if (!data->atlasPacker.restoreRowOffsets(rowOffsets.data(), rowOffsets.size())) return false;
+
+	data->glyphBoxes.clear();
+	for (uint32_t i = 0; i < header.glyphCount; ++i) {
+		std::pair<GlyphBox, int> entry;
+		std::memcpy((void *)&entry, glyphs + i * sizeof(entry), sizeof(entry));
+		data->glyphBoxes.push_back(entry);
+	}
+
+	data->codepointToGlyphBoxIndex.clear();
+	data->codepointToGlyphBoxIndex.reserve(header.codepointCount);
+	for (uint32_t i = 0; i < header.codepointCount; ++i) {
+		AtlasCacheCodepoint entry;
+		std::memcpy(&entry, codepoints + i * sizeof(entry), sizeof(entry));
+		if (entry.glyphIndex < 0 || entry.glyphIndex >= (int)header.glyphCount) continue;
+		data->codepointToGlyphBoxIndex[entry.codepoint] = entry.glyphIndex;
+	}
+
+	std::memcpy(data->atlasStorage.getData(), pixels, data->atlasStorage.getSize());
+
+	cacheDirty = false;
+	// the modification time orders the caches for eviction, a cache that is used is kept longer
+	std::error_code ec;
+	std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+	dbLog(dbg::LOG_INFO, "Loaded ", header.glyphCount, " glyphs from atlas cache ", path);
+	return true;
+}
+
+void FontAtlas::saveAtlasCache() {
+	if (!cacheDirty) return;
+	auto path = getAtlasCachePath();
+	if (path.empty()) return;
+
+	AtlasCacheHeader header;
+	std::memcpy(header.magic, atlasCacheMagic, sizeof(atlasCacheMagic));
+	header.formatVersion   = atlasCacheFormatVersion;
+	header.packerVersion   = RowAtlasPacker::VERSION;
+	header.fontFingerprint = fallbackChain.getFingerprint();
+	header.fontSize		   = fontSize;
+	header.atlasSize	   = getAtlasSize();
+	header.glyphCount	   = data->glyphBoxes.size();
+	header.codepointCount  = data->codepointToGlyphBoxIndex.size();
+	header.rowCount		   = data->atlasPacker.getRowOffsets().size();
+	header.glyphEntrySize  = sizeof(std::pair<GlyphBox, int>);
+
+	const std::size_t glyphBytes	 = std::size_t(header.glyphCount) * sizeof(std::pair<GlyphBox, int>);
+	const std::size_t codepointBytes = std::size_t(header.codepointCount) * sizeof(AtlasCacheCodepoint);
+	const std::size_t rowBytes		 = std::size_t(header.rowCount) * sizeof(uint32_t);
+
+	std::vector<char> bytes(sizeof(header) + glyphBytes + codepointBytes + rowBytes + data->atlasStorage.getSize());
+	char			 *out = bytes.data();
+
+	std::memcpy(out, &header, sizeof(header));
+	out += sizeof(header);
+	std::memcpy(out, data->glyphBoxes.begin(), glyphBytes);
+	out += glyphBytes;
+	for (auto [codepoint, index] : data->codepointToGlyphBoxIndex) {
+		AtlasCacheCodepoint entry{codepoint, index};
+		std::memcpy(out, &entry, sizeof(entry));
+		out += sizeof(entry);
+	}
+	std::memcpy(out, data->atlasPacker.getRowOffsets().data(), rowBytes);
+	out += rowBytes;
+	std::memcpy(out, data->atlasStorage.getData(), data->atlasStorage.getSize());
+
+	if (writeFileAtomic(path, bytes)) {
+		cacheDirty = false;
+		dbLog(dbg::LOG_INFO, "Saved ", header.glyphCount, " glyphs to atlas cache ", path);
+		evictAtlasCaches(path);
+	}
+}
 
 void FontAtlas::resize(uint32_t newSize) {
 	auto oldSize = fontSize;
 	newSize		 = std::min(newSize, 32u);
 	if (oldSize == newSize) return;
 
+	saveAtlasCache();
+
 	dbLog(dbg::LOG_INFO, "glyphboxes count before resize: ", data->glyphBoxes.size());
-	data->glyphBoxes.clear();
 	data->atlasPacker.setRowHeight(newSize + 2);
 
 	fontSize = newSize;
 
-	for (auto [c, _] : data->codepointToGlyphBoxIndex) {
-		addGlyphToAtlas(c);
+	if (!loadAtlasCache()) {
+		data->glyphBoxes.clear();
+		for (auto [c, _] : data->codepointToGlyphBoxIndex) {
+			addGlyphToAtlas(c);
+		}
+		cacheDirty = true;
 	}
 	dbLog(dbg::LOG_INFO, "glyphboxes count after resize: ", data->glyphBoxes.size());
 
@@ -343,6 +555,8 @@ void FontAtlas::syncWithGPU() {
 }
 
 void FontAtlas::uploadAtlasToGPU() {
+	// the frames in flight may still sample the atlas and read the glyph boxes, new glyphs are rare enough to wait
+	nri.synchronize();
 	nri::CommandPool &commandPool	= nri.getDefaultCommandPool();
 	auto			  commandBuffer = nri.createCommandBuffer(commandPool);
 	commandBuffer->begin();
@@ -377,29 +591,30 @@ std::pair<fxed::GlyphBox, int> FontAtlas::getGlyphBox(uint32_t c) {
 		auto i = addGlyphToAtlas(c);
 		if (i == -1) { return getGlyphBox(U'?'); }
 		atlasChanged = true;
+		cacheDirty	 = true;
 		return {data->glyphBoxes[i].first, i};
 	}
 }
 
 FontFallbackChain::FontFallbackChain(const std::vector<std::string_view> &fonts) : data(new FontFallbackChainData()) {
-	FT_Library ft;
-	if (FT_Init_FreeType(&ft)) { THROW_RUNTIME_ERR("Could not initialize FreeType library!"); }
+	data->fontPaths.assign(fonts.begin(), fonts.end());
+	data->fontFaces.resize(fonts.size(), nullptr);
+	data->faceOpened.resize(fonts.size(), false);
+}
 
-	for (const auto &fontPath : fonts) {
-		FT_Face face;
-		if (FT_New_Face(ft, fontPath.data(), 0, &face)) {
-			dbLog(dbg::LOG_ERROR, "Failed to load font face from path: ", fontPath);
-			continue;
-		}
-		dbLog(dbg::LOG_INFO, "Loaded font face from path: ", fontPath);
-		data->fontFaces.push_back(face);
+uint64_t FontFallbackChain::getFingerprint() const {
+	uint64_t hash = FNV_OFFSET_BASIS;
+	for (const auto &fontPath : data->fontPaths) {
+		hash = hashFileStamp(fontPath, hash);
 	}
+	return hash;
 }
 
 std::pair<fxed::GlyphBox, int> FontFallbackChain::getGlyphBox(uint32_t c, uint32_t size) const {
-	for (unsigned int i = 0; i < data->fontFaces.size(); i++) {
-		FT_Face &face	   = data->fontFaces[i];
-		FT_UInt	 loadFlags = FT_LOAD_DEFAULT;
+	for (unsigned int i = 0; i < data->fontPaths.size(); i++) {
+		FT_Face face = data->getFace(i);
+		if (face == nullptr) continue;
+		FT_UInt loadFlags = FT_LOAD_DEFAULT;
 
 		FT_UInt glyphIndex = FT_Get_Char_Index(face, c);
 
@@ -447,8 +662,9 @@ std::pair<fxed::GlyphBox, int> FontFallbackChain::getGlyphBox(uint32_t c, uint32
 FontFallbackChain::~FontFallbackChain() {
 	if (data == nullptr) { return; }
 	for (auto &face : data->fontFaces) {
-		FT_Done_Face(face);
+		if (face) FT_Done_Face(face);
 	}
+	if (data->ft) FT_Done_FreeType(data->ft);
 	delete data;
 }
 
@@ -457,7 +673,8 @@ FontFallbackChain::~FontFallbackChain() {
 	#include <shlobj.h>
 	#include <string>
 
-static std::string findWindowsFontPath(const std::string_view &fontName) {
+/// with substitute, a font that is always there stands in when fontName is not installed
+static std::string findWindowsFontPath(const std::string_view &fontName, bool substitute) {
 	char fontsPath[MAX_PATH];
 
 	// Get Windows Fonts directory
@@ -468,7 +685,7 @@ static std::string findWindowsFontPath(const std::string_view &fontName) {
 
 		// Check which exists
 		if (GetFileAttributesA(segoeui.c_str()) != INVALID_FILE_ATTRIBUTES) { return segoeui; }
-		if (GetFileAttributesA(tahoma.c_str()) != INVALID_FILE_ATTRIBUTES) { return tahoma; }
+		if (substitute && GetFileAttributesA(tahoma.c_str()) != INVALID_FILE_ATTRIBUTES) { return tahoma; }
 	}
 	return "";
 }
@@ -478,11 +695,13 @@ static std::string findWindowsFontPath(const std::string_view &fontName) {
 	#include <fontconfig/fontconfig.h>
 	#include <string>
 
-static std::string findLinuxFontPath(const std::string_view &fontName) {
+/// fontconfig always matches some font, without substitute only one of the family asked for is taken
+static std::string findLinuxFontPath(const std::string_view &fontName, bool substitute) {
 	std::string fontPath;
 
-	FcConfig  *config  = FcInitLoadConfigAndFonts();
-	FcPattern *pattern = FcNameParse((const FcChar8 *)fontName.data());
+	// loading the config scans every installed font, so it is done once and only on a path cache miss
+	static FcConfig *config = FcInitLoadConfigAndFonts();
+	FcPattern		*pattern = FcNameParse((const FcChar8 *)fontName.data());
 
 	FcConfigSubstitute(config, pattern, FcMatchPattern);
 	FcDefaultSubstitute(pattern);
@@ -490,37 +709,110 @@ static std::string findLinuxFontPath(const std::string_view &fontName) {
 	FcResult   result;
 	FcPattern *font = FcFontMatch(config, pattern, &result);
 
+	// the family asked for comes first in the pattern, substitution appends the families that may stand in for it
+	FcChar8 *family	 = nullptr;
+	bool	 matches = substitute || FcPatternGetString(pattern, FC_FAMILY, 0, &family) != FcResultMatch;
 	if (font) {
+		FcChar8 *matchedFamily = nullptr;
+		for (int i = 0; !matches && FcPatternGetString(font, FC_FAMILY, i, &matchedFamily) == FcResultMatch; ++i) {
+			matches = FcStrCmpIgnoreCase(family, matchedFamily) == 0;
+		}
 		FcChar8 *file = nullptr;
-		if (FcPatternGetString(font, FC_FILE, 0, &file) == FcResultMatch) { fontPath = (char *)file; }
+		if (matches && FcPatternGetString(font, FC_FILE, 0, &file) == FcResultMatch) { fontPath = (char *)file; }
 		FcPatternDestroy(font);
 	}
 
 	FcPatternDestroy(pattern);
-	FcConfigDestroy(config);
 
 	return fontPath;
 }
 #endif
 
+/// Persistent font name -> file path map, so resolving fonts at startup does not depend on how many fonts are
+/// installed. Entries are validated by checking that the file still exists. Only fonts that were found are kept, a
+/// name that fell back to the default font is looked up again on the next start.
+class FontPathCache {
+	std::unordered_map<std::string, std::string, beamcast::string_hash, std::equal_to<>> paths;
+	std::filesystem::path																 cachePath;
+	std::mutex																			 mutex;
+
+	FontPathCache() {
+		const auto &cacheDir = getCacheDirectory();
+		if (cacheDir.empty()) return;
+		cachePath = cacheDir / "font_paths.txt";
+
+		std::ifstream in(cachePath);
+		std::string	  line;
+		while (std::getline(in, line)) {
+			auto tab = line.find('\t');
+			if (tab == std::string::npos) continue;
+			paths.emplace(line.substr(0, tab), line.substr(tab + 1));
+		}
+	}
+
+	void save() {
+		if (cachePath.empty()) return;
+		std::string contents;
+		for (const auto &[name, path] : paths) {
+			contents += name;
+			contents += '\t';
+			contents += path;
+			contents += '\n';
+		}
+		writeFileAtomic(cachePath, contents);
+	}
+
+   public:
+	static FontPathCache &getInstance() {
+		static FontPathCache instance;
+		return instance;
+	}
+
+	std::optional<std::string> find(std::string_view fontName) {
+		std::lock_guard lock(mutex);
+		auto			it = paths.find(fontName);
+		if (it == paths.end()) return std::nullopt;
+
+		std::error_code ec;
+		if (!std::filesystem::is_regular_file(it->second, ec)) {
+			paths.erase(it);
+			save();
+			return std::nullopt;
+		}
+		return it->second;
+	}
+
+	void insert(std::string_view fontName, const std::string &path) {
+		std::lock_guard lock(mutex);
+		paths.insert_or_assign(std::string(fontName), path);
+		save();
+	}
+};
+
 std::string FontAtlas::findFontPath(std::string_view fontName) {
+	auto &cache = FontPathCache::getInstance();
+	if (auto cached = cache.find(fontName)) { return *cached; }
+
 	std::string result;
 #ifdef _WIN32
-	result = findWindowsFontPath(fontName);
+	result = findWindowsFontPath(fontName, false);
 #elif __linux__
-	result = findLinuxFontPath(fontName);
+	result = findLinuxFontPath(fontName, false);
 #else
 	result = "";	 // Unsupported platform
 #endif
-	if (result.empty()) { result = getDefaultSystemFontPath(); }
-	return result;
+	if (!result.empty()) {
+		cache.insert(fontName, result);
+		return result;
+	}
+	return getDefaultSystemFontPath();
 }
 
 std::string FontAtlas::getDefaultSystemFontPath() {
 #ifdef _WIN32
-	return findWindowsFontPath("segoeui");
+	return findWindowsFontPath("segoeui", true);
 #elif __linux__
-	return findLinuxFontPath("DejaVu Sans Mono:style=Regular");
+	return findLinuxFontPath("DejaVu Sans Mono:style=Regular", true);
 #else
 	return "";	   // Unsupported platform
 #endif
@@ -2,6 +2,8 @@
 
 #include "input.hpp"
 #include <glm/gtc/type_ptr.hpp>
+#include <string>
+#include <vector>
 
 using namespace fxed;
 
@@ -38,21 +40,15 @@ std::vector<std::function<void(GLFWwindow *, int, int, int)>>  Mouse::mouseButto
 std::vector<std::function<void(GLFWwindow *, double, double)>> Mouse::mouseMoveCallbacks;
 
 void Mouse::handleScroll(GLFWwindow *window, double xoffset, double yoffset) {
-	for (auto fun : scrollCallbacks) {
-		fun(window, xoffset, yoffset);
-	}
+	InputQueue::push({.type = InputEvent::Type::SCROLL, .window = window, .offset = {xoffset, yoffset}});
 }
 
 void Mouse::handleMouseButton(GLFWwindow *window, int button, int action, int mods) {
-	for (auto fun : mouseButtonCallbacks) {
-		fun(window, button, action, mods);
-	}
+	InputQueue::push({.type = InputEvent::Type::MOUSE_BUTTON, .window = window, .button = {button, action, mods}});
 }
 
 void Mouse::handleMouseMove(GLFWwindow *window, double xpos, double ypos) {
-	for (auto fun : mouseMoveCallbacks) {
-		fun(window, xpos, ypos);
-	}
+	InputQueue::push({.type = InputEvent::Type::MOUSE_MOVE, .window = window, .offset = {xpos, ypos}});
 }
 
 void Mouse::update() {}
@@ -93,14 +89,10 @@ void Keyboard::init(Window *window) {
 }
 
 void Keyboard::handleInput(GLFWwindow *window, int key, int scancode, int action, int mods) {
-	for (auto fun : callbacks) {
-		fun(window, key, scancode, action, mods);
-	}
+	InputQueue::push({.type = InputEvent::Type::KEY, .window = window, .key = {key, scancode, action, mods}});
 }
 void Keyboard::handleCharInput(GLFWwindow *window, unsigned int codepoint) {
-	for (auto fun : charCallbacks) {
-		fun(window, codepoint);
-	}
+	InputQueue::push({.type = InputEvent::Type::CHAR, .window = window, .codepoint = codepoint});
 }
 
 int Keyboard::getKey(Window &window, int key) { return glfwGetKey(window.getHandle(), key); }
@@ -115,3 +107,95 @@ void Keyboard::addKeyCallback(
 void Keyboard::addCharCallback(const std::function<void(GLFWwindow *window, int codepoint)> &callback) {
 	charCallbacks.push_back(callback);
 }
+
+void Keyboard::addTextCallback(const std::function<void(GLFWwindow *window, std::u32string_view text)> &callback) {
+	textCallbacks.push_back(callback);
+}
+
+void InputQueue::push(const InputEvent &event) {
+	if (!queue.push(event)) dbLog(dbg::LOG_WARNING, "Input queue is full, dropping event");
+}
+
+/// a key that types a character and runs no shortcut, its events can be taken out of a run of typed text
+static bool isTypingKey(const InputEvent &event) {
+	const auto &key = event.key;
+	bool printable	= (key.key >= GLFW_KEY_SPACE && key.key <= GLFW_KEY_WORLD_2) ||
+					  (key.key >= GLFW_KEY_KP_0 && key.key <= GLFW_KEY_KP_ADD) || key.key == GLFW_KEY_KP_EQUAL;
+	return printable && !(key.mods & (GLFW_MOD_CONTROL | GLFW_MOD_ALT | GLFW_MOD_SUPER));
+}
+
+void InputQueue::dispatch() {
+	std::u32string			text;
+	std::vector<InputEvent> keys;
+	InputEvent				event;
+	while (queue.pop(event)) {
+		// merge the following events of the same kind into this one
+		auto nextIsSame = [&]() {
+			const InputEvent *next = queue.peek();
+			return next != nullptr && next->type == event.type && next->window == event.window;
+		};
+		// GLFW reports the key before each character it types, so a run of text goes on across those keys
+		auto nextIsTyping = [&]() {
+			const InputEvent *next = queue.peek();
+			if (next == nullptr || next->window != event.window) return false;
+			return next->type == InputEvent::Type::CHAR || (next->type == InputEvent::Type::KEY && isTypingKey(*next));
+		};
+		InputEvent next;
+
+		switch (event.type) {
+			case InputEvent::Type::KEY:
+			case InputEvent::Type::CHAR:
+				if (event.type == InputEvent::Type::KEY && !isTypingKey(event)) {
+					for (const auto &fun : Keyboard::callbacks) {
+						fun(event.window, event.key.key, event.key.scancode, event.key.action, event.key.mods);
+					}
+					break;
+				}
+				text.clear();
+				keys.clear();
+				for (bool more = true; more; more = nextIsTyping() && queue.pop(event)) {
+					if (event.type == InputEvent::Type::CHAR) text.push_back(event.codepoint);
+					else keys.push_back(event);
+				}
+				// typing keys trigger no key handler, they reach the key callbacks before the text they typed
+				for (const InputEvent &key : keys) {
+					for (const auto &fun : Keyboard::callbacks) {
+						fun(key.window, key.key.key, key.key.scancode, key.key.action, key.key.mods);
+					}
+				}
+				if (text.empty()) break;
+				for (const auto &fun : Keyboard::charCallbacks) {
+					for (char32_t c : text) {
+						fun(event.window, c);
+					}
+				}
+				for (const auto &fun : Keyboard::textCallbacks) {
+					fun(event.window, text);
+				}
+				break;
+			case InputEvent::Type::SCROLL:
+				while (nextIsSame() && queue.pop(next)) {
+					event.offset.x += next.offset.x;
+					event.offset.y += next.offset.y;
+				}
+				for (const auto &fun : Mouse::scrollCallbacks) {
+					fun(event.window, event.offset.x, event.offset.y);
+				}
+				break;
+			case InputEvent::Type::MOUSE_BUTTON:
+				for (const auto &fun : Mouse::mouseButtonCallbacks) {
+					fun(event.window, event.button.button, event.button.action, event.button.mods);
+				}
+				break;
+			case InputEvent::Type::MOUSE_MOVE:
+				// positions are absolute, only the last one matters
+				while (nextIsSame() && queue.pop(next)) {
+					event.offset = next.offset;
+				}
+				for (const auto &fun : Mouse::mouseMoveCallbacks) {
+					fun(event.window, event.offset.x, event.offset.y);
+				}
+				break;
+		}
+	}
+}
@@ -0,0 +1,228 @@
+#include "large_file.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string_view>
+
+#include "utf8_convert.hpp"
+
+#ifdef __linux__
+	#include <poll.h>
+	#include <sys/eventfd.h>
+	#include <sys/inotify.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+using namespace fxed;
+
+/// the indexing thread shares what it found after every this many bytes
+static constexpr uint64_t INDEX_SLICE_SIZE = 64ull << 20;
+
+LargeFile::LargeFile(const std::filesystem::path &path) : path(path) {
+	checkpoints.push_back(0);
+	file	   = std::make_shared<const MappedFile>(path);
+	sharedFile = file;
+	// the index is built front to back, pages behind it can be dropped
+	file->adviseSequential();
+#ifdef __linux__
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	wakeFd	  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (inotifyFd >= 0) {
+		auto directory = path.parent_path().empty() ? std::filesystem::path(".") : path.parent_path();
+		dirWatch	   = inotify_add_watch(inotifyFd, directory.c_str(), IN_CREATE | IN_MOVED_TO);
+	}
+	if (inotifyFd >= 0 && (dirWatch < 0 || !watchFile())) {
+		::close(inotifyFd);
+		inotifyFd = -1;
+	}
+	if (inotifyFd < 0 || wakeFd < 0) dbLog(dbg::LOG_WARNING, "Cannot watch ", path, ", appended lines will not show");
+#endif
+	thread = std::jthread([this](std::stop_token stop) { run(stop); });
+}
+
+LargeFile::~LargeFile() {
+	thread.request_stop();
+#ifdef __linux__
+	uint64_t one = 1;
+	if (wakeFd >= 0 && ::write(wakeFd, &one, sizeof(one)) < 0) {
+		dbLog(dbg::LOG_WARNING, "Failed to wake large file thread");
+	}
+#endif
+	if (thread.joinable()) thread.join();
+#ifdef __linux__
+	if (inotifyFd >= 0) ::close(inotifyFd);
+	if (wakeFd >= 0) ::close(wakeFd);
+#endif
+}
+
+void LargeFile::run(std::stop_token stop) {
+	std::shared_ptr<const MappedFile> mapping;
+	{
+		std::lock_guard lock(mutex);
+		mapping = sharedFile;
+	}
+	uint64_t offset	  = 0;
+	bool	 replaced = false;
+	while (index(stop, *mapping, offset) && waitForChange(stop, replaced)) {
+		offset	= mapping->getSize();
+		mapping = std::make_shared<const MappedFile>(path);
+		std::lock_guard lock(mutex);
+		if (replaced || mapping->getSize() < offset) {
+			// truncated or replaced, whatever is there now is a different text
+			checkpoints.assign(1, 0);
+			newlineCount = 0;
+			offset		 = 0;
+			++generation;
+		}
+		sharedFile = mapping;
+	}
+}
+
+bool LargeFile::index(std::stop_token stop, const MappedFile &mapping, uint64_t offset) {
+	const char *data = mapping.getData();
+	uint64_t	size = mapping.getSize();
+	std::size_t count;
+	{
+		std::lock_guard lock(mutex);
+		count = newlineCount;
+	}
+	while (offset < size) {
+		if (stop.stop_requested()) return false;
+		std::vector<uint64_t> found;
+		const char			 *end = data + std::min(size, offset + INDEX_SLICE_SIZE);
+		for (const char *p = data + offset; (p = (const char *)std::memchr(p, '\n', end - p)) != nullptr;) {
+			++p;
+			if (++count % linesPerCheckpoint == 0) found.push_back(p - data);
+		}
+		offset = end - data;
+
+		std::lock_guard lock(mutex);
+		checkpoints.insert(checkpoints.end(), found.begin(), found.end());
+		newlineCount = count;
+	}
+	return true;
+}
+
+bool LargeFile::watchFile() {
+#ifdef __linux__
+	struct stat status;
+	if (::stat(path.c_str(), &status) != 0) return false;
+	// a file moved away keeps its watch, it would go on reporting changes to a file that is not shown anymore
+	if (fileWatch >= 0) inotify_rm_watch(inotifyFd, fileWatch);
+	// The mapping keeps a deleted file alive, so its deletion only shows as IN_ATTRIB when its link count drops.
+	// IN_MOVE_SELF and IN_DELETE_SELF cover a file renamed away or removed while not mapped.
+	fileWatch	= inotify_add_watch(inotifyFd, path.c_str(), IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+	watchedFile = {status.st_dev, status.st_ino};
+	return fileWatch >= 0;
+#else
+	return false;
+#endif
+}
+
+bool LargeFile::waitForChange(std::stop_token stop, bool &replaced) {
+	replaced = false;
+#ifdef __linux__
+	if (inotifyFd < 0 || wakeFd < 0) return false;
+	alignas(inotify_event) char buffer[4096];
+	pollfd						fds[2]	 = {{inotifyFd, POLLIN, 0}, {wakeFd, POLLIN, 0}};
+	std::string					fileName = path.filename().string();
+
+	while (!stop.stop_requested()) {
+		if (::poll(fds, 2, -1) < 0) continue;
+		if (fds[1].revents & POLLIN) return false;
+		// a program writing a log line by line sends a burst of events, they are picked up together
+		if (::poll(&fds[1], 1, 100) > 0) return false;
+		// any change to the file or to its name, a file there now may be another one
+		bool	changed = false;
+		ssize_t size;
+		while ((size = ::read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+			for (char *at = buffer; at < buffer + size;) {
+				auto *event = (inotify_event *)at;
+				at += sizeof(inotify_event) + event->len;
+				changed = changed || event->wd == fileWatch ||
+						  (event->wd == dirWatch && event->len > 0 && fileName == event->name);
+			}
+		}
+		if (!changed) continue;
+		struct stat status;
+		// gone and not back yet, the file shown stays until one is created with its name
+		if (::stat(path.c_str(), &status) != 0) continue;
+		replaced = std::pair<uint64_t, uint64_t>(status.st_dev, status.st_ino) != watchedFile;
+		if (replaced) {
+			if (!watchFile()) return false;
+			dbLog(dbg::LOG_INFO, "Following ", path, ", it was replaced");
+		}
+		return true;
+	}
+#else
+	(void)stop;
+#endif
+	return false;
+}
+
+bool LargeFile::update() {
+	std::lock_guard lock(mutex);
+	if (generation != knownGeneration) {
+		for (auto &cached : ring) {
+			cached.line = SIZE_MAX;
+		}
+		lastFound		= {0, 0};
+		knownGeneration = generation;
+	} else if (sharedFile != file) {
+		// only the line that ran to the old end can have grown
+		for (auto &cached : ring) {
+			if (cached.atEnd) cached.line = SIZE_MAX;
+		}
+	} else if (newlineCount + 1 == lineCount) {
+		return false;
+	}
+	file	  = sharedFile;
+	lineCount = newlineCount + 1;
+	return true;
+}
+
+uint64_t LargeFile::findLineStart(std::size_t line) {
+	// the lines in view are decoded top to bottom, so the scan usually goes on from the line before
+	auto [from, offset]	   = lastFound;
+	std::size_t checkpoint = line / linesPerCheckpoint;
+	if (from > line || from < checkpoint * linesPerCheckpoint) {
+		std::lock_guard lock(mutex);
+		// the checkpoints can be ahead of update() after the file was truncated
+		checkpoint = std::min(checkpoint, checkpoints.size() - 1);
+		from	   = checkpoint * linesPerCheckpoint;
+		offset	   = std::min(checkpoints[checkpoint], file->getSize());
+	}
+	const char *data = file->getData();
+	uint64_t	size = file->getSize();
+	for (; from < line && offset < size; ++from) {
+		auto *next = (const char *)std::memchr(data + offset, '\n', size - offset);
+		if (next == nullptr) break;
+		offset = next - data + 1;
+	}
+	lastFound = {from, offset};
+	return offset;
+}
+
+const std::u32string &LargeFile::getLine(std::size_t line) {
+	static const std::u32string noLine;
+	if (line >= lineCount || !file->isOpen()) return noLine;
+	auto &cached = ring[line % ring.size()];
+	if (cached.line == line) return cached.text;
+
+	const char *data  = file->getData();
+	uint64_t	size  = file->getSize();
+	uint64_t	start = findLineStart(line);
+	// no code point takes more than 4 bytes, the rest of a longer line is cut anyway
+	uint64_t	length = std::min<uint64_t>(size - start, maxLineLength * 4);
+	const char *end	   = length > 0 ? (const char *)std::memchr(data + start, '\n', length) : nullptr;
+	cached.line		   = line;
+	cached.atEnd	   = end == nullptr && start + length == size;
+	cached.text.clear();
+	for (char32_t c : std::string_view(data + start, end ? end - (data + start) : length) | fxed::to_utf32) {
+		if (cached.text.size() == maxLineLength) break;
+		cached.text.push_back(c);
+	}
+	return cached.text;
+}
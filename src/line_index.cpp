@@ -0,0 +1,168 @@
+#include "line_index.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <iterator>
+#include <numeric>
+#include <tuple>
+
+using namespace fxed;
+
+static uint64_t prefixSum(const std::vector<uint64_t> &tree, std::size_t count) {
+	uint64_t sum = 0;
+	for (; count > 0; count &= count - 1) {
+		sum += tree[count];
+	}
+	return sum;
+}
+
+void LineIndex::rebuildTrees() {
+	// every node adds its sum to its parent, linear in the number of blocks
+	lineTree.assign(blocks.size() + 1, 0);
+	offsetTree.assign(blocks.size() + 1, 0);
+	length = 0;
+	for (std::size_t i = 1; i <= blocks.size(); ++i) {
+		lineTree[i] += blocks[i - 1].lengths.size();
+		offsetTree[i] += blocks[i - 1].total;
+		length += blocks[i - 1].total;
+		std::size_t parent = i + (i & -i);
+		if (parent <= blocks.size()) {
+			lineTree[parent] += lineTree[i];
+			offsetTree[parent] += offsetTree[i];
+		}
+	}
+}
+
+void LineIndex::addToTrees(std::size_t block, uint64_t lengthDelta) {
+	// a negative delta wraps around and still adds up right
+	blocks[block].total += lengthDelta;
+	length += lengthDelta;
+	for (std::size_t i = block + 1; i < offsetTree.size(); i += i & -i) {
+		offsetTree[i] += lengthDelta;
+	}
+}
+
+std::pair<std::size_t, uint64_t> LineIndex::descend(const std::vector<uint64_t> &tree, uint64_t value) const {
+	std::size_t position = 0;
+	for (std::size_t step = std::bit_floor(tree.size() - 1); step > 0; step >>= 1) {
+		if (position + step < tree.size() && tree[position + step] <= value) {
+			position += step;
+			value -= tree[position];
+		}
+	}
+	return {position, value};
+}
+
+void LineIndex::assign(std::span<const std::u32string> lines) {
+	blocks.clear();
+	lineCount = 0;
+	replace(0, 0, lines);
+}
+
+void LineIndex::assign(std::span<const uint32_t> lengths) {
+	blocks.clear();
+	lineCount = 0;
+	replace(0, 0, lengths);
+}
+
+void LineIndex::replace(std::size_t first, std::size_t removed, std::span<const std::u32string> lines) {
+	std::vector<uint32_t> lengths;
+	lengths.reserve(lines.size());
+	for (const auto &line : lines) {
+		lengths.push_back(line.size() + 1);
+	}
+	replace(first, removed, std::span<const uint32_t>(lengths));
+}
+
+void LineIndex::replace(std::size_t first, std::size_t removed, std::span<const uint32_t> lengths) {
+	if (removed == lengths.size()) {
+		// the same number of lines, only the lengths of the blocks change
+		if (lengths.empty()) return;
+		auto [block, index] = descend(lineTree, first);
+		uint64_t delta		= 0;
+		for (uint32_t newLength : lengths) {
+			if (index == blocks[block].lengths.size()) {
+				addToTrees(block++, delta);
+				index = 0;
+				delta = 0;
+			}
+			uint32_t &stored = blocks[block].lengths[index++];
+			delta += uint64_t(newLength) - stored;
+			stored = newLength;
+		}
+		addToTrees(block, delta);
+		return;
+	}
+
+	// the lines before first in its block, the new lines and the lines after the removed ones in the block where they
+	// end are put together and split into blocks again
+	std::size_t block = 0;
+	uint64_t	index = 0;
+	if (first < lineCount) {
+		std::tie(block, index) = descend(lineTree, first);
+	} else if (!blocks.empty()) {
+		block = blocks.size() - 1;
+		index = blocks.back().lengths.size();
+	}
+	std::size_t lastBlock = block;
+	uint64_t	lastIndex = index + removed;
+	while (lastBlock < blocks.size() && lastIndex > blocks[lastBlock].lengths.size()) {
+		lastIndex -= blocks[lastBlock].lengths.size();
+		++lastBlock;
+	}
+
+	std::vector<uint32_t> spliced;
+	std::size_t			  end = block;	   // one past the last block replaced
+	if (!blocks.empty()) spliced.assign(blocks[block].lengths.begin(), blocks[block].lengths.begin() + index);
+	spliced.insert(spliced.end(), lengths.begin(), lengths.end());
+	if (!blocks.empty()) {
+		const auto &rest = blocks[lastBlock].lengths;
+		spliced.insert(spliced.end(), rest.begin() + lastIndex, rest.end());
+		end = lastBlock + 1;
+	}
+	// small leftovers join the next block, so deleting lines one by one does not leave many tiny blocks
+	if (spliced.size() < maxBlockSize / 4 && end < blocks.size()) {
+		spliced.insert(spliced.end(), blocks[end].lengths.begin(), blocks[end].lengths.end());
+		++end;
+	}
+
+	// blocks start half full, with room to grow before the next split
+	std::size_t chunkCount = (spliced.size() + maxBlockSize / 2 - 1) / (maxBlockSize / 2);
+	if (spliced.size() <= maxBlockSize) chunkCount = std::min<std::size_t>(chunkCount, 1);
+	std::vector<Block> newBlocks(chunkCount);
+	for (std::size_t i = 0; i < chunkCount; ++i) {
+		auto chunkBegin = spliced.begin() + spliced.size() * i / chunkCount;
+		auto chunkEnd	= spliced.begin() + spliced.size() * (i + 1) / chunkCount;
+		newBlocks[i].lengths.assign(chunkBegin, chunkEnd);
+		newBlocks[i].total = std::accumulate(chunkBegin, chunkEnd, uint64_t(0));
+	}
+	blocks.erase(blocks.begin() + block, blocks.begin() + end);
+	blocks.insert(blocks.begin() + block, std::make_move_iterator(newBlocks.begin()),
+				  std::make_move_iterator(newBlocks.end()));
+	lineCount = lineCount - removed + lengths.size();
+	rebuildTrees();
+}
+
+uint32_t LineIndex::getLineLength(std::size_t line) const {
+	auto [block, index] = descend(lineTree, line);
+	return blocks[block].lengths[index];
+}
+
+uint64_t LineIndex::lineToOffset(std::size_t line) const {
+	if (line >= lineCount) return length;
+	auto [block, index] = descend(lineTree, line);
+	const auto &lengths = blocks[block].lengths;
+	return prefixSum(offsetTree, block) + std::accumulate(lengths.begin(), lengths.begin() + index, uint64_t(0));
+}
+
+std::size_t LineIndex::offsetToLine(uint64_t offset) const {
+	if (lineCount == 0) return 0;
+	if (offset >= length) return lineCount - 1;
+	auto [block, rest]	= descend(offsetTree, offset);
+	const auto &lengths = blocks[block].lengths;
+	std::size_t index	= 0;
+	while (rest >= lengths[index]) {
+		rest -= lengths[index++];
+	}
+	return prefixSum(lineTree, block) + index;
+}
@@ -1,4 +1,5 @@
 #include "nri.hpp"
+#include "thread_pool.hpp"
 
 namespace nri {
 
@@ -26,6 +27,11 @@ ProgramBuilder &ProgramBuilder::setPushConstantRanges(const std::vector<PushCons
 	return *this;
 }
 
+std::future<std::unique_ptr<GraphicsProgram>> ProgramBuilder::buildGraphicsProgramAsync() {
+	return fxed::ThreadPool::getInstance().submit(
+		[builder = std::shared_ptr<ProgramBuilder>(clone())]() { return builder->buildGraphicsProgram(); });
+}
+
 ResourceHandle Buffer::getHandle() {
 	if (handle == ResourceHandle::INVALID_HANDLE) {
 		handle = createHandle();
@@ -1,3 +1,6 @@
+#include <charconv>
+#include <cmath>
+#include <format>
 #include <fstream>
 
 #include "pane.hpp"
@@ -97,6 +100,11 @@ void fxed::Pane::mouseClick(fxed::Mouse &, int button, int action, int) {
 
 void fxed::Pane::mouseMove(fxed::Mouse &, double, double) {}
 void fxed::Pane::charInput(unsigned int) {}
+void fxed::Pane::textInput(std::u32string_view text) {
+	for (char32_t c : text) {
+		charInput(c);
+	}
+}
 void fxed::Pane::keyInput(int, int, int, int) {}
 
 fxed::TextPane::TextPane(nri::NRI &nri, nri::CommandQueue &queue, uint32_t width, uint32_t height,
@@ -104,7 +112,7 @@ fxed::TextPane::TextPane(nri::NRI &nri, nri::CommandQueue &queue, uint32_t width
 	: Pane(nri, queue, width, height, U"Pane"),
 	  textRenderer(textRenderer),
 	  renderState(),
-	  textMesh(nri, queue, 100000) {
+	  textMesh(100000) {
 	renderState.viewportSize = {width, height};
 	renderState.translation	 = {0, 1};
 }
@@ -112,20 +120,21 @@ fxed::TextPane::TextPane(nri::NRI &nri, nri::CommandQueue &queue, uint32_t width
 void fxed::TextPane::render(nri::CommandBuffer &cmdBuf) {
 	// if the text renderer changed atlas may have changed, so we need to update the text mesh
 	if (textRenderer.getVersion() != textRendererVersion && !text.empty()) {
-		updateText(text);
+		rebuildMesh();
 		textRendererVersion = textRenderer.getVersion();
 	}
 	// don't allow scrolling up before the first line
 	renderState.translation.y = std::min(renderState.translation.y, 1.f);
 
-	renderState.translation.y = std::max(renderState.translation.y, -textMesh.getBounds().y + 1);
+	renderState.translation.y = std::max(renderState.translation.y, -getTextHeight() + 1);
 
 	renderState.translation.x = std::min(renderState.translation.x, 0.f);
 
 	Pane::render(cmdBuf);
 	TextRenderState currentRenderState = renderState;
 	currentRenderState.translation += (borderSize) / textRenderer.getFontSize();
-	textRenderer.renderText(cmdBuf, textMesh, currentRenderState);
+	currentRenderState.viewportPosition = position;
+	textRenderer.queueText(textMesh, currentRenderState);
 }
 
 void fxed::TextPane::scroll(fxed::Mouse &mouse, double deltaX, double deltaY) {
@@ -137,7 +146,7 @@ void fxed::TextPane::resize(uint32_t newWidth, uint32_t newHeight) {
 	if (newWidth == (uint32_t)size.x && newHeight == (uint32_t)size.y) return;
 	Pane::resize(newWidth, newHeight);
 	renderState.viewportSize = {newWidth, newHeight};
-	if (wordWrap) updateText(text);
+	if (wordWrap) rebuildMesh();
 };
 
 void fxed::TextPane::setTransform(uint32_t posX, uint32_t posY, uint32_t width, uint32_t height) {
@@ -145,6 +154,8 @@ void fxed::TextPane::setTransform(uint32_t posX, uint32_t posY, uint32_t width,
 	renderState.viewportSize = {width, height};
 }
 
+void fxed::TextPane::rebuildMesh() { updateText(text); }
+
 void fxed::TextPane::updateText(const std::u32string &text) {
 	this->text			  = text;
 	renderState.cursorPos = textMesh.updateText<std::span<const char32_t>>(
@@ -161,24 +172,85 @@ void fxed::TextPane::updateText(fxed::any_input_range<char32_t> &&text) {
 
 fxed::TextEditorPane::TextEditorPane(nri::NRI &nri, nri::CommandQueue &queue, uint32_t width, uint32_t height,
 									 TextRenderer &textRenderer, DefaultTextEditor &&editor)
-	: TextPane(nri, queue, width, height, textRenderer), editor(std::move(editor)) {}
+	: TextPane(nri, queue, width, height, textRenderer), editor(std::move(editor)), findBarMesh(256) {}
+
+template <class F>
+bool fxed::TextEditorPane::keepTopLine(F &&change) {
+	float		rowHeight = 1.2f;
+	float		top		  = -renderState.translation.y;
+	std::size_t topLine	  = rows.rowToLine((std::size_t)std::max(top / rowHeight, 0.f));
+	float		intoLine  = top - rows.lineToRow(topLine) * rowHeight;
+	if (!change()) return false;
+	renderState.translation.y = -(rows.lineToRow(topLine) * rowHeight + intoLine);
+	return true;
+}
+
+std::pair<std::size_t, std::size_t> fxed::TextEditorPane::getRowsInView() const {
+	float rowHeight = 1.2f;
+	float top		= -renderState.translation.y;
+	float bottom	= top + renderState.viewportSize.y / textRenderer.getFontSize();
+	return {(std::size_t)std::max(std::floor(top / rowHeight) - 1, 0.f),
+			(std::size_t)std::max(std::ceil(bottom / rowHeight) + 1, 0.f)};
+}
+
+float fxed::TextEditorPane::getTextHeight() const {
+	// down to the baseline of the last row, the mesh only has the rows around the view
+	return rows.getRowCount() > 0 ? (rows.getRowCount() - 1) * 1.2f : 0.f;
+}
+
+void fxed::TextEditorPane::rebuildMesh() {
+	auto &font		= textRenderer.getFont();
+	float lineWidth = wordWrap ? getWidth() : 0;
+	keepTopLine([&]() { return rows.update(editor, font, lineWidth, textRenderer.getVersion()); });
+
+	auto [firstRow, lastRow] = getRowsInView();
+	std::size_t screenRows	 = lastRow - firstRow;
+	std::size_t firstLine	 = rows.rowToLine(firstRow - std::min(firstRow, screenRows));
+	std::size_t lastLine	 = std::min(rows.rowToLine(lastRow + screenRows) + 1, editor.getLineCount());
+	keepTopLine([&]() { return rows.measure(editor, firstLine, lastLine, font); });
+	meshFirstRow = rows.lineToRow(firstLine);
+	meshLastRow	 = rows.lineToRow(lastLine);
+
+	this->text.clear();
+	for (std::size_t line = firstLine; line < lastLine; ++line) {
+		if (line > firstLine) this->text.push_back(U'\n');
+		this->text.append(editor.getLine(line));
+	}
+	cursorPos = editor.getCursorPos();
+	textMesh.updateText(std::span<const char32_t>{this->text.begin(), this->text.end()}, font, cursorPos, lineWidth,
+						[&](std::size_t line, std::size_t column, glm::vec2) {
+							return fxed::getTokenColor(highlighter.getToken(line, column));
+						},
+						firstLine, meshFirstRow);
+}
 
 void fxed::TextEditorPane::render(nri::CommandBuffer &cmdBuf) {
-	glm::vec2 &cursorRealPos = renderState.cursorPos;
-	textRenderer.getFont().syncWithGPU();
-	// TODO: this is hacky
-	if (editor.hasTextChanged() || editor.hasCursorMoved() || textRenderer.getVersion() != textRendererVersion) {
-		auto &&text	  = editor.getTextRange();
-		cursorPos	  = editor.getCursorPos();
-		cursorRealPos = textMesh.updateText(text, textRenderer.getFont(), cursorPos, wordWrap ? getWidth() : 0);
-		this->text.clear();
-		std::ranges::copy(text, std::back_inserter(this->text));
-		editor.resetTextChanged();
-		textRendererVersion = textRenderer.getVersion();
+	auto &font = textRenderer.getFont();
+	font.syncWithGPU();
+	flushEdits();
+	bool highlightChanged = highlighter.poll();
+	if (editor.hasTextChanged()) search.restart();
+	bool rowsChanged = keepTopLine([&]() {
+		return rows.update(editor, font, wordWrap ? getWidth() : 0, textRenderer.getVersion());
+	});
+	// a few milliseconds of searching per frame, matches appear while it runs
+	search.step(editor, std::chrono::milliseconds(2));
+	// replacing needs every match, it waits for the search instead of finishing it in one frame
+	if (replacePending && search.isDone()) {
+		replacePending = false;
+		replaceAll();
 	}
 
+	cursorPos = editor.getCursorPos();
 	if (editor.hasCursorMoved()) {
-		glm::vec2 screenBounds = glm::vec2(renderState.viewportSize) / textRenderer.getFontSize();
+		// the lines between the view and the cursor get their exact rows before scrolling to it
+		auto [firstRow, lastRow] = getRowsInView();
+		std::size_t line		 = cursorPos.y;
+		keepTopLine([&]() {
+			return rows.measure(editor, line - std::min(line, lastRow - firstRow), line + lastRow - firstRow, font);
+		});
+		glm::vec2 cursorRealPos = rows.getColumnPosition(editor.getLine(line), line, cursorPos.x, font);
+		glm::vec2 screenBounds	= glm::vec2(renderState.viewportSize) / textRenderer.getFontSize();
 		// clamp translation to prevent moving text out of screen
 		renderState.translation.x =
 			std::clamp<float>(renderState.translation.x, -cursorRealPos.x, screenBounds.x - cursorRealPos.x - 0.5);
@@ -186,67 +258,566 @@ void fxed::TextEditorPane::render(nri::CommandBuffer &cmdBuf) {
 			std::clamp<float>(renderState.translation.y, -cursorRealPos.y + 1, screenBounds.y - cursorRealPos.y - 1);
 	}
 
+	// only the rows around the view are laid out, scrolling past them lays out the next ones
+	auto [firstRow, lastRow] = getRowsInView();
+	bool outsideMesh		 = firstRow < meshFirstRow || std::min(lastRow, rows.getRowCount()) > meshLastRow;
+	if (editor.hasTextChanged() || highlightChanged || rowsChanged || outsideMesh ||
+		textRenderer.getVersion() != textRendererVersion) {
+		rebuildMesh();
+		editor.resetTextChanged();
+		textRendererVersion = textRenderer.getVersion();
+	}
+	renderState.cursorPos = rows.getColumnPosition(editor.getLine(cursorPos.y), cursorPos.y, cursorPos.x, font);
+
 	auto time =
 		std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch())
 			.count() /
 		1000.f;
 	renderState.showCursor = editor.milisecondsSinceLastMove() < 200 || (time - int64_t(time)) < 0.5;
+	updateHighlights();
 	TextPane::render(cmdBuf);
+	if (findActive || goToActive) renderFindBar();
 
 	editor.resetCursorMoved();
 }
 
+void fxed::TextEditorPane::flushEdits() {
+	// edits go to the highlighter and the rows right away, the highlighter's results only recolor the text when they
+	// arrive
+	if (auto edit = editor.takeLineEdit()) {
+		highlighter.update(editor, *edit);
+		rows.edit(editor, *edit, textRenderer.getFont());
+		onEdit(*edit);
+	}
+}
+
+void fxed::TextEditorPane::updateHighlights() {
+	highlights.clear();
+	renderState.highlights	 = {};
+	const auto &extraCursors = editor.getExtraCursors();
+	if (!findActive && extraCursors.empty()) return;
+
+	// only the matches and cursors on lines in view
+	auto [firstRow, lastRow] = getRowsInView();
+	std::size_t firstLine	 = rows.rowToLine(firstRow);
+	std::size_t lastLine	 = rows.rowToLine(lastRow) + 1;
+
+	if (findActive) {
+		for (const auto &match : search.getMatches(firstLine, lastLine)) {
+			textMesh.addHighlights(editor.getLine(match.line), match.line, match.column, match.column + match.length,
+								   textRenderer.getFont(), glm::vec4(0.9f, 0.7f, 0.2f, 0.35f), highlights);
+		}
+	}
+	// the other cursors are thin bars
+	auto cursor = std::ranges::lower_bound(extraCursors, (int32_t)firstLine, {}, [](glm::ivec2 c) { return c.y; });
+	for (; cursor != extraCursors.end() && cursor->y < (int32_t)lastLine; ++cursor) {
+		glm::vec2 position =
+			textMesh.getColumnPosition(editor.getLine(cursor->y), cursor->y, cursor->x, textRenderer.getFont());
+		highlights.push_back({position, 0.1f, glm::vec4(0.9f, 0.9f, 0.9f, 0.8f)});
+	}
+	renderState.highlights = highlights;
+}
+
+void fxed::TextEditorPane::addCursor(int dy) {
+	// on the line past the outermost cursor in that direction, in the column of the main one
+	std::vector<glm::ivec2> cursors = editor.getExtraCursors();
+	glm::ivec2				main	= editor.getCursorPos();
+	int						edge	= main.y;
+	if (!cursors.empty()) edge = dy < 0 ? std::min(edge, cursors.front().y) : std::max(edge, cursors.back().y);
+	if (edge + dy < 0 || edge + dy >= (int)editor.getLineCount()) return;
+	cursors.push_back({main.x, edge + dy});
+	editor.setExtraCursors(std::move(cursors));
+}
+
+void fxed::TextEditorPane::renderFindBar() {
+	std::u32string text;
+	if (goToActive) {
+		text			 = U"Go to line: " + goToQuery + U"_  ";
+		std::string hint = std::format("line:column or #offset, {} lines", editor.getLineCount());
+		std::ranges::copy(hint | fxed::to_utf32, std::back_inserter(text));
+	} else {
+		// with both fields shown, a _ marks the one typing goes to
+		text = U"Find: " + search.getQuery();
+		if (replaceActive && !replaceFocused) text += U'_';
+		text += U"  ";
+		std::string status = search.getError();
+		if (status.empty()) {
+			status = std::to_string(search.getMatches().size()) + (search.isDone() ? " matches" : "+ matches");
+		}
+		if (search.isRegex()) status += " (regex)";
+		if (replacePending) status += ", replacing when done";
+		std::ranges::copy(status | fxed::to_utf32, std::back_inserter(text));
+		if (replaceActive) text += U"  Replace: " + replacement + (replaceFocused ? U"_" : U"");
+	}
+	if (text != findBarText || textRenderer.getVersion() != textRendererVersion) {
+		findBarText = std::move(text);
+		findBarMesh.updateText(std::u32string_view(findBarText), textRenderer.getFont(), {0, 0}, 0,
+							   [](std::size_t, std::size_t, glm::vec2) { return glm::vec4(1.f); });
+	}
+
+	// one row along the bottom of the pane, on top of the text
+	float fontSize = textRenderer.getFontSize();
+	int	  height   = (int)std::ceil(fontSize * 1.4f);
+
+	fxed::TextHighlight background{glm::vec2(-0.5f, 0.f), size.x / fontSize + 1, glm::vec4(0.15f, 0.15f, 0.2f, 1.f)};
+	TextRenderState		barState;
+	barState.translation	  = {0.5f, 1.f};
+	barState.viewportSize	  = {size.x, height};
+	barState.viewportPosition = position + glm::ivec2(0, size.y - height);
+	barState.showCursor		  = false;
+	barState.highlights		  = std::span(&background, 1);
+	textRenderer.queueText(findBarMesh, barState);
+}
+
+void fxed::TextEditorPane::jumpToMatch(bool forward) {
+	auto matches = search.getMatches();
+	if (matches.empty()) return;
+	glm::ivec2		cursor = editor.getCursorPos();
+	// ahead of every match at the cursor going forward, behind them going back
+	fxed::TextMatch here{(uint32_t)cursor.y, (uint32_t)cursor.x, forward ? UINT32_MAX : 0};
+
+	const fxed::TextMatch *target;
+	if (forward) {
+		auto next = std::ranges::upper_bound(matches, here);
+		target	  = next != matches.end() ? &*next : &matches.front();
+	} else {
+		auto previous = std::ranges::lower_bound(matches, here);
+		target		  = previous != matches.begin() ? &*(previous - 1) : &matches.back();
+	}
+	editor.setCursor(glm::ivec2(target->column, target->line));
+}
+
+void fxed::TextEditorPane::replaceAll() {
+	assert(search.isDone() && "replaceAll needs every match");
+	std::vector<uint32_t>		lineNumbers;
+	std::vector<std::u32string> newLines;
+	auto						matches = search.getMatches();
+	for (std::size_t i = 0; i < matches.size();) {
+		uint32_t			  line	  = matches[i].line;
+		const std::u32string &oldLine = editor.getLine(line);
+		std::u32string		  newLine;
+		std::size_t			  copied = 0;
+		for (; i < matches.size() && matches[i].line == line; ++i) {
+			// plain text matches can overlap, only the first of those is replaced
+			if (matches[i].column < copied) continue;
+			newLine.append(oldLine, copied, matches[i].column - copied);
+			newLine += replacement;
+			copied = matches[i].column + matches[i].length;
+		}
+		newLine.append(oldLine, copied);
+		lineNumbers.push_back(line);
+		newLines.push_back(std::move(newLine));
+	}
+	dbLog(dbg::LOG_INFO, "Replaced ", matches.size(), " matches on ", lineNumbers.size(), " lines");
+	editText().replaceLines(std::move(lineNumbers), std::move(newLines));
+}
+
+void fxed::TextEditorPane::find() {
+	findActive	   = true;
+	replaceFocused = false;
+	goToActive	   = false;
+	search.restart();
+}
+
+void fxed::TextEditorPane::replace() {
+	find();
+	replaceActive = true;
+}
+
+void fxed::TextEditorPane::goToLine() {
+	goToActive	  = true;
+	findActive	  = false;
+	replaceActive = false;
+	goToQuery.clear();
+}
+
+void fxed::TextEditorPane::goToQueryPosition() {
+	std::string query;
+	std::ranges::copy(goToQuery | fxed::to_utf8, std::back_inserter(query));
+	bool		isOffset = query.starts_with('#');
+	const char *end		 = query.data() + query.size();
+	uint64_t	number	 = 0;
+	uint64_t	column	 = 1;
+	auto [next, error]	 = std::from_chars(query.data() + isOffset, end, number);
+	if (error != std::errc()) return;
+	if (isOffset) {
+		// an offset in code points from the start of the text, as the line index counts them
+		std::size_t line = editor.offsetToLine(number);
+		number			 = std::min(number - std::min(number, editor.lineToOffset(line)), (uint64_t)INT32_MAX);
+		editor.setCursor(glm::ivec2(number, line));
+		return;
+	}
+	// lines and columns are counted from 1, like compilers report them
+	if (next != end && *next == ':') std::from_chars(next + 1, end, column);
+	number = std::clamp<uint64_t>(number, 1, INT32_MAX);
+	column = std::clamp<uint64_t>(column, 1, INT32_MAX);
+	editor.setCursor(glm::ivec2(column - 1, number - 1));
+}
+
+void fxed::TextEditorPane::mouseClick(fxed::Mouse &mouse, int button, int action, int mods) {
+	TextPane::mouseClick(mouse, button, action, mods);
+	if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS) return;
+	// from window pixels to em in the text, the inverse of where TextPane::render draws it
+	float	  fontSize = textRenderer.getFontSize();
+	glm::vec2 pixel	   = glm::vec2(mouse.getPosition()) - glm::vec2(position) - (float)borderSize;
+	glm::vec2 point	   = pixel / fontSize - renderState.translation;
+	// a row holds the text from 0.9 em above its baseline to 0.3 em below
+	float		rowHeight = 1.2f;
+	std::size_t row		  = (std::size_t)std::max(std::floor(point.y / rowHeight + 0.75f), 0.f);
+	std::size_t line	  = std::min(rows.rowToLine(row), editor.getLineCount() - 1);
+	std::size_t column	  = textMesh.getColumnAt(editor.getLine(line), line, row, point.x, textRenderer.getFont());
+	editor.setExtraCursors({});
+	editor.setCursor(glm::ivec2(column, line));
+}
+
 void fxed::TextEditorPane::charInput(unsigned int codepoint) {
 	TextPane::charInput(codepoint);
-	editor.insertChar(codepoint);
+	if (findActive || goToActive) {
+		textInput(std::u32string(1, (char32_t)codepoint));
+		return;
+	}
+	editText().insertChar(codepoint);
+}
+
+void fxed::TextEditorPane::textInput(std::u32string_view text) {
+	if (goToActive) {
+		goToQuery += text;
+		return;
+	}
+	// a replace still waiting for the search is dropped when either field changes
+	if (findActive) replacePending = false;
+	if (findActive && replaceFocused) {
+		replacement += text;
+		return;
+	}
+	if (findActive) {
+		search.setQuery(search.getQuery() + std::u32string(text), search.isRegex());
+		return;
+	}
+	editText().insertText(text);
 }
 
 void fxed::TextEditorPane::keyInput(int key, int scancode, int action, int mods) {
 	TextPane::keyInput(key, scancode, action, mods);
+	if (goToActive && (action == GLFW_PRESS || action == GLFW_REPEAT)) {
+		switch (key) {
+			case GLFW_KEY_ESCAPE: goToActive = false; return;
+			case GLFW_KEY_ENTER:
+				goToQueryPosition();
+				goToActive = false;
+				return;
+			case GLFW_KEY_BACKSPACE:
+				if (!goToQuery.empty()) goToQuery.pop_back();
+				return;
+			// the line number is typed into the bar, no other key edits the text or moves the cursor under it
+			default: return;
+		}
+	}
+	if (findActive && (action == GLFW_PRESS || action == GLFW_REPEAT)) {
+		switch (key) {
+			case GLFW_KEY_ESCAPE:
+				findActive	   = false;
+				replaceActive  = false;
+				replacePending = false;
+				search.setQuery({}, search.isRegex());
+				return;
+			case GLFW_KEY_ENTER:
+				if (replaceFocused) replacePending = true;
+				else jumpToMatch(!(mods & GLFW_MOD_SHIFT));
+				return;
+			case GLFW_KEY_TAB: replaceFocused = replaceActive && !replaceFocused; return;
+			case GLFW_KEY_R:
+				// alt + r switches between plain text and regular expressions
+				if (mods & GLFW_MOD_ALT) {
+					search.setQuery(search.getQuery(), !search.isRegex());
+					replacePending = false;
+				}
+				return;
+			case GLFW_KEY_BACKSPACE: {
+				replacePending = false;
+				if (replaceFocused) {
+					if (!replacement.empty()) replacement.pop_back();
+					return;
+				}
+				std::u32string query = search.getQuery();
+				if (!query.empty()) query.pop_back();
+				search.setQuery(query, search.isRegex());
+				return;
+			}
+			default: break;
+		}
+	}
 	if (action == GLFW_PRESS || action == GLFW_REPEAT) {
 		switch (key) {
-			case GLFW_KEY_BACKSPACE: this->editor.deleteChar(); break;
-			case GLFW_KEY_ENTER: this->editor.insertChar('\n'); break;
-			case GLFW_KEY_TAB: this->editor.insertChar('\t'); break;
+			case GLFW_KEY_BACKSPACE: editText().deleteChar(); break;
+			case GLFW_KEY_ENTER: editText().insertChar('\n'); break;
+			case GLFW_KEY_TAB: editText().insertChar('\t'); break;
 			case GLFW_KEY_LEFT: this->editor.moveCursor(-1, 0); break;
 			case GLFW_KEY_RIGHT: this->editor.moveCursor(1, 0); break;
-			case GLFW_KEY_UP: this->editor.moveCursor(0, -1); break;
-			case GLFW_KEY_DOWN: this->editor.moveCursor(0, 1); break;
+			case GLFW_KEY_UP:
+			case GLFW_KEY_DOWN: {
+				int dy = key == GLFW_KEY_UP ? -1 : 1;
+				// ctrl + alt + up/down adds a cursor above or below
+				if ((mods & GLFW_MOD_CONTROL) && (mods & GLFW_MOD_ALT)) addCursor(dy);
+				else this->editor.moveCursor(0, dy);
+				break;
+			}
+			case GLFW_KEY_ESCAPE: this->editor.setExtraCursors({}); break;
 			default: break;
 		}
 	}
 }
 
-void fxed::TextEditorPane::undo() { editor.undo(); }
-void fxed::TextEditorPane::redo() { editor.redo(); }
+void fxed::TextEditorPane::undo() { editText().undo(); }
+void fxed::TextEditorPane::redo() { editText().redo(); }
 
 fxed::FileTextEditorPane::FileTextEditorPane(nri::NRI &nri, nri::CommandQueue &queue, uint32_t width, uint32_t height,
-											 TextRenderer &textRenderer, const std::filesystem::path &filePath)
+											 TextRenderer &textRenderer, const std::filesystem::path &filePath,
+											 bool lazy)
 	: TextEditorPane(nri, queue, width, height, textRenderer), filePath(filePath) {
-	std::ifstream file(filePath);
-	if (file.is_open()) {
+	highlighter.setLanguage(getLanguageForFile(filePath));
+	if (lazy) updateName();
+	else load();
+}
+
+void fxed::FileTextEditorPane::load() {
+	if (loaded) return;
+	loaded = true;
+	std::error_code ec;
+	auto			size = std::filesystem::file_size(filePath, ec);
+	if (!ec && size > largeFileSize) {
+		largeFile = std::make_unique<fxed::LargeFile>(filePath);
+		wordWrap  = false;
+		dbLog(dbg::LOG_INFO, "Opened large file read-only: ", filePath);
+	} else if (std::ifstream file(filePath); file.is_open()) {
 		this->getEditor() = DefaultTextEditor(std::ranges::istream_view<fxed::RawChar>(file) | fxed::to_utf32);
 		updateText(std::ranges::istream_view<fxed::RawChar>(file) | fxed::to_utf32);
 	} else {
 		dbLog(dbg::LOG_ERROR, "Failed to open file: ", filePath);
 	}
+	if (pendingView) setView(*std::exchange(pendingView, std::nullopt));
+	updateName();
+}
+
+void fxed::FileTextEditorPane::tabActivated() { load(); }
+
+fxed::FileTextEditorPane::View fxed::FileTextEditorPane::getView() const {
+	if (!loaded) return pendingView.value_or(View{});
+	return {largeFile ? glm::ivec2(0, 0) : editor.getCursorPos(), renderState.translation};
+}
+
+void fxed::FileTextEditorPane::setView(const View &view) {
+	if (!loaded) {
+		pendingView = view;
+		return;
+	}
+	renderState.translation = view.translation;
+	// the file may have changed since the view was kept, setCursor clamps the cursor to it
+	if (!largeFile) editor.setCursor(view.cursor);
+}
+
+fxed::FileTextEditorPane::~FileTextEditorPane() {
+	// the rest of the text is copied while the editor is still there, FileSave waits for the write
+	save.finishCopy(editor);
+}
+
+const std::filesystem::path &fxed::FileTextEditorPane::getFilePath() const { return filePath; }
+
+void fxed::FileTextEditorPane::updateName() {
 	this->name.clear();
 	std::ranges::copy(fxed::getIconForFile(filePath) | fxed::to_utf32, std::back_inserter(this->name));
 	std::ranges::copy(filePath.filename().string() | fxed::to_utf32, std::back_inserter(this->name));
+	if (largeFile) this->name += U" (read-only)";
+	if (recovered) this->name += U" (recovered)";
+	if (save.isSaving()) {
+		this->name += U" (saving)";
+	} else if (!saveError.empty()) {
+		this->name += U" (save failed: ";
+		std::ranges::copy(saveError | fxed::to_utf32, std::back_inserter(this->name));
+		this->name += U")";
+	}
+	Editor::getInstance().getTabsPane().invalidateHeaders();
 }
 
-const std::filesystem::path &fxed::FileTextEditorPane::getFilePath() const { return filePath; }
-
 void fxed::FileTextEditorPane::saveToFile() {
-	std::ofstream file(filePath);
-	if (file.is_open()) {
-		std::ranges::copy(editor.getTextRange() | fxed::to_utf8, std::ostream_iterator<char>(file));
-		dbLog(dbg::LOG_INFO, "Saved file: ", filePath);
+	// a restored tab that was never shown has no edits, its file already holds the text
+	if (!loaded) return;
+	if (largeFile) {
+		dbLog(dbg::LOG_WARNING, "Not saving read-only file: ", filePath);
+		return;
+	}
+	// one save at a time, the next one starts when it is done and takes the text as it is then
+	if (save.isSaving()) {
+		saveAgain = true;
+		return;
+	}
+	// the journal is reset when the save is done, so it must have the edits made since the last frame first
+	flushEdits();
+	save.start(editor, filePath, syncOnSave);
+	editedWhileSaving = false;
+	updateName();
+}
+
+void fxed::FileTextEditorPane::finishSave(std::error_code error) {
+	// edits made this frame were made while the file was written
+	flushEdits();
+	if (error) {
+		saveError = error.message();
+		dbLog(dbg::LOG_ERROR, "Failed to save ", filePath, ": ", saveError);
 	} else {
-		dbLog(dbg::LOG_ERROR, "Failed to open file for writing: ", filePath);
+		saveError.clear();
+		recovered = false;
+		// the journal keeps edits made while the file was written, over the whole text as the file no longer has it
+		if (journal && editedWhileSaving) journal->snapshot(editor);
+		else if (journal) journal->saved(editor);
+		dbLog(dbg::LOG_INFO, "Saved file: ", filePath);
+	}
+	updateName();
+	if (std::exchange(saveAgain, false)) saveToFile();
+}
+
+void fxed::FileTextEditorPane::restore(std::u32string_view text) {
+	editor = DefaultTextEditor(text);
+	// the next flushEdits starts a journal with the whole text
+	journal.reset();
+	recovered = true;
+	loaded	  = true;
+	updateName();
+}
+
+void fxed::FileTextEditorPane::onEdit(const LineEdit &edit) {
+	editedWhileSaving = editedWhileSaving || save.isSaving();
+	if (journal) return journal->record(editor, edit);
+	if (!recovered && !editor.canUndo()) {
+		// the text read from the file, or edits to it already undone, there is nothing to recover yet
+		fileTextFlushed = true;
+		return;
+	}
+	// the journal starts with the first edit, from the text as it was before it
+	journal = std::make_unique<fxed::EditJournal>(filePath, editor.getLineCount() + edit.removed - edit.inserted);
+	// A recovered text is not on the disk, and an edit flushed together with the text read from the file covers all
+	// of it. The journal needs the whole text then.
+	if (recovered || !fileTextFlushed) journal->snapshot(editor);
+	else journal->record(editor, edit);
+}
+
+float fxed::FileTextEditorPane::getTextHeight() const {
+	if (!largeFile) return TextEditorPane::getTextHeight();
+	return (largeFile->getLineCount() - 1) * 1.2f;
+}
+
+void fxed::FileTextEditorPane::rebuildMesh() {
+	if (!largeFile) return TextEditorPane::rebuildMesh();
+	// lines are not wrapped, so rows are lines and only the ones around the view are read from the file
+	auto [firstRow, lastRow] = getRowsInView();
+	std::size_t screenRows	 = lastRow - firstRow;
+	std::size_t lineCount	 = largeFile->getLineCount();
+	meshFirstRow			 = std::min(firstRow - std::min(firstRow, screenRows), lineCount);
+	meshLastRow				 = std::min(lastRow + screenRows, lineCount);
+
+	this->text.clear();
+	for (std::size_t line = meshFirstRow; line < meshLastRow; ++line) {
+		if (line > meshFirstRow) this->text.push_back(U'\n');
+		this->text.append(largeFile->getLine(line));
+	}
+	textMesh.updateText(
+		std::span<const char32_t>{this->text.begin(), this->text.end()}, textRenderer.getFont(), cursorPos, 0,
+		[](std::size_t, std::size_t, glm::vec2) { return fxed::getTokenColor(fxed::TokenKind::TEXT); }, meshFirstRow,
+		meshFirstRow);
+}
+
+void fxed::FileTextEditorPane::update() {
+	if (largeFile) return;
+	// a slice of the lines is copied for a save every frame, the file is written once all of them are
+	save.copy(editor, std::chrono::milliseconds(2));
+	if (auto error = save.poll()) finishSave(*error);
+}
+
+void fxed::FileTextEditorPane::render(nri::CommandBuffer &cmdBuf) {
+	// a restored tab reads its file when it is first drawn, however it came to the front
+	load();
+	if (!largeFile) return TextEditorPane::render(cmdBuf);
+	textRenderer.getFont().syncWithGPU();
+	// like tail -f, a view that shows the last line keeps showing it as lines are appended
+	float screenHeight = renderState.viewportSize.y / textRenderer.getFontSize();
+	bool  following	   = getTextHeight() + renderState.translation.y < screenHeight;
+	bool  changed	   = largeFile->update();
+	if (changed && following) {
+		renderState.translation.y = std::min(renderState.translation.y, screenHeight - getTextHeight() - 1);
+	}
+
+	auto [firstRow, lastRow] = getRowsInView();
+	bool outsideMesh		 = firstRow < meshFirstRow || std::min(lastRow, largeFile->getLineCount()) > meshLastRow;
+	if (changed || outsideMesh || textRenderer.getVersion() != textRendererVersion) {
+		rebuildMesh();
+		textRendererVersion = textRenderer.getVersion();
+	}
+	renderState.showCursor = false;
+	renderState.highlights = {};
+	TextPane::render(cmdBuf);
+}
+
+// the text a save is still copying must not change, the copy finishes before any edit
+void fxed::FileTextEditorPane::beforeEdit() { save.finishCopy(editor); }
+
+// Input can come before the first frame of a restored tab, which reads the file first.
+void fxed::FileTextEditorPane::charInput(unsigned int codepoint) {
+	load();
+	if (largeFile) return;
+	TextEditorPane::charInput(codepoint);
+}
+
+void fxed::FileTextEditorPane::textInput(std::u32string_view text) {
+	load();
+	if (largeFile) return;
+	TextEditorPane::textInput(text);
+}
+
+void fxed::FileTextEditorPane::keyInput(int key, int scancode, int action, int mods) {
+	load();
+	if (!largeFile) return TextEditorPane::keyInput(key, scancode, action, mods);
+	TextPane::keyInput(key, scancode, action, mods);
+	if (action != GLFW_PRESS && action != GLFW_REPEAT) return;
+	// nothing to edit, the keys only scroll
+	float rowHeight	   = 1.2f;
+	float screenHeight = renderState.viewportSize.y / textRenderer.getFontSize();
+	switch (key) {
+		case GLFW_KEY_UP: renderState.translation.y += rowHeight; break;
+		case GLFW_KEY_DOWN: renderState.translation.y -= rowHeight; break;
+		case GLFW_KEY_PAGE_UP: renderState.translation.y += screenHeight; break;
+		case GLFW_KEY_PAGE_DOWN: renderState.translation.y -= screenHeight; break;
+		case GLFW_KEY_HOME: renderState.translation.y = 1.f; break;
+		// the last line at the bottom, where the view follows appended lines
+		case GLFW_KEY_END: renderState.translation.y = screenHeight - getTextHeight() - 1; break;
+		default: break;
 	}
 }
 
+void fxed::FileTextEditorPane::undo() {
+	load();
+	TextEditorPane::undo();
+}
+
+void fxed::FileTextEditorPane::redo() {
+	load();
+	TextEditorPane::redo();
+}
+
+void fxed::FileTextEditorPane::find() {
+	load();
+	if (!largeFile) TextEditorPane::find();
+}
+
+void fxed::FileTextEditorPane::replace() {
+	load();
+	if (!largeFile) TextEditorPane::replace();
+}
+
+void fxed::FileTextEditorPane::goToLine() {
+	load();
+	if (!largeFile) TextEditorPane::goToLine();
+}
+
 fxed::SplitPane::SplitPane(nri::NRI &nri, nri::CommandQueue &queue, uint32_t width, uint32_t height, bool isVertical,
 						   float splitRatio)
 	: Pane(nri, queue, width, height), isVertical(isVertical), splitRatio(splitRatio) {
@@ -368,10 +939,42 @@ std::shared_ptr<fxed::Pane> &fxed::SplitPane::getChild(int index) {
 	}
 }
 
+// line spacing of TextMeshInstanced, in font size units
+static constexpr float fileTreeRowSpacing = 1.2f;
+
 void fxed::FileTreePane::refreshListing() {
-	std::stringstream ss;
-	fileTree.print(ss);
-	updateText(std::ranges::istream_view<fxed::RawChar>(ss) | fxed::to_utf32);
+	// only the rows that fit in the pane are laid out, the size of the tree does not matter
+	const auto &rows  = fileTree.getRows();
+	int			first = std::clamp<int>(std::floor(-renderState.translation.y / fileTreeRowSpacing), 0,
+										std::max<int>(rows.size() - 1, 0));
+	int			count = std::ceil(size.y / textRenderer.getFontSize() / fileTreeRowSpacing) + 2;
+	int			end	  = std::min<int>(rows.size(), first + count);
+
+	// the rows laid out before that are still in view and did not change keep their text
+	std::size_t changed	  = fileTree.takeChangedRow();
+	int			keepBegin = std::max(first, firstVisibleRow);
+	int			keepEnd	  = std::min<std::size_t>({std::size_t(end), firstVisibleRow + rowTexts.size(), changed});
+	if (first == firstVisibleRow && end - first == (int)rowTexts.size() && keepEnd >= end) return;
+
+	std::vector<std::u32string> texts;
+	texts.reserve(end - first);
+	for (int i = first; i < end; ++i) {
+		if (i >= keepBegin && i < keepEnd) {
+			texts.push_back(std::move(rowTexts[i - firstVisibleRow]));
+		} else {
+			texts.emplace_back();
+			FileTree::appendRowText(rows[i], texts.back());
+		}
+	}
+	rowTexts		= std::move(texts);
+	firstVisibleRow = first;
+
+	text.clear();
+	for (const auto &rowText : rowTexts) {
+		text += rowText;
+		text += U'\n';
+	}
+	updateText(text);
 }
 
 fxed::FileTreePane::FileTreePane(nri::NRI &nri, nri::CommandQueue &queue, uint32_t width, uint32_t height,
@@ -379,21 +982,61 @@ fxed::FileTreePane::FileTreePane(nri::NRI &nri, nri::CommandQueue &queue, uint32
 	: TextPane(nri, queue, width, height, textRenderer),
 	  currentPath(std::filesystem::current_path()),
 	  fileTree(currentPath),
-	  selectedRow(1),
-	  selectedIt(fileTree.begin()) {
-	refreshListing();
+	  selectedRow(1) {
 	renderState.showCursor = false;
 	this->wordWrap		   = false;
 	this->name			   = U"FileTree";
+	refreshListing();
+}
+
+void fxed::FileTreePane::selectRow(int row) {
+	selectedRow					= row;
+	this->renderState.cursorPos = glm::vec2(0, selectedRow);
+}
+
+void fxed::FileTreePane::activateRow(int row) {
+	auto &node = *fileTree.getRows()[row].node;
+	if (node.isDirectory()) {
+		fileTree.toggleOpen(row);
+	} else {
+		std::filesystem::path filePath = currentPath / node.path;
+		dbLog(dbg::LOG_INFO, "Selected file: ", filePath);
+		Editor::getInstance().openFile(filePath);
+	}
 }
 
 void fxed::FileTreePane::render(nri::CommandBuffer &cmdBuf) {
-	TextPane::render(cmdBuf);
+	const auto &rows = fileTree.getRows();
+	if (fileTree.update()) {
+		// entries may have appeared or disappeared above the selection, keep it on the same row
+		selectRow(std::clamp<int>(selectedRow, 1, std::max<int>(rows.size() - 1, 1)));
+	}
+
+	// don't allow scrolling up before the first row or past the last one
+	renderState.translation.y = std::min(renderState.translation.y, 1.f);
+	renderState.translation.y = std::max(renderState.translation.y, -(rows.size() - 1.f) * fileTreeRowSpacing + 1);
+	renderState.translation.x = std::min(renderState.translation.x, 0.f);
+
+	refreshListing();
+	if (textRenderer.getVersion() != textRendererVersion) {
+		updateText(text);
+		textRendererVersion = textRenderer.getVersion();
+	}
+
+	Pane::render(cmdBuf);
+	TextRenderState currentRenderState = renderState;
+	currentRenderState.translation += (borderSize) / textRenderer.getFontSize();
+	currentRenderState.translation.y += firstVisibleRow * fileTreeRowSpacing;
+	currentRenderState.viewportPosition = position;
+	textRenderer.queueText(textMesh, currentRenderState);
+	// the selection below is drawn over the rows, as it was before text was batched
+	textRenderer.flush(cmdBuf);
+
 	// draw a highlight behind the selected row
 	auto &backgroundShader = fxed::ResourceManager::getInstance().getShader(backgroundShaderID);
 	auto &backgroundMesh   = fxed::ResourceManager::getInstance().getMesh(backgroundMeshID);
 
-	float		  rowHeight = textRenderer.getFontSize() * 1.2f;
+	float		  rowHeight = textRenderer.getFontSize() * fileTreeRowSpacing;
 	PushConstants pushConstants{.color0		  = glm::vec3(0.2f, 0.2f, 0.2f),
 								.borderSize	  = 2,
 								.color1		  = glm::vec3(1.0f, 1.0f, 1.0f),
@@ -417,78 +1060,28 @@ void fxed::FileTreePane::mouseClick(fxed::Mouse &mouse, int button, int action,
 	auto position = mouse.getPosition();
 	position -= this->position;
 	position.y -= (renderState.translation.y - 1) * textRenderer.getFontSize();		// adjust for scrolling
-	float rowHeight	 = textRenderer.getFontSize() * 1.2f;
+	float rowHeight	 = textRenderer.getFontSize() * fileTreeRowSpacing;
 	int	  clickedRow = position.y / rowHeight;
-	if (clickedRow > 0) {	  // TODO: check upper bound as well
-		{
-			auto oldSelectedIt	= selectedIt;
-			auto oldSelectedRow = selectedRow;
-			selectedIt			= fileTree.begin();
-			for (int i = 1; i < clickedRow && selectedIt != fileTree.end(); ++i) {
-				++selectedIt;
-			}
-			if (selectedIt == fileTree.end()) {		// revert to old selection if we clicked out of bounds
-				selectedIt	= oldSelectedIt;
-				selectedRow = oldSelectedRow;
-				return;
-			} else {
-				selectedRow = clickedRow;
-			}
-		}
+	if (clickedRow <= 0 || clickedRow >= (int)fileTree.getRows().size()) return;
 
-		this->renderState.cursorPos = glm::vec2(0, selectedRow);
-		if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
-			auto &node = *selectedIt;
-			if (auto *dirNode = dynamic_cast<fxed::FileTree::DirectoryNode *>(&node)) {
-				dirNode->toggleOpen();
-				refreshListing();
-			} else if (auto *fileNode = dynamic_cast<fxed::FileTree::FileNode *>(&node)) {
-				std::filesystem::path filePath = currentPath / fileNode->path;
-				dbLog(dbg::LOG_INFO, "Selected file: ", filePath);
-				Editor::getInstance().openFile(filePath);
-			}
-		}
-	}
+	selectRow(clickedRow);
+	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) { activateRow(selectedRow); }
 }
 
 void fxed::FileTreePane::keyInput(int key, int scancode, int action, int mods) {
 	Pane::keyInput(key, scancode, action, mods);
+	if (fileTree.empty()) return;	  // still listing
 	if (action == GLFW_PRESS || action == GLFW_REPEAT) {
 		if (key == GLFW_KEY_DOWN) {
-			if (!selectedIt.isBack()) {
-				++selectedIt;
-				++selectedRow;
-				this->renderState.cursorPos = glm::vec2(0, selectedRow);
-			}
+			if (selectedRow + 1 < (int)fileTree.getRows().size()) selectRow(selectedRow + 1);
 		} else if (key == GLFW_KEY_UP) {
-			if (!selectedIt.isBegin()) {
-				--selectedIt;
-				--selectedRow;
-				this->renderState.cursorPos = glm::vec2(0, selectedRow);
-			}
+			if (selectedRow > 1) selectRow(selectedRow - 1);
 		} else if (key == GLFW_KEY_ENTER) {
-			auto &node = *selectedIt;
-			if (auto *dirNode = dynamic_cast<fxed::FileTree::DirectoryNode *>(&node)) {
-				dirNode->toggleOpen();
-				refreshListing();
-			} else if (auto *fileNode = dynamic_cast<fxed::FileTree::FileNode *>(&node)) {
-				if (key != GLFW_KEY_ENTER) return;
-				std::filesystem::path filePath = currentPath / fileNode->path;
-				dbLog(dbg::LOG_INFO, "Selected file: ", filePath);
-				Editor::getInstance().openFile(filePath);
-			}
+			activateRow(selectedRow);
 		} else if (key == GLFW_KEY_RIGHT) {
-			auto &node = *selectedIt;
-			if (auto *dirNode = dynamic_cast<fxed::FileTree::DirectoryNode *>(&node)) {
-				dirNode->setOpen(true);
-				refreshListing();
-			}
+			fileTree.setOpen(selectedRow, true);
 		} else if (key == GLFW_KEY_LEFT) {
-			auto &node = *selectedIt;
-			if (auto *dirNode = dynamic_cast<fxed::FileTree::DirectoryNode *>(&node)) {
-				dirNode->setOpen(false);
-				refreshListing();
-			}
+			fileTree.setOpen(selectedRow, false);
 		}
 	}
 }
@@ -496,13 +1089,171 @@ void fxed::FileTreePane::keyInput(int key, int scancode, int action, int mods) {
 void fxed::FileTreePane::setPath(const std::filesystem::path &p) {
 	currentPath = p;
 	fileTree	= FileTree(currentPath);
-	selectedRow = 1;
-	selectedIt	= fileTree.begin();
+	selectRow(1);
 	refreshListing();
 }
 
 const std::filesystem::path &fxed::FileTreePane::getPath() const { return currentPath; }
 
+void fxed::FileTreePane::openDirectories(const std::vector<std::filesystem::path> &directories) {
+	fileTree.openDirectories(directories);
+}
+
+// line spacing of TextMeshInstanced, row 0 is the header and result i is on row i + 1
+static constexpr float findInFilesRowSpacing = 1.2f;
+
+fxed::FindInFilesPane::FindInFilesPane(nri::NRI &nri, nri::CommandQueue &queue, uint32_t width, uint32_t height,
+									   TextRenderer &textRenderer, const std::filesystem::path &root)
+	: TextPane(nri, queue, width, height, textRenderer), root(root), search(std::make_shared<FileSearch>()) {
+	renderState.showCursor = false;
+	this->wordWrap		   = false;
+	this->name			   = U"Find in Files";
+}
+
+// workers still walking the folder stop at their next file, the search itself lives until they are done
+fxed::FindInFilesPane::~FindInFilesPane() { search->cancel(); }
+
+void fxed::FindInFilesPane::refreshListing() {
+	int first = std::clamp<int>(std::floor(-renderState.translation.y / findInFilesRowSpacing), 0, results.size());
+	int count = std::ceil(size.y / textRenderer.getFontSize() / findInFilesRowSpacing) + 2;
+	if (!rowsChanged && first == firstVisibleRow && count == visibleRowCount) return;
+
+	firstVisibleRow = first;
+	visibleRowCount = count;
+	rowsChanged		= false;
+
+	text.clear();
+	for (int row = first; row < std::min<int>(results.size() + 1, first + count); ++row) {
+		if (row == 0) {
+			text += header;
+		} else {
+			const auto		&match	   = results[row - 1];
+			std::string_view matchText = match.text;
+			// without the indentation
+			matchText.remove_prefix(std::min(matchText.find_first_not_of(" \t"), matchText.size()));
+
+			auto relativePath = match.path.lexically_relative(root).string();
+			auto line		  = std::format("{}:{}: {}", relativePath, match.line + 1, matchText);
+			std::ranges::copy(line | fxed::to_utf32, std::back_inserter(text));
+		}
+		text += U'\n';
+	}
+	updateText(text);
+}
+
+void fxed::FindInFilesPane::startSearch() {
+	searchedQuery = query;
+	results.clear();
+	rowsChanged = true;
+	selectResult(0);
+
+	std::string utf8Query;
+	std::ranges::copy(query | fxed::to_utf8, std::back_inserter(utf8Query));
+	search->start(root, utf8Query);
+}
+
+void fxed::FindInFilesPane::selectResult(int index) {
+	selectedResult = std::clamp<int>(index, 0, std::max<int>(results.size() - 1, 0));
+	// scroll just enough to keep the selected row in view
+	float row				  = (selectedResult + 1) * findInFilesRowSpacing;
+	float screenHeight		  = size.y / textRenderer.getFontSize();
+	renderState.translation.y = std::min(renderState.translation.y, screenHeight - row - 1);
+	renderState.translation.y = std::max(renderState.translation.y, -row + 1);
+}
+
+void fxed::FindInFilesPane::openResult(int index) {
+	if (index < 0 || index >= (int)results.size()) return;
+	const auto &match = results[index];
+	dbLog(dbg::LOG_INFO, "Opening search result: ", match.path, ":", match.line + 1);
+	if (auto *pane = Editor::getInstance().openFile(match.path)) {
+		pane->getEditor().setCursor(glm::ivec2(match.column, match.line));
+	}
+}
+
+void fxed::FindInFilesPane::render(nri::CommandBuffer &cmdBuf) {
+	// results arrive in batches from the workers, most frames there are none
+	auto finished = search->takeFinished();
+	if (!finished.empty()) {
+		std::ranges::move(finished, std::back_inserter(results));
+		rowsChanged = true;
+	}
+
+	std::string status;
+	if (!searchedQuery.empty()) {
+		status = std::format("  {}{} matches in {} files", search->getMatchCount(), search->isDone() ? "" : "+",
+							 search->getFileCount());
+	}
+	std::u32string newHeader = U"Find in ";
+	std::ranges::copy(root.string() | fxed::to_utf32, std::back_inserter(newHeader));
+	newHeader += U": " + query;
+	std::ranges::copy(status | fxed::to_utf32, std::back_inserter(newHeader));
+	if (newHeader != header) {
+		header		= std::move(newHeader);
+		rowsChanged = true;
+	}
+
+	// don't allow scrolling up before the header or past the last result
+	float lastRow			  = results.size() * findInFilesRowSpacing;
+	renderState.translation.y = std::min(renderState.translation.y, 1.f);
+	renderState.translation.y = std::max(renderState.translation.y, -lastRow + 1);
+	renderState.translation.x = std::min(renderState.translation.x, 0.f);
+
+	refreshListing();
+	if (textRenderer.getVersion() != textRendererVersion) {
+		updateText(text);
+		textRendererVersion = textRenderer.getVersion();
+	}
+
+	// the selected result gets a highlight behind its row
+	highlights.clear();
+	int selectedRow = selectedResult + 1 - firstVisibleRow;
+	if (selectedResult < (int)results.size() && selectedRow >= 0 && selectedRow < visibleRowCount) {
+		highlights.push_back({glm::vec2(-0.5f, selectedRow * findInFilesRowSpacing),
+							  size.x / textRenderer.getFontSize() + 1, glm::vec4(0.3f, 0.3f, 0.4f, 0.6f)});
+	}
+	renderState.highlights = highlights;
+
+	Pane::render(cmdBuf);
+	TextRenderState currentRenderState = renderState;
+	currentRenderState.translation += (borderSize) / textRenderer.getFontSize();
+	currentRenderState.translation.y += firstVisibleRow * findInFilesRowSpacing;
+	currentRenderState.viewportPosition = position;
+	textRenderer.queueText(textMesh, currentRenderState);
+}
+
+void fxed::FindInFilesPane::mouseClick(fxed::Mouse &mouse, int button, int action, int mods) {
+	Pane::mouseClick(mouse, button, action, mods);
+	if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS) return;
+	auto position = mouse.getPosition();
+	position -= this->position;
+	position.y -= (renderState.translation.y - 1) * textRenderer.getFontSize();	 // adjust for scrolling
+	int clickedRow = position.y / (textRenderer.getFontSize() * findInFilesRowSpacing);
+	if (clickedRow <= 0 || clickedRow > (int)results.size()) return;
+
+	selectResult(clickedRow - 1);
+	openResult(selectedResult);
+}
+
+void fxed::FindInFilesPane::charInput(unsigned int codepoint) { query += (char32_t)codepoint; }
+void fxed::FindInFilesPane::textInput(std::u32string_view text) { query += text; }
+
+void fxed::FindInFilesPane::keyInput(int key, int scancode, int action, int mods) {
+	Pane::keyInput(key, scancode, action, mods);
+	if (action != GLFW_PRESS && action != GLFW_REPEAT) return;
+	switch (key) {
+		case GLFW_KEY_BACKSPACE:
+			if (!query.empty()) query.pop_back();
+			break;
+		case GLFW_KEY_ENTER:
+			if (query == searchedQuery) openResult(selectedResult);
+			else startSearch();
+			break;
+		case GLFW_KEY_UP: selectResult(selectedResult - 1); break;
+		case GLFW_KEY_DOWN: selectResult(selectedResult + 1); break;
+		default: break;
+	}
+}
+
 void fxed::TabsPane::placeTab(std::shared_ptr<Pane> &pane) {
 	pane->setTransform(position.x, position.y + textRenderer.getFontSize() * 1.5f, size.x,
 					   size.y - textRenderer.getFontSize() * 1.5f);
@@ -510,7 +1261,7 @@ void fxed::TabsPane::placeTab(std::shared_ptr<Pane> &pane) {
 
 fxed::TabsPane::TabsPane(nri::NRI &nri, nri::CommandQueue &queue, uint32_t width, uint32_t height,
 						 TextRenderer &textRenderer)
-	: Pane(nri, queue, width, height), textRenderer(textRenderer) {
+	: Pane(nri, queue, width, height), headerMesh(16384), textRenderer(textRenderer) {
 	this->name = U"Tabs";
 }
 
@@ -524,12 +1275,42 @@ static std::u32string getTabName(const std::shared_ptr<fxed::Pane> &pane) {
 uint32_t fxed::TabsPane::addTab(std::shared_ptr<Pane> &&pane) {
 	tabs.push_back(std::move(pane));
 	setTransform(position.x, position.y, size.x, size.y);
-	tabMeshes.emplace_back(nri, queue, 100);
-	tabMeshes.back().updateText(getTabName(tabs.back()), textRenderer.getFont(), glm::ivec2(0, 0), 0);
+	headersDirty = true;
 	return tabs.size() - 1;
 }
 
+void fxed::TabsPane::updateHeaders() {
+	std::u32string names;
+	for (const auto &tab : tabs) {
+		names += getTabName(tab);
+		names += U'\n';
+	}
+	headerMesh.updateText(names, textRenderer.getFont());
+
+	tabHeaders.clear();
+	float x = 0;
+	for (size_t i = 0; i < tabs.size(); ++i) {
+		float width = headerMesh.getRowWidth(i) * textRenderer.getFontSize() + 20;
+		tabHeaders.push_back({x, width});
+		x += width;
+	}
+	headersDirty = false;
+}
+
+int fxed::TabsPane::findTabAt(float x) const {
+	auto it = std::ranges::upper_bound(tabHeaders, x, {}, &TabHeader::x);
+	if (it == tabHeaders.begin()) return -1;
+	--it;
+	if (x >= it->x + it->width) return -1;
+	return it - tabHeaders.begin();
+}
+
 void fxed::TabsPane::render(nri::CommandBuffer &cmdBuf) {
+	// saves keep going in the tabs that are not shown, and show their state in the headers drawn below
+	for (auto &tab : tabs) {
+		tab->update();
+	}
+
 	// render tab headers
 	auto &backgroundShader = fxed::ResourceManager::getInstance().getShader(backgroundShaderID);
 	auto &backgroundMesh   = fxed::ResourceManager::getInstance().getMesh(backgroundMeshID);
@@ -539,11 +1320,10 @@ void fxed::TabsPane::render(nri::CommandBuffer &cmdBuf) {
 			tab->setTransform(position.x, position.y + textRenderer.getFontSize() * 1.5f, size.x,
 							  size.y - textRenderer.getFontSize() * 1.5f);
 		}
-		for (size_t i = 0; i < tabs.size(); ++i) {
-			tabMeshes[i].updateText(getTabName(tabs[i]), textRenderer.getFont(), glm::ivec2(0, 0), 0);
-		}
+		headersDirty		= true;
 		textRendererVersion = textRenderer.getVersion();
 	}
+	if (headersDirty) updateHeaders();
 
 	float		  tabHeight = textRenderer.getFontSize() * 1.5f;
 	PushConstants pushConstants{.color0		  = glm::vec3(0.0f, 0.0f, 0.0f),
@@ -555,40 +1335,40 @@ void fxed::TabsPane::render(nri::CommandBuffer &cmdBuf) {
 	backgroundShader.bind(cmdBuf);
 	backgroundMesh.bind(cmdBuf);
 
-	float xOffset = 0;
-	for (size_t i = 0; i < tabs.size(); ++i) {
+	// headers are sorted by x, so everything from the first one past the right edge on is invisible
+	size_t visibleTabs = 0;
+	while (visibleTabs < tabHeaders.size() && tabHeaders[visibleTabs].x < size.x) {
+		++visibleTabs;
+	}
+
+	for (size_t i = 0; i < visibleTabs; ++i) {
 		if (i == activeTab) {
 			pushConstants.color1 = glm::vec3(1.0f, 1.0f, 1.0f);
 		} else {
 			pushConstants.color1 = glm::vec3(0.5f, 0.5f, 0.5f);
 		}
 
-		float tabWidth				 = tabMeshes[i].getBounds().x * textRenderer.getFontSize() + 20;
-		pushConstants.viewportSize.x = tabWidth;
+		const auto &header			 = tabHeaders[i];
+		pushConstants.viewportSize.x = header.width;
 
 		backgroundShader.setPushConstants(cmdBuf, &pushConstants, sizeof(pushConstants), 0);
-		glm::vec2 tabPos = glm::vec2(position) + glm::vec2(xOffset, 0);
-		cmdBuf.setViewport(tabPos.x, tabPos.y, tabWidth, tabHeight, 0.0f, 1.0f);
-		cmdBuf.setScissor(tabPos.x, tabPos.y, tabWidth, tabHeight);
+		glm::vec2 tabPos = glm::vec2(position) + glm::vec2(header.x, 0);
+		cmdBuf.setViewport(tabPos.x, tabPos.y, header.width, tabHeight, 0.0f, 1.0f);
+		cmdBuf.setScissor(tabPos.x, tabPos.y, header.width, tabHeight);
 		backgroundMesh.draw(cmdBuf, backgroundShader);
-
-		xOffset += tabWidth;
 	}
 
-	xOffset = 0;
-	for (size_t i = 0; i < tabs.size(); ++i) {
-		float			tabWidth = tabMeshes[i].getBounds().x * textRenderer.getFontSize() + 20;
-		glm::vec2		tabPos	 = glm::vec2(position) + glm::vec2(xOffset, 0);
+	for (size_t i = 0; i < visibleTabs; ++i) {
+		const auto	   &header = tabHeaders[i];
+		glm::vec2		tabPos = glm::vec2(position) + glm::vec2(header.x, 0);
 		TextRenderState tabRenderState{
-			.translation  = glm::vec2(0, 1),
-			.viewportSize = glm::ivec2(tabWidth, tabHeight),
-			.cursorPos	  = glm::vec2(0, 0),
-			.showCursor	  = false,
+			.translation	  = glm::vec2(0, 1 - i * 1.2f),		// bring row i of the header mesh to the top
+			.viewportSize	  = glm::ivec2(header.width, tabHeight),
+			.viewportPosition = glm::ivec2(tabPos.x + 10, tabPos.y),
+			.cursorPos		  = glm::vec2(0, 0),
+			.showCursor		  = false,
 		};
-		cmdBuf.setViewport(tabPos.x + 10, tabPos.y, tabWidth, tabHeight, 0.0f, 1.0f);
-		cmdBuf.setScissor(tabPos.x + 10, tabPos.y, tabWidth, tabHeight);
-		textRenderer.renderText(cmdBuf, tabMeshes[i], tabRenderState);
-		xOffset += tabWidth;
+		textRenderer.queueText(headerMesh, tabRenderState, i, i + 1);
 	}
 
 	// render active child
@@ -601,29 +1381,27 @@ void fxed::TabsPane::render(nri::CommandBuffer &cmdBuf) {
 void fxed::TabsPane::mouseClick(fxed::Mouse &mouse, int button, int action, int mods) {
 	auto position = mouse.getPosition();
 	position -= this->position;
-	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
-		float xOffset	= 0;
-		float tabHeight = textRenderer.getFontSize() * 1.5f;
-		for (size_t i = 0; i < tabs.size(); ++i) {
-			float tabWidth			  = tabMeshes[i].getBounds().x * textRenderer.getFontSize() + 20;
-			float closeButtonPosition = tabWidth - 10 - textRenderer.getFontSize();
-			if (position.x >= xOffset && position.x < xOffset + closeButtonPosition && position.y >= 0 &&
-				position.y < tabHeight) {
+	float tabHeight = textRenderer.getFontSize() * 1.5f;
+	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && position.y >= 0 && position.y < tabHeight) {
+		if (headersDirty) updateHeaders();
+		int i = findTabAt(position.x);
+		if (i >= 0) {
+			const auto &header				= tabHeaders[i];
+			float		closeButtonPosition = header.x + header.width - 10 - textRenderer.getFontSize();
+			if (position.x < closeButtonPosition) {
 				setActiveTab(i);
 				return;
 			}
-			if (position.x >= xOffset + closeButtonPosition && position.x < xOffset + tabWidth && position.y >= 0 &&
-				position.y < tabHeight) {
-				tabs.erase(tabs.begin() + i);
-				tabMeshes.erase(tabMeshes.begin() + i);
-				if (activeTab >= i) { setActiveTab(std::max(0u, activeTab - 1)); }
-				return;
-			}
-			xOffset += tabWidth;
+			nri.synchronize();	   // the closed tab's meshes may still be read by frames in flight
+			tabs.erase(tabs.begin() + i);
+			headersDirty = true;
+			// the tab before the closed one comes to the front, or the new first tab when the first one is closed
+			if (activeTab >= uint32_t(i)) setActiveTab(activeTab > 0 ? activeTab - 1 : 0);
+			return;
 		}
 	}
 
-	if (!tabs.empty() && position.y >= textRenderer.getFontSize() * 1.5f) {
+	if (!tabs.empty() && position.y >= tabHeight) {
 		assert(activeTab >= 0 && activeTab < tabs.size());
 		tabs[activeTab]->mouseClick(mouse, button, action, mods);
 	} else Pane::mouseClick(mouse, button, action, mods);
@@ -666,6 +1444,7 @@ void fxed::TabsPane::mouseMove(fxed::Mouse &mouse, double deltaX, double deltaY)
 void fxed::TabsPane::setActiveTab(uint32_t index) {
 	if (index < tabs.size()) {
 		activeTab = index;
+		tabs[activeTab]->tabActivated();
 		tabs[activeTab]->setActive();
 		placeTab(tabs[activeTab]);
 	}
@@ -0,0 +1,576 @@
+#include "regex.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <format>
+#include <stdexcept>
+
+#include "text_search.hpp"
+
+using namespace fxed;
+
+namespace {
+
+// past this many cached DFA states, or NFA states in all of them, they are all dropped and built again as needed,
+// bounding the memory
+constexpr std::size_t maxDfaStates	   = 4096;
+constexpr std::size_t maxDfaCachedSize = 1 << 22;
+// {m,n} copies its operand, so the counts are limited, and nested ones are caught by the limit on the NFA size
+constexpr int		  maxRepeat		  = 1000;
+constexpr std::size_t maxNfaStates	  = 1 << 16;
+// the prefilter only needs some string every match contains, a prefix of a longer one still is
+constexpr std::size_t maxLiteralLength = 256;
+
+constexpr char32_t maxCodePoint = 0x10ffff;
+
+struct Node {
+	enum Kind { CHARS, CONCAT, ALTERNATE, REPEAT, LINE_START, LINE_END, EMPTY };
+
+	Kind			  kind;
+	uint32_t		  chars	   = 0;
+	int				  min	   = 0;
+	int				  max	   = -1;	 // -1 for no limit
+	std::vector<Node> children = {};
+};
+
+class Parser {
+	std::u32string_view			  pattern;
+	std::size_t					  pos = 0;
+	std::vector<Regex::CharSet> &charSets;
+
+	[[noreturn]] void fail(std::string_view what) const {
+		throw std::runtime_error(std::format("Invalid regular expression: {} at {}", what, pos));
+	}
+	bool atEnd() const { return pos == pattern.size(); }
+	bool accept(char32_t c) {
+		if (atEnd() || pattern[pos] != c) return false;
+		++pos;
+		return true;
+	}
+
+	Node chars(Regex::CharSet &&set) {
+		charSets.push_back(std::move(set));
+		return {Node::CHARS, uint32_t(charSets.size() - 1)};
+	}
+
+	static Regex::CharSet normalize(Regex::CharSet set) {
+		std::ranges::sort(set);
+		Regex::CharSet result;
+		for (auto [first, last] : set) {
+			if (!result.empty() && first <= result.back().second + 1) {
+				result.back().second = std::max(result.back().second, last);
+			} else result.push_back({first, last});
+		}
+		return result;
+	}
+
+	static Regex::CharSet negate(const Regex::CharSet &set) {
+		Regex::CharSet result;
+		char32_t	   next = 0;
+		for (auto [first, last] : set) {
+			if (first > next) result.push_back({next, first - 1});
+			next = last + 1;
+		}
+		if (next <= maxCodePoint) result.push_back({next, maxCodePoint});
+		return result;
+	}
+
+	/// \d, \w, \s and their negations, or nothing for other escapes
+	static bool classEscape(char32_t c, Regex::CharSet &set) {
+		Regex::CharSet ranges;
+		switch (c | 0x20) {
+			case 'd': ranges = {{'0', '9'}}; break;
+			case 'w': ranges = {{'0', '9'}, {'A', 'Z'}, {'_', '_'}, {'a', 'z'}}; break;
+			case 's': ranges = {{'\t', '\r'}, {' ', ' '}}; break;
+			default: return false;
+		}
+		if (c >= 'A' && c <= 'Z') ranges = negate(ranges);
+		set.insert(set.end(), ranges.begin(), ranges.end());
+		return true;
+	}
+
+	char32_t escapedChar() {
+		if (atEnd()) fail("trailing backslash");
+		char32_t c = pattern[pos++];
+		switch (c) {
+			case 't': return '\t';
+			case 'n': return '\n';
+			case 'r': return '\r';
+			default: return c;
+		}
+	}
+
+	Node parseClass() {
+		bool		   negated = accept('^');
+		Regex::CharSet set;
+		// a ] right after the [ is a literal
+		for (bool first = true; first || !accept(']'); first = false) {
+			if (atEnd()) fail("missing ]");
+			char32_t c = pattern[pos++];
+			if (c == '\\') {
+				if (!atEnd() && classEscape(pattern[pos], set)) {
+					++pos;
+					continue;
+				}
+				c = escapedChar();
+			}
+			char32_t last = c;
+			if (pos + 1 < pattern.size() && pattern[pos] == '-' && pattern[pos + 1] != ']') {
+				++pos;
+				last = pattern[pos++];
+				if (last == '\\') last = escapedChar();
+				if (last < c) fail("reversed range");
+			}
+			set.push_back({c, last});
+		}
+		set = normalize(std::move(set));
+		return chars(negated ? negate(set) : std::move(set));
+	}
+
+	Node parseAtom() {
+		char32_t c = pattern[pos++];
+		switch (c) {
+			case '(': {
+				Node inner = parseAlternation();
+				if (!accept(')')) fail("missing )");
+				return inner;
+			}
+			case '[': return parseClass();
+			case '.': return chars({{0, maxCodePoint}});
+			case '^': return {Node::LINE_START};
+			case '$': return {Node::LINE_END};
+			case '*':
+			case '+':
+			case '?': fail("nothing to repeat");
+			case '\\': {
+				Regex::CharSet set;
+				if (!atEnd() && classEscape(pattern[pos], set)) {
+					++pos;
+					return chars(normalize(std::move(set)));
+				}
+				c = escapedChar();
+				return chars({{c, c}});
+			}
+			default: return chars({{c, c}});
+		}
+	}
+
+	int parseCount() {
+		int count = 0;
+		if (atEnd() || pattern[pos] < '0' || pattern[pos] > '9') fail("expected a number");
+		while (!atEnd() && pattern[pos] >= '0' && pattern[pos] <= '9') {
+			count = count * 10 + (pattern[pos++] - '0');
+			if (count > maxRepeat) fail("repeat count too large");
+		}
+		return count;
+	}
+
+	Node parseRepeat() {
+		Node atom = parseAtom();
+		while (!atEnd()) {
+			int min, max;
+			if (accept('*')) min = 0, max = -1;
+			else if (accept('+')) min = 1, max = -1;
+			else if (accept('?')) min = 0, max = 1;
+			// a { without a count after it is a literal, like in most code
+			else if (pos + 1 < pattern.size() && pattern[pos] == '{' && pattern[pos + 1] >= '0' &&
+					 pattern[pos + 1] <= '9') {
+				++pos;
+				min = max = parseCount();
+				if (accept(',')) max = !atEnd() && pattern[pos] == '}' ? -1 : parseCount();
+				if (!accept('}')) fail("missing }");
+				if (max != -1 && max < min) fail("reversed repeat count");
+			} else break;
+			Node repeat{Node::REPEAT, 0, min, max};
+			repeat.children.push_back(std::move(atom));
+			atom = std::move(repeat);
+		}
+		return atom;
+	}
+
+	Node parseConcatenation() {
+		Node concat{Node::CONCAT};
+		while (!atEnd() && pattern[pos] != '|' && pattern[pos] != ')') {
+			concat.children.push_back(parseRepeat());
+		}
+		if (concat.children.empty()) return {Node::EMPTY};
+		if (concat.children.size() == 1) return std::move(concat.children.front());
+		return concat;
+	}
+
+   public:
+	Parser(std::u32string_view pattern, std::vector<Regex::CharSet> &charSets)
+		: pattern(pattern), charSets(charSets) {}
+
+	Node parseAlternation() {
+		Node alternate{Node::ALTERNATE};
+		alternate.children.push_back(parseConcatenation());
+		while (accept('|')) {
+			alternate.children.push_back(parseConcatenation());
+		}
+		if (alternate.children.size() == 1) return std::move(alternate.children.front());
+		return alternate;
+	}
+
+	Node parse() {
+		Node root = parseAlternation();
+		if (!atEnd()) fail("unmatched )");
+		return root;
+	}
+};
+
+/// Thompson construction, a fragment is an entry state and the branches still to be connected to what follows
+struct Fragment {
+	int32_t								  start;
+	std::vector<std::pair<int32_t, bool>> outs;		// state, and whether it is the second branch of a SPLIT
+};
+
+class NfaBuilder {
+	std::vector<Regex::NfaState> &states;
+	bool						  reversed;
+
+	int32_t add(Regex::NfaState state) {
+		if (states.size() >= maxNfaStates) throw std::runtime_error("Invalid regular expression: pattern too large");
+		states.push_back(state);
+		return states.size() - 1;
+	}
+
+	void patch(const Fragment &fragment, int32_t target) {
+		for (auto [state, second] : fragment.outs) {
+			(second ? states[state].next1 : states[state].next) = target;
+		}
+	}
+
+	Fragment single(Regex::NfaState state) {
+		int32_t s = add(state);
+		return {s, {{s, false}}};
+	}
+
+	Fragment concat(Fragment a, Fragment b) {
+		patch(a, b.start);
+		return {a.start, std::move(b.outs)};
+	}
+
+	Fragment optional(Fragment a) {
+		int32_t split = add({Regex::NfaState::SPLIT, 0, a.start});
+		a.outs.push_back({split, true});
+		return {split, std::move(a.outs)};
+	}
+
+   public:
+	NfaBuilder(std::vector<Regex::NfaState> &states, bool reversed) : states(states), reversed(reversed) {}
+
+	Fragment build(const Node &node) {
+		using enum Regex::NfaState::Kind;
+		switch (node.kind) {
+			case Node::CHARS: return single({CHARS, node.chars});
+			// the reversed pattern sees the line end first
+			case Node::LINE_START: return single({reversed ? LINE_END : LINE_START});
+			case Node::LINE_END: return single({reversed ? LINE_START : LINE_END});
+			case Node::EMPTY: return single({SPLIT});
+			case Node::CONCAT: {
+				Fragment result = single({SPLIT});
+				for (std::size_t i = 0; i < node.children.size(); ++i) {
+					const auto &child = node.children[reversed ? node.children.size() - 1 - i : i];
+					result			  = concat(std::move(result), build(child));
+				}
+				return result;
+			}
+			case Node::ALTERNATE: {
+				Fragment result = build(node.children.back());
+				for (std::size_t i = node.children.size() - 1; i-- > 0;) {
+					Fragment branch = build(node.children[i]);
+					int32_t	 split	= add({SPLIT, 0, branch.start, result.start});
+					branch.outs.insert(branch.outs.end(), result.outs.begin(), result.outs.end());
+					result = {split, std::move(branch.outs)};
+				}
+				return result;
+			}
+			case Node::REPEAT: {
+				const Node &child  = node.children.front();
+				Fragment	result = single({SPLIT});
+				for (int i = 0; i < node.min; ++i) {
+					result = concat(std::move(result), build(child));
+				}
+				if (node.max == -1) {
+					// a loop back to a split before the operand
+					Fragment loop  = build(child);
+					int32_t	 split = add({SPLIT, 0, loop.start});
+					patch(loop, split);
+					return concat(std::move(result), {split, {{split, true}}});
+				}
+				for (int i = node.min; i < node.max; ++i) {
+					result = concat(std::move(result), optional(build(child)));
+				}
+				return result;
+			}
+		}
+		return single({SPLIT});
+	}
+
+	int32_t buildAll(const Node &root) {
+		Fragment fragment = build(root);
+		patch(fragment, add({Regex::NfaState::MATCH}));
+		return fragment.start;
+	}
+};
+
+/// What every match of a node must contain, for the prefilter. A node is exact when it matches one string only.
+struct Literals {
+	bool		   exact = false;
+	std::u32string string;		// the exact string, or the longest one every match contains
+};
+
+Literals requiredLiterals(const Node &node, const std::vector<Regex::CharSet> &charSets) {
+	auto longest = [](std::u32string &a, const std::u32string &b) {
+		if (b.size() > a.size()) a = b;
+	};
+
+	switch (node.kind) {
+		case Node::CHARS: {
+			const auto &set = charSets[node.chars];
+			if (set.size() == 1 && set[0].first == set[0].second) return {true, std::u32string(1, set[0].first)};
+			return {};
+		}
+		case Node::LINE_START:
+		case Node::LINE_END:
+		case Node::EMPTY: return {true, {}};
+		case Node::CONCAT: {
+			// runs of exact children join into one literal
+			Literals	   result{true, {}};
+			std::u32string run;
+			for (const auto &child : node.children) {
+				Literals literals = requiredLiterals(child, charSets);
+				if (literals.exact) {
+					run += literals.string;
+					continue;
+				}
+				result.exact = false;
+				longest(result.string, run);
+				longest(result.string, literals.string);
+				run.clear();
+			}
+			if (result.exact && run.size() <= maxLiteralLength) return {true, run};
+			result.exact = false;
+			longest(result.string, run);
+			result.string.resize(std::min(result.string.size(), maxLiteralLength));
+			return result;
+		}
+		case Node::REPEAT: {
+			if (node.min == 0) return {};
+			Literals literals = requiredLiterals(node.children.front(), charSets);
+			if (literals.exact && node.min == node.max && literals.string.size() * node.min <= maxLiteralLength) {
+				std::u32string repeated;
+				for (int i = 0; i < node.min; ++i) {
+					repeated += literals.string;
+				}
+				return {true, repeated};
+			}
+			return {false, literals.string.substr(0, maxLiteralLength)};
+		}
+		case Node::ALTERNATE: return {};
+	}
+	return {};
+}
+
+}	  // namespace
+
+Regex::Regex(std::u32string_view pattern) {
+	Node root = Parser(pattern, charSets).parse();
+
+	Literals literals = requiredLiterals(root, charSets);
+	requiredLiteral	  = literals.string;
+
+	forward.nfaStart   = NfaBuilder(forward.nfa, false).buildAll(root);
+	reverse.nfaStart   = NfaBuilder(reverse.nfa, true).buildAll(root);
+	reverse.unanchored = true;
+
+	// characters that no set tells apart share a class, so the DFA has a column per class instead of per character
+	for (const auto &set : charSets) {
+		for (auto [first, last] : set) {
+			classBounds.push_back(first);
+			if (last < maxCodePoint) classBounds.push_back(last + 1);
+		}
+	}
+	std::ranges::sort(classBounds);
+	classBounds.erase(std::unique(classBounds.begin(), classBounds.end()), classBounds.end());
+	if (!classBounds.empty() && classBounds.front() == 0) classBounds.erase(classBounds.begin());
+	for (char32_t c = 0; c < 128; ++c) {
+		asciiClasses[c] = std::ranges::upper_bound(classBounds, c) - classBounds.begin();
+	}
+}
+
+uint32_t Regex::classOf(char32_t c) const {
+	if (c < 128) return asciiClasses[c];
+	return std::ranges::upper_bound(classBounds, c) - classBounds.begin();
+}
+
+bool Regex::contains(uint32_t charSet, char32_t c) const {
+	const auto &set = charSets[charSet];
+	auto		it	= std::ranges::upper_bound(set, c, {}, &std::pair<char32_t, char32_t>::first);
+	return it != set.begin() && c <= (it - 1)->second;
+}
+
+void Regex::closure(const Dfa &dfa, std::vector<int32_t> &seeds, bool atLineStart, bool atLineEnd,
+					std::vector<int32_t> &out) {
+	if (visited.size() < dfa.nfa.size()) visited.resize(dfa.nfa.size(), 0);
+	if (++visitGeneration == 0) {
+		std::ranges::fill(visited, 0);
+		visitGeneration = 1;
+	}
+	out.clear();
+	while (!seeds.empty()) {
+		int32_t s = seeds.back();
+		seeds.pop_back();
+		if (s == -1 || visited[s] == visitGeneration) continue;
+		visited[s] = visitGeneration;
+
+		const NfaState &state = dfa.nfa[s];
+		switch (state.kind) {
+			case NfaState::SPLIT:
+				seeds.push_back(state.next1);
+				seeds.push_back(state.next);
+				break;
+			case NfaState::LINE_START:
+				if (atLineStart) seeds.push_back(state.next);
+				break;
+			case NfaState::LINE_END:
+				// kept in the set, it is followed when the line ends
+				if (atLineEnd) seeds.push_back(state.next);
+				else out.push_back(s);
+				break;
+			default: out.push_back(s);
+		}
+	}
+	std::ranges::sort(out);
+}
+
+bool Regex::accepts(const Dfa &dfa, int32_t state, bool atLineEnd, bool emptyLine) const {
+	return dfa.accepting[state] & (emptyLine ? 4 : atLineEnd ? 2 : 1);
+}
+
+int32_t Regex::addState(Dfa &dfa, std::vector<int32_t> &&set) {
+	if (auto it = dfa.stateIds.find(set); it != dfa.stateIds.end()) return it->second;
+	if (dfa.states.size() >= maxDfaStates || dfa.cachedSize + set.size() > maxDfaCachedSize) {
+		++dfa.flushes;
+		dfa.cachedSize = 0;
+		dfa.stateIds.clear();
+		dfa.states.clear();
+		dfa.accepting.clear();
+		dfa.transitions.clear();
+		dfa.startStates[0] = dfa.startStates[1] = -1;
+	}
+
+	auto hasMatch = [&](const std::vector<int32_t> &states) {
+		return std::ranges::any_of(states, [&](int32_t s) { return dfa.nfa[s].kind == NfaState::MATCH; });
+	};
+	// a $ still in the set is passed at the line end, and a ^ after it too if the line is empty
+	std::vector<int32_t> seeds(set), atEnd, onEmptyLine;
+	closure(dfa, seeds, false, true, atEnd);
+	seeds = set;
+	closure(dfa, seeds, true, true, onEmptyLine);
+	uint8_t accepting = hasMatch(set) | hasMatch(atEnd) << 1 | hasMatch(onEmptyLine) << 2;
+
+	int32_t id = dfa.states.size();
+	dfa.cachedSize += set.size();
+	dfa.stateIds.emplace(set, id);
+	dfa.states.push_back(std::move(set));
+	dfa.accepting.push_back(accepting);
+	dfa.transitions.resize(dfa.transitions.size() + classCount(), -1);
+	return id;
+}
+
+int32_t Regex::startState(Dfa &dfa, bool atLineStart) {
+	int32_t &start = dfa.startStates[atLineStart];
+	if (start == -1) {
+		std::vector<int32_t> seeds{dfa.nfaStart}, set;
+		closure(dfa, seeds, atLineStart, false, set);
+		start = addState(dfa, std::move(set));
+	}
+	return start;
+}
+
+int32_t Regex::step(Dfa &dfa, int32_t state, char32_t c) {
+	uint32_t	cls	  = classOf(c);
+	std::size_t index = state * classCount() + cls;
+	if (dfa.transitions[index] != -1) return dfa.transitions[index];
+
+	// every character of a class is in the same sets, so its first one stands for all of them
+	char32_t			 representative = cls == 0 ? 0 : classBounds[cls - 1];
+	std::vector<int32_t> seeds, set;
+	for (int32_t s : dfa.states[state]) {
+		const NfaState &nfaState = dfa.nfa[s];
+		if (nfaState.kind == NfaState::CHARS && contains(nfaState.chars, representative)) {
+			seeds.push_back(nfaState.next);
+		}
+	}
+	if (dfa.unanchored) seeds.push_back(dfa.nfaStart);
+	closure(dfa, seeds, false, false, set);
+
+	uint32_t flushes = dfa.flushes;
+	int32_t	 next	 = addState(dfa, std::move(set));
+	// if the cache was just flushed, state is gone and the transition is made again next time
+	if (dfa.flushes == flushes) dfa.transitions[index] = next;
+	return next;
+}
+
+std::size_t Regex::findAll(std::u32string_view line, std::vector<RegexMatch> &matches, std::size_t from,
+						  std::size_t budget) {
+	constexpr auto npos = std::u32string_view::npos;
+	// the starts are found once per line, a call that continues a line reuses them
+	if (from == 0 || matchStarts.size() != line.size() + 1) {
+		if (!requiredLiteral.empty() && findInLine(line, requiredLiteral) == npos) return npos;
+
+		// the reversed pattern accepts, running backwards from the line end, at every position where a match starts
+		matchStarts.assign(line.size() + 1, false);
+		int32_t state = startState(reverse, true);
+		for (std::size_t i = line.size();; --i) {
+			matchStarts[i] = accepts(reverse, state, i == 0, line.empty());
+			if (i == 0) break;
+			state = step(reverse, state, line[i - 1]);
+		}
+		scanStates.assign(line.size() + 1, -1);
+		scanIds.assign(line.size() + 1, 0);
+		scanEnds.clear();
+		scanFlushes = forward.flushes;
+	}
+
+	// From each start, the forward DFA runs until it can not match anymore and the last accepting position is the
+	// end. A scan that reaches a position in the state an earlier scan had there goes the same way from then on, so it
+	// takes that scan's end instead. Without this, a pattern like a[^z]*z|a scans to the line end from every a.
+	auto forgetScans = [&]() {
+		if (forward.flushes == scanFlushes) return;
+		std::ranges::fill(scanStates, -1);	   // the state ids were reused
+		scanFlushes = forward.flushes;
+	};
+	std::size_t steps = 0;
+	for (std::size_t pos = from; pos <= line.size();) {
+		auto it = std::find(matchStarts.begin() + pos, matchStarts.end(), true);
+		if (it == matchStarts.end()) break;
+		std::size_t begin = it - matchStarts.begin();
+		uint32_t	scan  = scanEnds.size();
+		int64_t		end	  = -1;
+		int32_t		state = startState(forward, begin == 0);
+		forgetScans();
+		for (std::size_t i = begin;; ++i) {
+			if (scanStates[i] == state) {
+				if (scanEnds[scanIds[i]] >= (int64_t)i) end = scanEnds[scanIds[i]];
+				break;
+			}
+			scanStates[i] = state;
+			scanIds[i]	  = scan;
+			if (accepts(forward, state, i == line.size(), line.empty())) end = i;
+			if (i == line.size() || forward.states[state].empty()) break;
+			state = step(forward, state, line[i]);
+			forgetScans();
+			++steps;
+		}
+		scanEnds.push_back(end);
+		// the reverse DFA found a match here, so the forward one accepts somewhere
+		assert(end >= (int64_t)begin);
+		matches.push_back({(uint32_t)begin, (uint32_t)end});
+		pos = end > (int64_t)begin ? end : begin + 1;
+		if (steps >= budget && pos <= line.size()) return pos;
+	}
+	return npos;
+}
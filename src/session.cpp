@@ -0,0 +1,136 @@
+#include "session.hpp"
+
+#include <cstring>
+#include <format>
+#include <string>
+#include <string_view>
+
+#include "file_utils.hpp"
+
+using namespace fxed;
+
+// Layout: header, the folder, then tabCount tabs, each a SessionTab followed by its path, then directoryCount
+// directories, each a uint32_t length and that many bytes of path.
+struct SessionHeader {
+	char	 magic[8];
+	uint32_t formatVersion;
+	uint32_t folderSize;
+	uint32_t tabCount;
+	uint32_t activeTab;
+	uint32_t directoryCount;
+};
+
+struct SessionTab {
+	uint32_t pathSize;
+	int32_t	 cursor[2];
+	float	 translation[2];
+};
+
+static constexpr char	  sessionMagic[8]		= {'F', 'X', 'S', 'E', 'S', 'S', 'N', '\0'};
+static constexpr uint32_t sessionFormatVersion = 1;
+
+std::filesystem::path Session::getSessionPath(const std::filesystem::path &folder) {
+	const auto &cacheDir = getCacheDirectory();
+	if (cacheDir.empty()) return {};
+	return cacheDir / "sessions" / std::format("{:016x}.session", hashString(folder.string()));
+}
+
+static void appendBytes(std::string &out, const void *data, std::size_t size) {
+	out.append((const char *)data, size);
+}
+
+bool Session::save() const {
+	auto path = getSessionPath(folder);
+	if (path.empty()) return false;
+
+	std::string	  folderString = folder.string();
+	SessionHeader header;
+	std::memcpy(header.magic, sessionMagic, sizeof(sessionMagic));
+	header.formatVersion  = sessionFormatVersion;
+	header.folderSize	  = folderString.size();
+	header.tabCount		  = tabs.size();
+	header.activeTab	  = activeTab;
+	header.directoryCount = openDirectories.size();
+
+	std::string bytes;
+	appendBytes(bytes, &header, sizeof(header));
+	bytes += folderString;
+	for (const auto &tab : tabs) {
+		std::string tabPath = tab.path.string();
+		SessionTab	entry{uint32_t(tabPath.size()), {tab.cursor.x, tab.cursor.y},
+						  {tab.translation.x, tab.translation.y}};
+		appendBytes(bytes, &entry, sizeof(entry));
+		bytes += tabPath;
+	}
+	for (const auto &directory : openDirectories) {
+		std::string directoryPath = directory.generic_string();
+		uint32_t	size		  = directoryPath.size();
+		appendBytes(bytes, &size, sizeof(size));
+		bytes += directoryPath;
+	}
+
+	std::error_code ec;
+	std::filesystem::create_directories(path.parent_path(), ec);
+	if (!writeFileAtomic(path, bytes)) return false;
+	dbLog(dbg::LOG_INFO, "Saved session of ", folder, " with ", tabs.size(), " tabs to ", path);
+	return true;
+}
+
+std::optional<Session> Session::load(const std::filesystem::path &folder) {
+	auto path = getSessionPath(folder);
+	if (path.empty()) return std::nullopt;
+
+	MappedFile file(path);
+	if (!file.isOpen() || file.getSize() < sizeof(SessionHeader)) return std::nullopt;
+	SessionHeader header;
+	std::memcpy(&header, file.getData(), sizeof(header));
+
+	const char *data   = file.getData();
+	std::size_t size   = file.getSize();
+	std::size_t offset = sizeof(header);
+	// every read is checked against the end of the file, a truncated session is dropped as a whole
+	auto read = [&](void *out, std::size_t count) {
+		if (count > size - offset) return false;
+		std::memcpy(out, data + offset, count);
+		offset += count;
+		return true;
+	};
+	auto readString = [&](std::string &out, std::size_t count) {
+		if (count > size - offset) return false;
+		out.assign(data + offset, count);
+		offset += count;
+		return true;
+	};
+
+	Session		session;
+	std::string folderString;
+	if (std::memcmp(header.magic, sessionMagic, sizeof(sessionMagic)) != 0 ||
+		header.formatVersion != sessionFormatVersion || !readString(folderString, header.folderSize) ||
+		folderString != folder.string()) {
+		dbLog(dbg::LOG_WARNING, "Ignoring unreadable session ", path);
+		return std::nullopt;
+	}
+	session.folder	  = folder;
+	session.activeTab = header.activeTab;
+
+	for (uint32_t i = 0; i < header.tabCount; ++i) {
+		SessionTab	entry;
+		std::string tabPath;
+		if (!read(&entry, sizeof(entry)) || !readString(tabPath, entry.pathSize)) {
+			dbLog(dbg::LOG_WARNING, "Ignoring truncated session ", path);
+			return std::nullopt;
+		}
+		session.tabs.push_back({tabPath, {entry.cursor[0], entry.cursor[1]},
+								{entry.translation[0], entry.translation[1]}});
+	}
+	for (uint32_t i = 0; i < header.directoryCount; ++i) {
+		uint32_t	length;
+		std::string directoryPath;
+		if (!read(&length, sizeof(length)) || !readString(directoryPath, length)) {
+			dbLog(dbg::LOG_WARNING, "Ignoring truncated session ", path);
+			return std::nullopt;
+		}
+		session.openDirectories.emplace_back(directoryPath);
+	}
+	return session;
+}
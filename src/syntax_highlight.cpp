@@ -0,0 +1,359 @@
+#include "syntax_highlight.hpp"
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+#include "thread_pool.hpp"
+
+using namespace fxed;
+
+namespace {
+
+struct Keyword {
+	std::u32string_view name;
+	TokenKind			kind;
+};
+
+// sorted by name for binary search
+constexpr Keyword keywords[] = {
+	{U"alignas", TokenKind::KEYWORD},
+	{U"alignof", TokenKind::KEYWORD},
+	{U"auto", TokenKind::TYPE},
+	{U"bool", TokenKind::TYPE},
+	{U"break", TokenKind::KEYWORD},
+	{U"case", TokenKind::KEYWORD},
+	{U"catch", TokenKind::KEYWORD},
+	{U"char", TokenKind::TYPE},
+	{U"char16_t", TokenKind::TYPE},
+	{U"char32_t", TokenKind::TYPE},
+	{U"char8_t", TokenKind::TYPE},
+	{U"class", TokenKind::KEYWORD},
+	{U"co_await", TokenKind::KEYWORD},
+	{U"co_return", TokenKind::KEYWORD},
+	{U"co_yield", TokenKind::KEYWORD},
+	{U"concept", TokenKind::KEYWORD},
+	{U"const", TokenKind::KEYWORD},
+	{U"const_cast", TokenKind::KEYWORD},
+	{U"consteval", TokenKind::KEYWORD},
+	{U"constexpr", TokenKind::KEYWORD},
+	{U"constinit", TokenKind::KEYWORD},
+	{U"continue", TokenKind::KEYWORD},
+	{U"decltype", TokenKind::KEYWORD},
+	{U"default", TokenKind::KEYWORD},
+	{U"delete", TokenKind::KEYWORD},
+	{U"do", TokenKind::KEYWORD},
+	{U"double", TokenKind::TYPE},
+	{U"dynamic_cast", TokenKind::KEYWORD},
+	{U"else", TokenKind::KEYWORD},
+	{U"enum", TokenKind::KEYWORD},
+	{U"explicit", TokenKind::KEYWORD},
+	{U"export", TokenKind::KEYWORD},
+	{U"extern", TokenKind::KEYWORD},
+	{U"false", TokenKind::NUMBER},
+	{U"float", TokenKind::TYPE},
+	{U"for", TokenKind::KEYWORD},
+	{U"friend", TokenKind::KEYWORD},
+	{U"goto", TokenKind::KEYWORD},
+	{U"if", TokenKind::KEYWORD},
+	{U"inline", TokenKind::KEYWORD},
+	{U"int", TokenKind::TYPE},
+	{U"long", TokenKind::TYPE},
+	{U"mutable", TokenKind::KEYWORD},
+	{U"namespace", TokenKind::KEYWORD},
+	{U"new", TokenKind::KEYWORD},
+	{U"noexcept", TokenKind::KEYWORD},
+	{U"nullptr", TokenKind::NUMBER},
+	{U"operator", TokenKind::KEYWORD},
+	{U"override", TokenKind::KEYWORD},
+	{U"private", TokenKind::KEYWORD},
+	{U"protected", TokenKind::KEYWORD},
+	{U"public", TokenKind::KEYWORD},
+	{U"reinterpret_cast", TokenKind::KEYWORD},
+	{U"requires", TokenKind::KEYWORD},
+	{U"return", TokenKind::KEYWORD},
+	{U"short", TokenKind::TYPE},
+	{U"signed", TokenKind::TYPE},
+	{U"sizeof", TokenKind::KEYWORD},
+	{U"static", TokenKind::KEYWORD},
+	{U"static_assert", TokenKind::KEYWORD},
+	{U"static_cast", TokenKind::KEYWORD},
+	{U"struct", TokenKind::KEYWORD},
+	{U"switch", TokenKind::KEYWORD},
+	{U"template", TokenKind::KEYWORD},
+	{U"this", TokenKind::KEYWORD},
+	{U"thread_local", TokenKind::KEYWORD},
+	{U"throw", TokenKind::KEYWORD},
+	{U"true", TokenKind::NUMBER},
+	{U"try", TokenKind::KEYWORD},
+	{U"typedef", TokenKind::KEYWORD},
+	{U"typename", TokenKind::KEYWORD},
+	{U"union", TokenKind::KEYWORD},
+	{U"unsigned", TokenKind::TYPE},
+	{U"using", TokenKind::KEYWORD},
+	{U"virtual", TokenKind::KEYWORD},
+	{U"void", TokenKind::TYPE},
+	{U"volatile", TokenKind::KEYWORD},
+	{U"wchar_t", TokenKind::TYPE},
+	{U"while", TokenKind::KEYWORD},
+};
+static_assert(std::ranges::is_sorted(keywords, {}, &Keyword::name), "keywords must be sorted by name");
+
+constexpr bool isIdentifierStart(char32_t c) {
+	return (c >= U'a' && c <= U'z') || (c >= U'A' && c <= U'Z') || c == U'_' || c > 127;
+}
+constexpr bool isDigit(char32_t c) { return c >= U'0' && c <= U'9'; }
+constexpr bool isIdentifierChar(char32_t c) { return isIdentifierStart(c) || isDigit(c); }
+constexpr bool isSpace(char32_t c) { return c == U' ' || c == U'\t' || c == U'\r'; }
+
+TokenKind classifyIdentifier(std::u32string_view word) {
+	auto it = std::ranges::lower_bound(keywords, word, {}, &Keyword::name);
+	return it != std::end(keywords) && it->name == word ? it->kind : TokenKind::TEXT;
+}
+
+}	  // namespace
+
+Language fxed::getLanguageForFile(const std::filesystem::path &path) {
+	static constexpr std::string_view cppExtensions[] = {".c",  ".cc",  ".cpp", ".cxx", ".h",
+														 ".hh", ".hpp", ".hxx", ".inl", ".hlsl"};
+	auto extension = path.extension().string();
+	if (std::ranges::find(cppExtensions, extension) != std::end(cppExtensions)) return Language::CPP;
+	return Language::NONE;
+}
+
+LexState fxed::tokenizeLine(std::u32string_view line, LexState state, std::vector<TokenKind> &kinds) {
+	kinds.assign(line.size(), TokenKind::TEXT);
+	bool   endsWithBackslash = !line.empty() && line.back() == U'\\';
+	size_t i				 = 0;
+
+	auto fill = [&](size_t begin, size_t end, TokenKind kind) {
+		std::fill(kinds.begin() + begin, kinds.begin() + end, kind);
+	};
+	// i is just past the opening quote, returns true if the literal is closed on this line
+	auto skipQuoted = [&](char32_t quote) {
+		for (; i < line.size(); ++i) {
+			if (line[i] == U'\\') ++i;
+			else if (line[i] == quote) {
+				++i;
+				return true;
+			}
+		}
+		i = line.size();
+		return false;
+	};
+
+	if (state == LexState::LINE_COMMENT) {
+		fill(0, line.size(), TokenKind::COMMENT);
+		return endsWithBackslash ? LexState::LINE_COMMENT : LexState::NORMAL;
+	}
+	if (state == LexState::STRING) {
+		bool closed = skipQuoted(U'"');
+		fill(0, i, TokenKind::STRING);
+		if (!closed) return endsWithBackslash ? LexState::STRING : LexState::NORMAL;
+	}
+	if (state == LexState::BLOCK_COMMENT) {
+		size_t end = line.find(U"*/");
+		if (end == std::u32string_view::npos) {
+			fill(0, line.size(), TokenKind::COMMENT);
+			return LexState::BLOCK_COMMENT;
+		}
+		i = end + 2;
+		fill(0, i, TokenKind::COMMENT);
+	}
+
+	// a directive only counts as the first token on the line
+	size_t firstToken = line.find_first_not_of(U" \t");
+	if (i == 0 && firstToken != std::u32string_view::npos && line[firstToken] == U'#') {
+		i = firstToken + 1;
+		while (i < line.size() && isSpace(line[i])) ++i;
+		while (i < line.size() && isIdentifierChar(line[i])) ++i;
+		fill(firstToken, i, TokenKind::PREPROCESSOR);
+		// #include <header>
+		size_t open = line.find_first_not_of(U" \t", i);
+		if (open != std::u32string_view::npos && line[open] == U'<') {
+			size_t close = line.find(U'>', open);
+			if (close != std::u32string_view::npos) {
+				fill(open, close + 1, TokenKind::STRING);
+				i = close + 1;
+			}
+		}
+	}
+
+	while (i < line.size()) {
+		char32_t c	   = line[i];
+		size_t	 start = i;
+		if (isSpace(c)) {
+			++i;
+		} else if (c == U'/' && i + 1 < line.size() && line[i + 1] == U'/') {
+			fill(i, line.size(), TokenKind::COMMENT);
+			return endsWithBackslash ? LexState::LINE_COMMENT : LexState::NORMAL;
+		} else if (c == U'/' && i + 1 < line.size() && line[i + 1] == U'*') {
+			size_t end = line.find(U"*/", i + 2);
+			if (end == std::u32string_view::npos) {
+				fill(i, line.size(), TokenKind::COMMENT);
+				return LexState::BLOCK_COMMENT;
+			}
+			i = end + 2;
+			fill(start, i, TokenKind::COMMENT);
+		} else if (c == U'"' || c == U'\'') {
+			++i;
+			bool closed = skipQuoted(c);
+			fill(start, i, TokenKind::STRING);
+			if (!closed && c == U'"' && endsWithBackslash) return LexState::STRING;
+		} else if (isDigit(c) || (c == U'.' && i + 1 < line.size() && isDigit(line[i + 1]))) {
+			// also takes digit separators, suffixes and exponent signs
+			++i;
+			while (i < line.size()) {
+				char32_t d = line[i];
+				char32_t prev = line[i - 1] | 0x20;
+				if (isIdentifierChar(d) || d == U'.' || d == U'\'') ++i;
+				else if ((d == U'+' || d == U'-') && (prev == U'e' || prev == U'p')) ++i;
+				else break;
+			}
+			fill(start, i, TokenKind::NUMBER);
+		} else if (isIdentifierStart(c)) {
+			while (i < line.size() && isIdentifierChar(line[i])) ++i;
+			auto word = line.substr(start, i - start);
+			// encoding prefix of a literal like u8"..." or L'x', the literal itself is lexed next
+			bool isPrefix = word == U"u8" || word == U"u" || word == U"U" || word == U"L";
+			if (isPrefix && i < line.size() && (line[i] == U'"' || line[i] == U'\'')) {
+				fill(start, i, TokenKind::STRING);
+			} else {
+				fill(start, i, classifyIdentifier(word));
+			}
+		} else {
+			kinds[i++] = TokenKind::PUNCTUATION;
+		}
+	}
+	return LexState::NORMAL;
+}
+
+glm::vec4 fxed::getTokenColor(TokenKind kind) {
+	static const std::array<glm::vec4, 8> colors = {
+		glm::vec4(0.86f, 0.86f, 0.86f, 1.f),	 // TEXT
+		glm::vec4(0.34f, 0.61f, 0.84f, 1.f),	 // KEYWORD
+		glm::vec4(0.31f, 0.79f, 0.69f, 1.f),	 // TYPE
+		glm::vec4(0.71f, 0.81f, 0.66f, 1.f),	 // NUMBER
+		glm::vec4(0.81f, 0.57f, 0.47f, 1.f),	 // STRING
+		glm::vec4(0.42f, 0.60f, 0.33f, 1.f),	 // COMMENT
+		glm::vec4(0.77f, 0.53f, 0.75f, 1.f),	 // PREPROCESSOR
+		glm::vec4(0.70f, 0.70f, 0.70f, 1.f),	 // PUNCTUATION
+	};
+	return colors[(size_t)kind];
+}
+
+void HighlightWorker::edit(uint64_t generation, const LineEdit &edit, std::vector<std::u32string> &&newLines) {
+	std::lock_guard lock(mutex);
+	pending.push_back({generation, edit, std::move(newLines)});
+	if (running) return;
+	running = true;
+	ThreadPool::getInstance().execute([self = shared_from_this()]() { self->run(); });
+}
+
+std::vector<HighlightWorker::LineTokens> HighlightWorker::takeFinished() {
+	std::lock_guard lock(mutex);
+	return std::exchange(finished, {});
+}
+
+void HighlightWorker::applyEdit(PendingEdit &pendingEdit) {
+	const LineEdit &edit = pendingEdit.edit;
+	generation			 = pendingEdit.generation;
+
+	lines.erase(lines.begin() + edit.first, lines.begin() + edit.first + edit.removed);
+	lines.insert(lines.begin() + edit.first, std::make_move_iterator(pendingEdit.lines.begin()),
+				 std::make_move_iterator(pendingEdit.lines.end()));
+	endStates.erase(endStates.begin() + edit.first, endStates.begin() + edit.first + edit.removed);
+	endStates.insert(endStates.begin() + edit.first, edit.inserted, LexState::UNKNOWN);
+
+	// move the lines still waiting to their new numbers, the edited range is parsed from its first line anyway
+	std::set<uint32_t> dirty;
+	for (uint32_t line : dirtyLines) {
+		if (line < edit.first) dirty.insert(line);
+		else if (line >= edit.first + edit.removed) dirty.insert(line + edit.inserted - edit.removed);
+	}
+	if (edit.first < lines.size()) dirty.insert(edit.first);
+	dirtyLines = std::move(dirty);
+}
+
+void HighlightWorker::run() {
+	// lines per batch, between batches new edits are applied and results handed to the main thread
+	constexpr size_t batchSize = 2048;
+
+	while (!cancelled) {
+		std::vector<PendingEdit> edits;
+		{
+			std::lock_guard lock(mutex);
+			edits.swap(pending);
+			if (edits.empty() && dirtyLines.empty()) {
+				running = false;
+				return;
+			}
+		}
+		for (auto &edit : edits) {
+			applyEdit(edit);
+		}
+
+		std::vector<LineTokens> batch;
+		while (batch.size() < batchSize && !dirtyLines.empty()) {
+			uint32_t line = *dirtyLines.begin();
+			dirtyLines.erase(dirtyLines.begin());
+
+			// the smallest dirty line always comes after lines that are up to date
+			LexState   startState = line == 0 ? LexState::NORMAL : endStates[line - 1];
+			LineTokens tokens{generation, line, {}};
+			LexState   endState = tokenizeLine(lines[line], startState, tokens.kinds);
+			batch.push_back(std::move(tokens));
+
+			if (endState != endStates[line] && line + 1 < lines.size()) dirtyLines.insert(line + 1);
+			endStates[line] = endState;
+		}
+
+		std::lock_guard lock(mutex);
+		std::ranges::move(batch, std::back_inserter(finished));
+	}
+}
+
+SyntaxHighlighter::~SyntaxHighlighter() { worker->cancel(); }
+
+void SyntaxHighlighter::update(const TextStateBase &text, const LineEdit &edit) {
+	if (language == Language::NONE) return;
+	std::vector<std::u32string> newLines;
+	newLines.reserve(edit.inserted);
+	for (uint32_t i = 0; i < edit.inserted; ++i) {
+		newLines.push_back(text.getLine(edit.first + i));
+	}
+
+	// a line edited in place keeps its old tokens until the new ones arrive, so typing does not flicker
+	if (edit.removed != edit.inserted) {
+		lineTokens.erase(lineTokens.begin() + edit.first, lineTokens.begin() + edit.first + edit.removed);
+		lineTokens.insert(lineTokens.begin() + edit.first, edit.inserted, {});
+	}
+
+	++generation;
+	unseenEdits.push_back({generation, edit});
+	worker->edit(generation, edit, std::move(newLines));
+}
+
+bool SyntaxHighlighter::poll() {
+	auto finished = worker->takeFinished();
+	if (finished.empty()) return false;
+
+	for (auto &tokens : finished) {
+		// results are in order, the worker has seen every edit up to this one
+		while (!unseenEdits.empty() && unseenEdits.front().first <= tokens.generation) {
+			unseenEdits.pop_front();
+		}
+		int64_t line = tokens.line;
+		for (const auto &[_, edit] : unseenEdits) {
+			if (line < edit.first) continue;
+			if (line < edit.first + edit.removed) {
+				// the line was edited again and will be sent once more
+				line = -1;
+				break;
+			}
+			line += (int64_t)edit.inserted - edit.removed;
+		}
+		if (line >= 0 && line < (int64_t)lineTokens.size()) lineTokens[line] = std::move(tokens.kinds);
+	}
+	return true;
+}
@@ -1,5 +1,8 @@
 #include "text_editor.hpp"
 
+#include <algorithm>
+#include <iterator>
+
 using namespace fxed;
 
 bool InsertCharAction::forward(TextStateBase &editor) {
@@ -36,11 +39,102 @@ void DeleteCharAction::print(std::ostream &os) const {
 	os << "Delete '" << (char)c << "' at (" << positionBefore.x << ", " << positionBefore.y << ")";
 }
 
+bool InsertTextAction::forward(TextStateBase &editor) {
+	editor.setCursor(positionBefore);
+	editor.insertText(text);
+	positionAfter = editor.getCursorPos();
+	return true;
+}
+
+void InsertTextAction::backward(TextStateBase &editor) {
+	editor.setCursor(positionAfter);
+	for (size_t i = 0; i < text.size(); ++i) {
+		editor.deleteChar();
+	}
+	assert(editor.getCursorPos() == positionBefore);
+}
+
+void InsertTextAction::print(std::ostream &os) const {
+	os << "Insert " << text.size() << " chars at (" << positionBefore.x << ", " << positionBefore.y << ")";
+}
+
+void ReplaceLinesAction::swapLines(TextStateBase &editor) {
+	for (size_t i = 0; i < lineNumbers.size(); ++i) {
+		std::u32string current = editor.getLine(lineNumbers[i]);
+		editor.replaceLine(lineNumbers[i], std::move(otherLines[i]));
+		otherLines[i] = std::move(current);
+	}
+}
+
+bool ReplaceLinesAction::forward(TextStateBase &editor) {
+	swapLines(editor);
+	return true;
+}
+
+void ReplaceLinesAction::backward(TextStateBase &editor) { swapLines(editor); }
+
+void ReplaceLinesAction::print(std::ostream &os) const { os << "Replace " << lineNumbers.size() << " lines"; }
+
+bool MultiCursorAction::forward(TextStateBase &editor) {
+	editor.setCursor(cursorBefore);
+	editor.setExtraCursors(extraBefore);
+	if (hunks.empty()) {
+		hunks		= editor.editAtCursors(text, deleteBefore);
+		cursorAfter = editor.getCursorPos();
+		extraAfter	= editor.getExtraCursors();
+		return true;
+	}
+	editor.swapHunks(hunks);
+	editor.setCursor(cursorAfter);
+	editor.setExtraCursors(extraAfter);
+	return true;
+}
+
+void MultiCursorAction::backward(TextStateBase &editor) {
+	editor.swapHunks(hunks);
+	editor.setCursor(cursorBefore);
+	editor.setExtraCursors(extraBefore);
+}
+
+void MultiCursorAction::print(std::ostream &os) const {
+	os << (deleteBefore ? "Delete" : "Insert " + std::to_string(text.size()) + " chars") << " at "
+	   << extraBefore.size() + 1 << " cursors";
+}
+
 std::ostream &operator<<(std::ostream &os, const Action &action) {
 	action.print(os);
 	return os;
 }
 
+LineEdit LineEdit::then(const LineEdit &next) const {
+	// [begin, end) covers both edits in the line numbers between them
+	uint32_t begin = std::min(first, next.first);
+	uint32_t end   = std::max(first + inserted, next.first + next.removed);
+	return {begin, end + removed - inserted - begin, end + next.inserted - next.removed - begin};
+}
+
+void TextState::recordEdit(uint32_t first, uint32_t removed, uint32_t inserted) {
+	LineEdit edit{first, removed, inserted};
+	lineEdit  = lineEdit ? lineEdit->then(edit) : edit;
+	indexEdit = indexEdit ? indexEdit->then(edit) : edit;
+}
+
+void TextState::updateLineIndex() const {
+	if (!indexEdit) return;
+	auto [first, removed, inserted] = *std::exchange(indexEdit, std::nullopt);
+	lineIndex.replace(first, removed, std::span(lines).subspan(first, inserted));
+}
+
+uint64_t TextState::lineToOffset(size_t line) const {
+	updateLineIndex();
+	return lineIndex.lineToOffset(line);
+}
+
+size_t TextState::offsetToLine(uint64_t offset) const {
+	updateLineIndex();
+	return lineIndex.offsetToLine(offset);
+}
+
 int32_t TextState::measureLineOffset(int line, int charOffset) const {
 	if (charOffset == -1) return -1;
 	int32_t offset = 0;
@@ -63,6 +157,7 @@ TextState::TextState(fxed::any_input_range<char32_t> &&text) {
 		++it;
 	}
 	if (lines.empty()) { lines.emplace_back(); }
+	recordEdit(0, 0, lines.size());
 	textChanged	 = true;
 	lastMoveTime = std::chrono::high_resolution_clock::now();
 	cursorMoved	 = true;
@@ -70,12 +165,14 @@ TextState::TextState(fxed::any_input_range<char32_t> &&text) {
 
 void TextState::insertChar(char32_t c) {
 	if (c == '\n') {
+		recordEdit(cursorPos.y, 1, 2);
 		std::u32string newLine = lines[cursorPos.y].substr(cursorPos.x);
 		lines[cursorPos.y].resize(cursorPos.x);
 		lines.insert(lines.begin() + cursorPos.y + 1, std::move(newLine));
 		cursorPos.y++;
 		cursorPos.x = 0;
 	} else {
+		recordEdit(cursorPos.y, 1, 1);
 		lines[cursorPos.y].insert(lines[cursorPos.y].begin() + cursorPos.x, c);
 		cursorPos.x++;
 	}
@@ -83,15 +180,37 @@ void TextState::insertChar(char32_t c) {
 	cursorMoved	 = true;
 	lastMoveTime = std::chrono::high_resolution_clock::now();
 	textChanged	 = true;
+	clampExtraCursors();
+}
+
+void TextState::insertText(std::u32string_view text) {
+	// insert each line of the text at once instead of shifting the rest of the line for every character
+	recordEdit(cursorPos.y, 1, 1);
+	while (!text.empty()) {
+		size_t newline = text.find(U'\n');
+		auto   chunk   = text.substr(0, newline);
+		lines[cursorPos.y].insert(cursorPos.x, chunk);
+		cursorPos.x += chunk.size();
+		if (newline == std::u32string_view::npos) break;
+		insertChar(U'\n');
+		text.remove_prefix(newline + 1);
+	}
+	currentMax	 = measureLineOffset(cursorPos.y, cursorPos.x);
+	cursorMoved	 = true;
+	lastMoveTime = std::chrono::high_resolution_clock::now();
+	textChanged	 = true;
+	clampExtraCursors();
 }
 
 char32_t TextState::deleteChar() {
 	char32_t deletedChar = '\0';
 	if (cursorPos.x > 0) {
+		recordEdit(cursorPos.y, 1, 1);
 		deletedChar = lines[cursorPos.y][cursorPos.x - 1];
 		lines[cursorPos.y].erase(lines[cursorPos.y].begin() + cursorPos.x - 1);
 		cursorPos.x--;
 	} else if (cursorPos.y > 0) {
+		recordEdit(cursorPos.y - 1, 2, 1);
 		deletedChar = '\n';
 		cursorPos.x = lines[cursorPos.y - 1].size();
 		lines[cursorPos.y - 1] += lines[cursorPos.y];
@@ -102,6 +221,7 @@ char32_t TextState::deleteChar() {
 	cursorMoved	 = true;
 	lastMoveTime = std::chrono::high_resolution_clock::now();
 	textChanged	 = true;
+	clampExtraCursors();
 	return deletedChar;
 }
 
@@ -122,6 +242,15 @@ void TextState::moveCursor(int dx, int dy) {
 	cursorPos.x	 = std::clamp(newCursorX, 0, (int32_t)lines[cursorPos.y].size());
 	cursorMoved	 = true;
 	lastMoveTime = std::chrono::high_resolution_clock::now();
+
+	// the other cursors just move by the offset, clamped to their lines
+	if (!extraCursors.empty()) {
+		std::vector<glm::ivec2> moved = extraCursors;
+		for (auto &cursor : moved) {
+			cursor += glm::ivec2(dx, dy);
+		}
+		setExtraCursors(std::move(moved));
+	}
 }
 
 void TextState::setCursor(glm::ivec2 pos) {
@@ -132,6 +261,148 @@ void TextState::setCursor(glm::ivec2 pos) {
 	cursorMoved	 = true;
 }
 
+void TextState::replaceLine(size_t line, std::u32string text) {
+	recordEdit(line, 1, 1);
+	lines[line] = std::move(text);
+	if (cursorPos.y == (int32_t)line) cursorPos.x = std::min<int32_t>(cursorPos.x, lines[line].size());
+	textChanged = true;
+	clampExtraCursors();
+}
+
+static bool cursorLess(glm::ivec2 a, glm::ivec2 b) { return a.y != b.y ? a.y < b.y : a.x < b.x; }
+static bool isInText(const std::vector<std::u32string> &lines, glm::ivec2 cursor) {
+	return cursor.y < (int32_t)lines.size() && cursor.x <= (int32_t)lines[cursor.y].size();
+}
+
+void TextState::setExtraCursors(std::vector<glm::ivec2> cursors) {
+	for (auto &cursor : cursors) {
+		cursor.y = std::clamp(cursor.y, 0, (int32_t)lines.size() - 1);
+		cursor.x = std::clamp(cursor.x, 0, (int32_t)lines[cursor.y].size());
+	}
+	// moving every cursor by the same amount mostly keeps them sorted
+	if (!std::ranges::is_sorted(cursors, cursorLess)) std::ranges::sort(cursors, cursorLess);
+	// cursors that ran into each other or into the main one become one
+	auto [end, _] = std::ranges::unique(cursors);
+	cursors.erase(end, cursors.end());
+	std::erase(cursors, cursorPos);
+	extraCursors = std::move(cursors);
+	cursorMoved	 = true;
+}
+
+void TextState::clampExtraCursors() {
+	// edits made with one cursor, their undo and replace all can shorten or remove the lines the others are on
+	if (!std::ranges::all_of(extraCursors, [&](glm::ivec2 cursor) { return isInText(lines, cursor); })) {
+		setExtraCursors(std::move(extraCursors));
+	}
+}
+
+std::vector<LineHunk> TextState::editAtCursors(std::u32string_view text, bool deleteBefore) {
+	// the extra cursors are kept sorted, inside the text and never equal to the main one
+	assert(std::ranges::all_of(extraCursors, [&](glm::ivec2 cursor) { return isInText(lines, cursor); }));
+	std::vector<glm::ivec2> cursors = extraCursors;
+	cursors.insert(std::ranges::lower_bound(cursors, cursorPos, cursorLess), cursorPos);
+
+	// Cursors on the same line share a hunk, and so do the lines a deletion at the start of a line joins. The hunks
+	// hold the new lines until swapHunks puts all of them in the text at once.
+	std::vector<LineHunk>	hunks;
+	std::vector<glm::ivec2> moved;
+	std::u32string			current;	 // the last line of the hunk, still being built
+	int32_t					shift	   = 0;		// lines added by the hunks before, to number the cursors
+	glm::ivec2				mainCursor = cursorPos;
+
+	auto closeHunk = [&]() {
+		LineHunk &hunk = hunks.back();
+		hunk.lines.push_back(std::move(current));
+		current.clear();
+		shift += int32_t(hunk.lines.size()) - int32_t(hunk.count);
+	};
+
+	for (std::size_t i = 0; i < cursors.size();) {
+		int32_t y	 = cursors[i].y;
+		bool	join = deleteBefore && cursors[i].x == 0 && y > 0;
+		if (hunks.empty() || uint32_t(join ? y - 1 : y) >= hunks.back().first + hunks.back().count) {
+			if (!hunks.empty()) closeHunk();
+			hunks.push_back({uint32_t(join ? y - 1 : y), 0, {}});
+			if (join) current = lines[y - 1];
+		}
+		// else the line before is the end of this hunk and current still holds it, the join appends to it
+		LineHunk &hunk = hunks.back();
+		hunk.count	   = y + 1 - hunk.first;
+
+		const std::u32string &line	 = lines[y];
+		int32_t				  copied = 0;
+		current.reserve(current.size() + line.size() + text.size());
+		for (; i < cursors.size() && cursors[i].y == y; ++i) {
+			int32_t x = cursors[i].x;
+			if (deleteBefore) {
+				if (x > copied) current.append(line, copied, x - 1 - copied);
+			} else {
+				current.append(line, copied, x - copied);
+				std::u32string_view rest = text;
+				for (std::size_t newline; (newline = rest.find(U'\n')) != std::u32string_view::npos;) {
+					current.append(rest.substr(0, newline));
+					hunk.lines.push_back(std::move(current));
+					current = {};
+					rest.remove_prefix(newline + 1);
+				}
+				current.append(rest);
+			}
+			copied = x;
+			glm::ivec2 position(current.size(), hunk.first + shift + hunk.lines.size());
+			if (cursors[i] == cursorPos) mainCursor = position;
+			else moved.push_back(position);
+		}
+		current.append(line, copied);
+	}
+	if (!hunks.empty()) closeHunk();
+	swapHunks(hunks);
+
+	cursorPos = mainCursor;
+	setExtraCursors(std::move(moved));
+	currentMax	 = measureLineOffset(cursorPos.y, cursorPos.x);
+	lastMoveTime = std::chrono::high_resolution_clock::now();
+	return hunks;
+}
+
+void TextState::swapHunks(std::vector<LineHunk> &hunks) {
+	if (hunks.empty()) return;
+	uint32_t first	 = hunks.front().first;
+	uint32_t oldEnd	 = hunks.back().first + hunks.back().count;
+	bool	 inPlace = std::ranges::all_of(hunks, [](const LineHunk &hunk) { return hunk.lines.size() == hunk.count; });
+
+	// when no hunk changes the number of lines they are swapped where they are, otherwise the lines from the first
+	// hunk on are moved once into a new vector instead of shifting the rest of the text for every hunk
+	std::vector<std::u32string> rebuilt;
+	if (!inPlace) rebuilt.reserve(lines.size() - first);
+	uint32_t copied = first;	 // lines before this are already in rebuilt
+	for (auto &hunk : hunks) {
+		auto begin = lines.begin() + hunk.first;
+		if (inPlace) {
+			std::swap_ranges(begin, begin + hunk.count, hunk.lines.begin());
+			continue;
+		}
+		rebuilt.insert(rebuilt.end(), std::make_move_iterator(lines.begin() + copied), std::make_move_iterator(begin));
+		std::vector<std::u32string> old(std::make_move_iterator(begin), std::make_move_iterator(begin + hunk.count));
+		uint32_t					newFirst = first + rebuilt.size();
+		rebuilt.insert(rebuilt.end(), std::make_move_iterator(hunk.lines.begin()),
+					   std::make_move_iterator(hunk.lines.end()));
+		copied	   = hunk.first + hunk.count;
+		hunk.first = newFirst;
+		hunk.count = hunk.lines.size();
+		hunk.lines = std::move(old);
+	}
+	if (!inPlace) {
+		rebuilt.insert(rebuilt.end(), std::make_move_iterator(lines.begin() + copied),
+					   std::make_move_iterator(lines.end()));
+		lines.resize(first);
+		std::ranges::move(rebuilt, std::back_inserter(lines));
+	}
+	uint32_t newEnd = hunks.back().first + hunks.back().count;
+	recordEdit(first, oldEnd - first, newEnd - first);
+	textChanged = true;
+	clampExtraCursors();
+}
+
 char32_t TextState::getCharAt(glm::ivec2 pos) const {
 	if (pos.y < 0 || pos.y >= (int32_t)lines.size() || pos.x < 0 || pos.x >= (int32_t)lines[pos.y].size()) {
 		return U'\0';
@@ -1,7 +1,15 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+
 #include "text_rendering.hpp"
 #include "buffer_utils.hpp"
 #include "nri.hpp"
 #include "resource_manager.hpp"
+#include "thread_pool.hpp"
 using namespace fxed;
 
 TextMesh::TextMesh(nri::NRI &nri, nri::CommandQueue &q, std::size_t maxCharCount)
@@ -44,41 +52,86 @@ TextMesh &TextMesh::operator=(TextMesh &&other) noexcept {
 	return *this;
 }
 
-TextMeshInstanced::TextMeshInstanced(nri::NRI &nri, nri::CommandQueue &q, std::size_t maxInstanceCount)
-	: instanceData(nullptr, 0) {
-	instanceBuffer = nri.createBuffer(maxInstanceCount * sizeof(InstanceData), nri::BUFFER_USAGE_VERTEX);
-	indexBuffer	   = nri.createBuffer(6 * sizeof(uint32_t), nri::BUFFER_USAGE_INDEX);
-
-	auto [offsets, memReq] = getBufferOffsets({instanceBuffer.get(), indexBuffer.get()});
-	memory = allocateBindMemory(nri, {instanceBuffer.get(), indexBuffer.get()}, nri::MEMORY_TYPE_UPLOAD);
+TextMeshInstanced::TextMeshInstanced(std::size_t maxInstanceCount)
+	: rowStarts(1, 0), rowWidths(1, 0.f), maxInstanceCount(maxInstanceCount), bounds(0, 0) {}
+
+std::span<const TextMeshInstanced::InstanceData> TextMeshInstanced::getInstances(std::size_t firstRow,
+																				std::size_t lastRow) const {
+	// to the rows laid out, counted from the first of them
+	firstRow = std::max(firstRow, this->firstRow) - this->firstRow;
+	lastRow	 = std::min(std::max(lastRow, this->firstRow) - this->firstRow, rowStarts.size());
+	if (firstRow >= lastRow) return {};
+	std::size_t first = rowStarts[firstRow];
+	std::size_t last  = lastRow < rowStarts.size() ? rowStarts[lastRow] : instanceData.size();
+	return std::span(instanceData).subspan(first, last - first);
+}
 
-	auto *instanceDataPtr = (InstanceData *)memory->map();
-	if (!instanceDataPtr) {
-		dbLog(dbg::LOG_ERROR, "Failed to map instance buffer for TextMeshInstanced");
-		THROW_RUNTIME_ERR("Failed to map instance buffer for TextMeshInstanced");
+void TextMeshInstanced::addHighlights(std::u32string_view line, std::size_t lineIndex, std::size_t begin,
+									  std::size_t end, fxed::FontAtlas &font, glm::vec4 color,
+									  std::vector<TextHighlight> &highlights) const {
+	if (lineIndex < firstLine || lineIndex - firstLine >= lineRows.size() || begin >= end) return;
+	// same wrapping as updateText
+	float		lineHeight = 1.2f;
+	std::size_t row		   = firstRow + lineRows[lineIndex - firstLine];
+	float		x		   = 0.f;
+	float		rangeStart = 0.f;
+
+	auto addQuad = [&]() { highlights.push_back({glm::vec2(rangeStart, row * lineHeight), x - rangeStart, color}); };
+	for (std::size_t i = 0; i < end && i < line.size(); ++i) {
+		if (i == begin) rangeStart = x;
+		if (line[i] == 0 || line[i] == 13) continue;
+		auto [box, index] = font.getGlyphBox(line[i]);
+		if (wrapWidth > 0 && x + box.advance >= wrapWidth) {
+			if (i > begin) addQuad();
+			++row;
+			x		   = 0.f;
+			rangeStart = 0.f;
+		}
+		if (index == -1) continue;
+		x += box.advance;
 	}
+	addQuad();
+}
 
-	// Fill index buffer with quad indices (0, 1, 2, 2, 3, 0)
-	uint32_t *indexData = (uint32_t *)((char *)instanceDataPtr + indexBuffer->getOffset());
-	indexData[0]		= 0;
-	indexData[1]		= 1;
-	indexData[2]		= 2;
-	indexData[3]		= 2;
-	indexData[4]		= 3;
-	indexData[5]		= 0;
-
-	instanceData = StaticVector<InstanceData>((InstanceData *)((char *)instanceDataPtr + instanceBuffer->getOffset()),
-											  maxInstanceCount);
-};
-
-void TextMeshInstanced::bind(nri::CommandBuffer &cmdBuffer) const {
-	instanceBuffer->bindAsVertexBuffer(cmdBuffer, 0, 0, sizeof(InstanceData));
-	indexBuffer->bindAsIndexBuffer(cmdBuffer, 0, nri::IndexType::INDEX_TYPE_UINT32);
+glm::vec2 TextMeshInstanced::getColumnPosition(std::u32string_view line, std::size_t lineIndex, std::size_t column,
+											  fxed::FontAtlas &font) const {
+	if (lineIndex < firstLine || lineIndex - firstLine >= lineRows.size()) return {0, 0};
+	float		lineHeight = 1.2f;
+	std::size_t row		   = firstRow + lineRows[lineIndex - firstLine];
+	float		x		   = 0.f;
+	for (std::size_t i = 0; i < column && i < line.size(); ++i) {
+		if (line[i] == 0 || line[i] == 13) continue;
+		auto [box, index] = font.getGlyphBox(line[i]);
+		if (wrapWidth > 0 && x + box.advance >= wrapWidth) {
+			++row;
+			x = 0.f;
+		}
+		if (index == -1) continue;
+		x += box.advance;
+	}
+	return {x, row * lineHeight};
 }
 
-void TextMeshInstanced::draw(nri::CommandBuffer &cmdBuffer, nri::GraphicsProgram &program) const {
-	if (instanceData.empty()) return;
-	program.drawIndexed(cmdBuffer, 6, instanceData.size(), 0, 0, 0);
+std::size_t TextMeshInstanced::getColumnAt(std::u32string_view line, std::size_t lineIndex, std::size_t row, float x,
+										   fxed::FontAtlas &font) const {
+	if (lineIndex < firstLine || lineIndex - firstLine >= lineRows.size()) return 0;
+	std::size_t currentRow = firstRow + lineRows[lineIndex - firstLine];
+	float		advance	   = 0.f;
+	for (std::size_t i = 0; i < line.size(); ++i) {
+		if (line[i] == 0 || line[i] == 13) continue;
+		auto [box, index] = font.getGlyphBox(line[i]);
+		if (wrapWidth > 0 && advance + box.advance >= wrapWidth) {
+			// the rest of the line is on the rows after
+			if (currentRow >= row) return i;
+			++currentRow;
+			advance = 0.f;
+		}
+		if (index == -1) continue;
+		// left of the middle of a glyph is before it
+		if (currentRow >= row && x < advance + box.advance / 2) return i;
+		advance += box.advance;
+	}
+	return line.size();
 }
 
 std::vector<nri::VertexBinding> TextMeshInstanced::getVertexBindings() {
@@ -88,8 +141,10 @@ std::vector<nri::VertexBinding> TextMeshInstanced::getVertexBindings() {
 			{0, nri::FORMAT_R32G32B32A32_SFLOAT, 0, nri::VertexInputRate::VERTEX_INPUT_RATE_INSTANCE, "COLOR"},
 			{1, nri::FORMAT_R32G32_SFLOAT, 4 * sizeof(float), nri::VertexInputRate::VERTEX_INPUT_RATE_INSTANCE,
 			 "TRANSLATION"},
-			{2, nri::FORMAT_R32G32_SINT, 6 * sizeof(float), nri::VertexInputRate::VERTEX_INPUT_RATE_INSTANCE,
-			 "CHAR_INDEX_DRAW_MODE"},
+			{2, nri::FORMAT_R32_SINT, offsetof(InstanceData, charIndex),
+			 nri::VertexInputRate::VERTEX_INPUT_RATE_INSTANCE, "CHAR_INDEX"},
+			{3, nri::FORMAT_R16G16_UINT, offsetof(InstanceData, drawMode),
+			 nri::VertexInputRate::VERTEX_INPUT_RATE_INSTANCE, "DRAW_MODE_INDEX"},
 		}}};
 }
 
@@ -102,61 +157,50 @@ struct PushConstants {
 	nri::ResourceHandle glyphGeometryBufferHandle;
 };
 
-struct PushConstantsCursor {
-	glm::ivec2 viewportSize;
-	glm::vec2  translation = {0, 0};
-	glm::vec2  cursorPos;
-	float	   textSize;
-	float	   time;
+struct PushConstantsBatched {
+	glm::ivec2			viewportSize;	  /// whole window
+	uint32_t			drawBase;		  /// index of the frame's first TextDraw in drawBufferHandle
+	float				textSize;
+	nri::ResourceHandle textureHandle;
+	nri::ResourceHandle glyphGeometryBufferHandle;
+	nri::ResourceHandle drawBufferHandle;
 };
 
-ResourceID TextRenderer::cursorMeshID	= ResourceID::invalid();
-ResourceID TextRenderer::shaderID		= ResourceID::invalid();
-ResourceID TextRenderer::cursorShaderID = ResourceID::invalid();
-ResourceID TextRenderer::shader_TWO_ID	= ResourceID::invalid();
+ResourceID TextRenderer::shaderID	   = ResourceID::invalid();
+ResourceID TextRenderer::shader_TWO_ID = ResourceID::invalid();
 
-TextRenderer::TextRenderer(nri::NRI &nri, nri::CommandQueue &queue, fxed::FontAtlas &&font)
+TextRenderer::TextRenderer(nri::NRI &nri, nri::CommandQueue &, fxed::FontAtlas &&font)
 	: font(std::move(font)), fontSize(this->font.getFontSize()) {
+	// the programs are independent, let the driver compile them in parallel
+	std::future<std::unique_ptr<nri::GraphicsProgram>> shaderFuture, shader_TWO_Future;
+
 	auto sb = nri.createProgramBuilder();
 	if (shaderID.invalid()) {
-		auto shader =
+		shaderFuture =
 			sb->addShaderModule(nri::ShaderCreateInfo{"shaders/text.hlsl", "VSMain", nri::SHADER_TYPE_VERTEX})
 				.addShaderModule(nri::ShaderCreateInfo{"shaders/text.hlsl", "PSMain", nri::SHADER_TYPE_FRAGMENT})
 				.setVertexBindings(fxed::TextMesh::getVertexBindings())
 				.setPrimitiveType(nri::PRIMITIVE_TYPE_TRIANGLES)
 				.setPushConstantRanges({{0, sizeof(PushConstants)}})
-				.buildGraphicsProgram();
-		shaderID = ResourceManager::getInstance().addShader(std::move(shader));
-	}
-
-	sb->clearShaderModules();
-	if (cursorShaderID.invalid()) {
-		auto cursorShader =
-			sb->addShaderModule(nri::ShaderCreateInfo{"shaders/cursor.hlsl", "VSMain", nri::SHADER_TYPE_VERTEX})
-				.addShaderModule(nri::ShaderCreateInfo{"shaders/cursor.hlsl", "PSMain", nri::SHADER_TYPE_FRAGMENT})
-				.setPushConstantRanges({{0, sizeof(PushConstantsCursor)}})
-				.buildGraphicsProgram();	 // this uses the same vertex bindings as the text shader
-
-		cursorShaderID = ResourceManager::getInstance().addShader(std::move(cursorShader));
+				.buildGraphicsProgramAsync();
 	}
 
 	sb->clearShaderModules();
 	if (shader_TWO_ID.invalid()) {
-		auto shader =
+		shader_TWO_Future =
 			sb->addShaderModule(nri::ShaderCreateInfo{"shaders/text_instanced.hlsl", "VSMain", nri::SHADER_TYPE_VERTEX})
 				.addShaderModule(
 					nri::ShaderCreateInfo{"shaders/text_instanced.hlsl", "PSMain", nri::SHADER_TYPE_FRAGMENT})
 				.setVertexBindings(fxed::TextMeshInstanced::getVertexBindings())
 				.setPrimitiveType(nri::PRIMITIVE_TYPE_TRIANGLES)
-				.setPushConstantRanges({{0, sizeof(PushConstants)}})
-				.buildGraphicsProgram();
-		shader_TWO_ID = ResourceManager::getInstance().addShader(std::move(shader));
+				.setPushConstantRanges({{0, sizeof(PushConstantsBatched)}})
+				.buildGraphicsProgramAsync();
 	}
 
-	if (cursorMeshID.invalid()) {
-		auto cursorMesh = std::make_unique<fxed::QuadMesh>(nri, queue, glm::vec2(0.1f, 1.0f));
-		cursorMeshID	= ResourceManager::getInstance().addMesh(std::move(cursorMesh));
-	}
+	auto &pool = ThreadPool::getInstance();
+	if (shaderFuture.valid()) shaderID = ResourceManager::getInstance().addShader(pool.await(shaderFuture));
+	if (shader_TWO_Future.valid())
+		shader_TWO_ID = ResourceManager::getInstance().addShader(pool.await(shader_TWO_Future));
 }
 
 float TextRenderer::getFontSize() const { return fontSize; }
@@ -183,54 +227,108 @@ void TextRenderer::renderText(nri::CommandBuffer &cmdBuf, const fxed::TextMesh &
 
 	textMesh.bind(cmdBuf);
 	textMesh.draw(cmdBuf, shader);
+}
+
+void TextRenderer::beginFrame(nri::Window &window) {
+	this->window = &window;
+	frameInstances.clear();
+	frameDraws.clear();
+}
+
+void TextRenderer::queueText(const fxed::TextMeshInstanced &textMesh, const TextRenderState &renderState) {
+	// rows are 1.2 em apart starting at translation.y, keep one extra row on each side for ascenders and descenders
+	float		rowHeight = 1.2f;
+	float		top		  = -renderState.translation.y;
+	float		bottom	  = top + renderState.viewportSize.y / fontSize;
+	std::size_t first	  = (std::size_t)std::max(std::floor(top / rowHeight) - 1, 0.f);
+	std::size_t last	  = (std::size_t)std::max(std::ceil(bottom / rowHeight) + 1, 0.f);
+	queueText(textMesh, renderState, first, last);
+}
+
+void TextRenderer::queueText(const fxed::TextMeshInstanced &textMesh, const TextRenderState &renderState,
+							 std::size_t firstRow, std::size_t lastRow) {
+	assert(window != nullptr && "TextRenderer::beginFrame was not called");
+	if (frameDraws.size() > std::numeric_limits<uint16_t>::max()) {
+		dbLog(dbg::LOG_WARNING, "Too many text draws in one frame, skipping");
+		return;
+	}
+	uint16_t  drawIndex = static_cast<uint16_t>(frameDraws.size());
+	glm::vec2 clipMin	= glm::vec2(renderState.viewportPosition);
+	glm::vec2 clipMax	= clipMin + glm::vec2(renderState.viewportSize);
+	frameDraws.push_back({
+		.origin		 = clipMin,
+		.translation = renderState.translation,
+		.clipRect	 = glm::vec4(clipMin, clipMax),
+	});
+
+	// highlights go first so the glyphs blend over them
+	for (const auto &highlight : renderState.highlights) {
+		frameInstances.push_back({
+			.color		 = highlight.color,
+			.translation = highlight.position,
+			.charIndex	 = std::bit_cast<int32_t>(highlight.width),
+			.drawMode	 = static_cast<uint16_t>(CharacterDrawMode::HIGHLIGHT),
+			.drawIndex	 = drawIndex,
+		});
+	}
+
+	auto instances = textMesh.getInstances(firstRow, lastRow);
+	frameInstances.reserve(frameInstances.size() + instances.size() + 1);
+	for (auto instance : instances) {
+		instance.drawIndex = drawIndex;
+		frameInstances.push_back(instance);
+	}
 
 	if (renderState.showCursor) {
-		PushConstantsCursor cursorPushConstants{.viewportSize = renderState.viewportSize,
-												.translation  = pushConstants.translation,
-												.cursorPos	  = renderState.cursorPos,
-												.textSize	  = pushConstants.textSize,
-												.time		  = 0};
-
-		auto &cursorShader = (nri::GraphicsProgram &)cursorShaderID;
-		cursorShader.bind(cmdBuf);
-		cursorShader.setPushConstants(cmdBuf, &cursorPushConstants, sizeof(cursorPushConstants), 0);
-		auto &cursorMesh = (fxed::Mesh &)cursorMeshID;
-		cursorMesh.bind(cmdBuf);
-		cursorMesh.draw(cmdBuf, cursorShader);
+		frameInstances.push_back({
+			.color		 = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f),
+			.translation = renderState.cursorPos,
+			.charIndex	 = -1,
+			.drawMode	 = static_cast<uint16_t>(CharacterDrawMode::CURSOR),
+			.drawIndex	 = drawIndex,
+		});
 	}
 }
 
-void TextRenderer::renderText(nri::CommandBuffer &cmdBuf, const fxed::TextMeshInstanced &textMesh,
-							  const TextRenderState &renderState) {
+void TextRenderer::flush(nri::CommandBuffer &cmdBuf) {
+	if (frameInstances.empty()) return;
+	assert(window != nullptr && "TextRenderer::beginFrame was not called");
+
+	static constexpr uint32_t quadIndices[] = {0, 1, 2, 2, 3, 0};
+
+	using InstanceData = TextMeshInstanced::InstanceData;
+
+	auto indices   = window->allocateUpload(sizeof(quadIndices), sizeof(uint32_t));
+	auto instances = window->allocateUpload(frameInstances.size() * sizeof(InstanceData), sizeof(InstanceData));
+	auto draws	   = window->allocateUpload(frameDraws.size() * sizeof(TextDraw), sizeof(TextDraw));
+	std::memcpy(indices.data, quadIndices, sizeof(quadIndices));
+	std::memcpy(instances.data, frameInstances.data(), frameInstances.size() * sizeof(InstanceData));
+	std::memcpy(draws.data, frameDraws.data(), frameDraws.size() * sizeof(TextDraw));
+
+	auto	   renderTarget = window->getCurrentRenderTarget();
+	glm::ivec2 windowSize(renderTarget.image.getWidth(), renderTarget.image.getHeight());
+
 	auto &shader = (nri::GraphicsProgram &)shader_TWO_ID;
 	shader.bind(cmdBuf);
 
-	PushConstants pushConstants{.viewportSize			   = renderState.viewportSize,
-								.translation			   = renderState.translation,
-								.textureHandle			   = font.getHandle(),
-								.textSize				   = fontSize,
-								.time					   = 0,
-								.glyphGeometryBufferHandle = font.getGlyphGeometryBufferHandle()};
-
+	PushConstantsBatched pushConstants{.viewportSize			  = windowSize,
+									   .drawBase				  = uint32_t(draws.offset / sizeof(TextDraw)),
+									   .textSize				  = fontSize,
+									   .textureHandle			  = font.getHandle(),
+									   .glyphGeometryBufferHandle = font.getGlyphGeometryBufferHandle(),
+									   .drawBufferHandle		  = draws.buffer->getHandle()};
 	shader.setPushConstants(cmdBuf, &pushConstants, sizeof(pushConstants), 0);
 
-	textMesh.bind(cmdBuf);
-	textMesh.draw(cmdBuf, shader);
+	// panes are clipped in the pixel shader, so the whole batch goes through one viewport
+	cmdBuf.setViewport(0, 0, windowSize.x, windowSize.y, 0.0f, 1.0f);
+	cmdBuf.setScissor(0, 0, windowSize.x, windowSize.y);
 
-	if (renderState.showCursor) {
-		PushConstantsCursor cursorPushConstants{.viewportSize = renderState.viewportSize,
-												.translation  = pushConstants.translation,
-												.cursorPos	  = renderState.cursorPos,
-												.textSize	  = pushConstants.textSize,
-												.time		  = 0};
-
-		auto &cursorShader = (nri::GraphicsProgram &)cursorShaderID;
-		cursorShader.bind(cmdBuf);
-		cursorShader.setPushConstants(cmdBuf, &cursorPushConstants, sizeof(cursorPushConstants), 0);
-		auto &cursorMesh = (fxed::Mesh &)cursorMeshID;
-		cursorMesh.bind(cmdBuf);
-		cursorMesh.draw(cmdBuf, cursorShader);
-	}
+	instances.buffer->bindAsVertexBuffer(cmdBuf, 0, instances.offset, sizeof(InstanceData));
+	indices.buffer->bindAsIndexBuffer(cmdBuf, indices.offset, nri::IndexType::INDEX_TYPE_UINT32);
+	shader.drawIndexed(cmdBuf, 6, frameInstances.size(), 0, 0, 0);
+
+	frameInstances.clear();
+	frameDraws.clear();
 }
 
 // glm::vec2 TextMesh::updateText(fxed::any_input_range<char32_t> &&text, fxed::FontAtlas &font, glm::ivec2
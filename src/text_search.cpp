@@ -0,0 +1,245 @@
+#include "text_search.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+	#include <immintrin.h>
+	#define FXED_AVX2_DISPATCH
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+using namespace fxed;
+
+// characters a regular expression steps through between two looks at the clock
+static constexpr std::size_t regexStepsPerCheck = 1 << 16;
+
+namespace {
+
+#ifdef FXED_AVX2_DISPATCH
+// the build targets baseline x86-64, AVX2 is only used where the CPU reports it
+bool hasAvx2() {
+	static const bool supported = [] {
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+	}();
+	return supported;
+}
+
+/// the AVX2 part of findInLine, checks starts from i on 8 at a time and leaves i at the first start it did not check
+template <class MiddleMatches>
+__attribute__((target("avx2"))) std::size_t findInLineAvx2(const char32_t *data, std::size_t &i, std::size_t end,
+														   std::u32string_view needle, MiddleMatches &&middleMatches) {
+	const __m256i first8 = _mm256_set1_epi32((int)needle.front());
+	const __m256i last8	 = _mm256_set1_epi32((int)needle.back());
+	std::size_t	  last	 = needle.size() - 1;
+	for (; i + 8 <= end; i += 8) {
+		__m256i	 a	  = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(data + i)), first8);
+		__m256i	 b	  = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(data + i + last)), last8);
+		uint32_t mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(a, b)));
+		for (; mask != 0; mask &= mask - 1) {
+			std::size_t candidate = i + std::countr_zero(mask);
+			if (middleMatches(candidate)) return candidate;
+		}
+	}
+	return std::u32string_view::npos;
+}
+
+/// the AVX2 part of findBytes, 32 starts at a time
+template <class MiddleMatches>
+__attribute__((target("avx2"))) std::size_t findBytesAvx2(const char *data, std::size_t &i, std::size_t end,
+														  std::string_view needle, MiddleMatches &&middleMatches) {
+	const __m256i first32 = _mm256_set1_epi8(needle.front());
+	const __m256i last32  = _mm256_set1_epi8(needle.back());
+	std::size_t	  last	  = needle.size() - 1;
+	for (; i + 32 <= end; i += 32) {
+		__m256i	 a	  = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i)), first32);
+		__m256i	 b	  = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i + last)), last32);
+		uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(a, b));
+		for (; mask != 0; mask &= mask - 1) {
+			std::size_t candidate = i + std::countr_zero(mask);
+			if (middleMatches(candidate)) return candidate;
+		}
+	}
+	return std::string_view::npos;
+}
+#endif
+
+}	  // namespace
+
+std::size_t fxed::findInLine(std::u32string_view haystack, std::u32string_view needle, std::size_t from) {
+	constexpr auto npos = std::u32string_view::npos;
+	if (needle.empty()) return from <= haystack.size() ? from : npos;
+	if (haystack.size() < needle.size() || from > haystack.size() - needle.size()) return npos;
+
+	const char32_t *data = haystack.data();
+	std::size_t		last = needle.size() - 1;
+	std::size_t		end	 = haystack.size() - last;	   // one past the last possible start
+	// the first and last characters are already known to match
+	auto middleMatches = [&](std::size_t i) {
+		return needle.size() <= 2 || std::memcmp(data + i + 1, needle.data() + 1, (needle.size() - 2) * 4) == 0;
+	};
+
+	std::size_t i = from;
+#ifdef FXED_AVX2_DISPATCH
+	if (hasAvx2()) {
+		if (std::size_t found = findInLineAvx2(data, i, end, needle, middleMatches); found != npos) return found;
+	}
+#endif
+#if defined(__SSE2__)
+	// without AVX2 this does the whole line, with it only the last few starts
+	const __m128i first4 = _mm_set1_epi32((int)needle.front());
+	const __m128i last4	 = _mm_set1_epi32((int)needle.back());
+	for (; i + 4 <= end; i += 4) {
+		__m128i	 a	  = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(data + i)), first4);
+		__m128i	 b	  = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(data + i + last)), last4);
+		uint32_t mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(a, b)));
+		for (; mask != 0; mask &= mask - 1) {
+			std::size_t candidate = i + std::countr_zero(mask);
+			if (middleMatches(candidate)) return candidate;
+		}
+	}
+#endif
+	for (; i < end; ++i) {
+		if (data[i] == needle.front() && data[i + last] == needle.back() && middleMatches(i)) return i;
+	}
+	return npos;
+}
+
+std::size_t fxed::findBytes(std::string_view haystack, std::string_view needle, std::size_t from) {
+	constexpr auto npos = std::string_view::npos;
+	if (needle.empty()) return from <= haystack.size() ? from : npos;
+	if (haystack.size() < needle.size() || from > haystack.size() - needle.size()) return npos;
+
+	const char *data = haystack.data();
+	std::size_t last = needle.size() - 1;
+	std::size_t end	 = haystack.size() - last;
+
+	auto middleMatches = [&](std::size_t i) {
+		return needle.size() <= 2 || std::memcmp(data + i + 1, needle.data() + 1, needle.size() - 2) == 0;
+	};
+
+	std::size_t i = from;
+#ifdef FXED_AVX2_DISPATCH
+	if (hasAvx2()) {
+		if (std::size_t found = findBytesAvx2(data, i, end, needle, middleMatches); found != npos) return found;
+	}
+#endif
+#if defined(__SSE2__)
+	const __m128i first16 = _mm_set1_epi8(needle.front());
+	const __m128i last16  = _mm_set1_epi8(needle.back());
+	for (; i + 16 <= end; i += 16) {
+		__m128i	 a	  = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i)), first16);
+		__m128i	 b	  = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i + last)), last16);
+		uint32_t mask = _mm_movemask_epi8(_mm_and_si128(a, b));
+		for (; mask != 0; mask &= mask - 1) {
+			std::size_t candidate = i + std::countr_zero(mask);
+			if (middleMatches(candidate)) return candidate;
+		}
+	}
+#endif
+	for (; i < end; ++i) {
+		if (data[i] == needle.front() && data[i + last] == needle.back() && middleMatches(i)) return i;
+	}
+	return npos;
+}
+
+void TextSearch::setQuery(std::u32string_view newQuery, bool isRegex) {
+	if (newQuery == query && isRegex == regexMode) return;
+	if (isRegex || regexMode) {
+		query	  = newQuery;
+		regexMode = isRegex;
+		regex.reset();
+		error.clear();
+		if (regexMode && !query.empty()) {
+			try {
+				regex.emplace(query);
+			} catch (const std::runtime_error &e) {
+				error = e.what();
+			}
+		}
+		restart();
+		return;
+	}
+	// every match of the longer query starts at a match of the shorter one
+	bool extends = !query.empty() && newQuery.starts_with(query);
+	query		 = newQuery;
+	if (!extends) {
+		restart();
+		return;
+	}
+	candidates.erase(candidates.begin(), candidates.begin() + nextCandidate);
+	candidates.insert(candidates.begin(), matches.begin(), matches.end());
+	nextCandidate = 0;
+	matches.clear();
+	done = false;
+}
+
+void TextSearch::restart() {
+	matches.clear();
+	candidates.clear();
+	nextCandidate = 0;
+	nextLine	  = 0;
+	nextColumn	  = 0;
+	done		  = query.empty() || (regexMode && !regex);
+}
+
+bool TextSearch::step(const TextStateBase &text, std::chrono::microseconds budget) {
+	if (done) return false;
+	auto		start	  = std::chrono::steady_clock::now();
+	auto		outOfTime = [&]() { return std::chrono::steady_clock::now() - start >= budget; };
+	std::size_t found	  = matches.size();
+
+	// candidates come from lines before nextLine, so checking them first keeps the matches sorted
+	while (nextCandidate < candidates.size()) {
+		std::size_t batchEnd = std::min(candidates.size(), nextCandidate + 4096);
+		for (; nextCandidate < batchEnd; ++nextCandidate) {
+			auto candidate = candidates[nextCandidate];
+			if (candidate.line >= text.getLineCount()) continue;
+			std::u32string_view line = text.getLine(candidate.line);
+			if (line.substr(candidate.column).starts_with(query)) {
+				matches.push_back({candidate.line, candidate.column, (uint32_t)query.size()});
+			}
+		}
+		if (outOfTime()) return matches.size() != found;
+	}
+	candidates.clear();
+	nextCandidate = 0;
+
+	std::size_t lineCount = text.getLineCount();
+	while (nextLine < lineCount) {
+		std::size_t batchEnd = std::min(lineCount, nextLine + 256);
+		for (; nextLine < batchEnd; ++nextLine) {
+			std::u32string_view line = text.getLine(nextLine);
+			if (regex) {
+				// one line can take long on its own, it is matched in slices with the time checked in between
+				do {
+					lineMatches.clear();
+					nextColumn = regex->findAll(line, lineMatches, nextColumn, regexStepsPerCheck);
+					for (auto [begin, end] : lineMatches) {
+						matches.push_back({(uint32_t)nextLine, begin, end - begin});
+					}
+					if (nextColumn != std::u32string_view::npos && outOfTime()) return matches.size() != found;
+				} while (nextColumn != std::u32string_view::npos);
+				nextColumn = 0;
+				continue;
+			}
+			for (std::size_t column = findInLine(line, query); column != std::u32string_view::npos;
+				 column = findInLine(line, query, column + 1)) {
+				matches.push_back({(uint32_t)nextLine, (uint32_t)column, (uint32_t)query.size()});
+			}
+		}
+		if (outOfTime()) return matches.size() != found;
+	}
+	done = true;
+	return matches.size() != found;
+}
+
+std::span<const TextMatch> TextSearch::getMatches(std::size_t firstLine, std::size_t lastLine) const {
+	auto begin = std::ranges::lower_bound(matches, firstLine, {}, &TextMatch::line);
+	auto end   = std::ranges::lower_bound(begin, matches.end(), lastLine, {}, &TextMatch::line);
+	return {begin, end};
+}
@@ -0,0 +1,105 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+using namespace fxed;
+
+static thread_local std::size_t currentWorker = SIZE_MAX;
+
+ThreadPool::ThreadPool(unsigned int threadCount) {
+	if (threadCount == 0) threadCount = std::clamp(std::thread::hardware_concurrency(), 2u, 8u) - 1;
+
+	queues.reserve(threadCount);
+	for (unsigned int i = 0; i < threadCount; ++i) {
+		queues.push_back(std::make_unique<WorkQueue>());
+	}
+	threads.reserve(threadCount);
+	for (unsigned int i = 0; i < threadCount; ++i) {
+		threads.emplace_back([this, i]() { workerLoop(i); });
+	}
+	dbLog(dbg::LOG_DEBUG, "Started thread pool with ", threadCount, " workers");
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard lock(sleepMutex);
+		stopping = true;
+	}
+	wakeUp.notify_all();
+	threads.clear();
+}
+
+ThreadPool &ThreadPool::getInstance() {
+	static ThreadPool instance;
+	return instance;
+}
+
+void ThreadPool::execute(std::function<void()> &&task) {
+	std::size_t index = currentWorker < queues.size() ? currentWorker : nextQueue++ % queues.size();
+	{
+		std::lock_guard lock(queues[index]->mutex);
+		queues[index]->tasks.push_back(std::move(task));
+	}
+	{
+		std::lock_guard lock(sleepMutex);
+		++pendingCount;
+	}
+	wakeUp.notify_one();
+}
+
+bool ThreadPool::popTask(std::size_t preferredQueue, std::function<void()> &task, bool steal) {
+	// own queue is LIFO for locality, stealing takes the oldest task
+	if (preferredQueue < queues.size()) {
+		auto		   &queue = *queues[preferredQueue];
+		std::lock_guard lock(queue.mutex);
+		if (!queue.tasks.empty()) {
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+			--pendingCount;
+			return true;
+		}
+	}
+	if (!steal) return false;
+	for (std::size_t i = 0; i < queues.size(); ++i) {
+		auto &queue = *queues[(preferredQueue + i + 1) % queues.size()];
+		if (!queue.mutex.try_lock()) continue;
+		std::lock_guard lock(queue.mutex, std::adopt_lock);
+		if (!queue.tasks.empty()) {
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			--pendingCount;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ThreadPool::runPendingTask() {
+	std::function<void()> task;
+	if (currentWorker >= queues.size() || !popTask(currentWorker, task, false)) return false;
+	task();
+	return true;
+}
+
+void ThreadPool::workerLoop(std::size_t index) {
+	currentWorker = index;
+	while (true) {
+		std::function<void()> task;
+		if (popTask(index, task)) {
+			try {
+				task();
+			} catch (const std::exception &e) {
+				dbLog(dbg::LOG_ERROR, "Uncaught exception in thread pool task: ", e.what());
+			}
+			continue;
+		}
+
+		std::unique_lock lock(sleepMutex);
+		if (stopping) return;
+		// a failed try_lock can miss a task, so sleep with a timeout instead of indefinitely
+		wakeUp.wait_for(lock, std::chrono::milliseconds(50), [this]() { return stopping || pendingCount > 0; });
+		if (stopping) return;
+	}
+}
@@ -0,0 +1,236 @@
+#include "visual_rows.hpp"
+
+#include <algorithm>
+#include <optional>
+
+#include "thread_pool.hpp"
+
+using namespace fxed;
+
+// The same wrapping as TextMeshInstanced::updateText. glyph(c) gives the advance of a code point and whether it moves
+// the next one at all, or nothing if it cannot be measured.
+template <class GlyphFn>
+static std::optional<uint32_t> wrappedRows(std::u32string_view line, float wrapWidth, GlyphFn &&glyph) {
+	if (wrapWidth <= 0) return 1;
+	uint32_t rows = 1;
+	double	 x	  = 0.0;
+	for (char32_t c : line) {
+		if (c == 0 || c == 13) continue;
+		auto advance = glyph(c);
+		if (!advance) return std::nullopt;
+		if (x + advance->first >= wrapWidth) {
+			++rows;
+			x = 0.0;
+		}
+		if (advance->second) x += advance->first;
+	}
+	return rows;
+}
+
+/// joins touching and overlapping ranges of a sorted list
+static void mergeRanges(std::vector<std::pair<std::size_t, std::size_t>> &ranges) {
+	std::size_t count = 0;
+	for (auto range : ranges) {
+		if (count > 0 && range.first <= ranges[count - 1].second) {
+			ranges[count - 1].second = std::max(ranges[count - 1].second, range.second);
+		} else {
+			ranges[count++] = range;
+		}
+	}
+	ranges.resize(count);
+}
+
+VisualRows::~VisualRows() {
+	for (auto &chunk : inFlight) {
+		chunk->cancelled = true;
+	}
+}
+
+uint32_t VisualRows::countRows(std::u32string_view line, FontAtlas &font) const {
+	return *wrappedRows(line, wrapWidth, [&](char32_t c) {
+		auto [box, index] = font.getGlyphBox(c);
+		return std::optional(std::pair(box.advance, index != -1));
+	});
+}
+
+void VisualRows::reset(const TextStateBase &text, FontAtlas &font, float wrapWidth, uint32_t fontVersion) {
+	for (auto &chunk : inFlight) {
+		chunk->cancelled = true;
+	}
+	inFlight.clear();
+	stale.clear();
+	this->wrapWidth	  = wrapWidth;
+	this->fontVersion = fontVersion;
+
+	// the old counts are the best guess until the new ones arrive, unless they belong to another text
+	std::size_t lineCount = text.getLineCount();
+	if (wrapWidth == 0 || rows.getLineCount() != lineCount) rows.assign(std::vector<uint32_t>(lineCount, 1));
+	if (wrapWidth == 0) return;
+
+	auto advances = std::make_shared<AsciiAdvances>();
+	advances->fill(-1.f);
+	for (char32_t c = 32; c < 127; ++c) {
+		auto [box, index] = font.getGlyphBox(c);
+		if (index != -1) (*advances)[c] = box.advance;
+	}
+	auto [tabBox, tabIndex] = font.getGlyphBox(U'\t');
+	if (tabIndex != -1) (*advances)[U'\t'] = tabBox.advance;
+	asciiAdvances = std::move(advances);
+	stale.push_back({0, lineCount});
+}
+
+bool VisualRows::collect(FontAtlas &font) {
+	std::vector<std::shared_ptr<Chunk>> chunks;
+	{
+		std::lock_guard lock(finished->mutex);
+		chunks.swap(finished->chunks);
+	}
+	bool changed = false;
+	for (auto &chunk : chunks) {
+		// cancelled chunks were already dropped from inFlight when their lines were edited
+		if (chunk->cancelled) continue;
+		std::erase(inFlight, chunk);
+		for (std::size_t i = 0; i < chunk->lines.size(); ++i) {
+			if (chunk->rows[i] == 0) chunk->rows[i] = countRows(chunk->lines[i], font);
+			changed = changed || chunk->rows[i] != rows.getLineLength(chunk->first + i);
+		}
+		rows.replace(chunk->first, chunk->rows.size(), chunk->rows);
+	}
+	return changed;
+}
+
+void VisualRows::dispatch(const TextStateBase &text) {
+	// enough to keep every worker busy between two frames, without copying out the whole text at once
+	std::size_t maxInFlight = 2 * ThreadPool::getInstance().getThreadCount();
+	while (inFlight.size() < maxInFlight && !stale.empty()) {
+		auto	   &range = stale.front();
+		auto		chunk = std::make_shared<Chunk>();
+		std::size_t size  = 0;
+		chunk->first	  = range.first;
+		while (range.first < range.second && chunk->lines.size() < chunkLines && size < chunkCodePoints) {
+			chunk->lines.push_back(text.getLine(range.first++));
+			size += chunk->lines.back().size();
+		}
+		if (range.first == range.second) stale.erase(stale.begin());
+		inFlight.push_back(chunk);
+
+		ThreadPool::getInstance().execute([chunk, finished = finished, advances = asciiAdvances, width = wrapWidth]() {
+			if (chunk->cancelled) return;
+			chunk->rows.reserve(chunk->lines.size());
+			for (const auto &line : chunk->lines) {
+				auto rows = wrappedRows(line, width, [&](char32_t c) -> std::optional<std::pair<float, bool>> {
+					if (c >= advances->size() || (*advances)[c] < 0) return std::nullopt;
+					return std::pair((*advances)[c], true);
+				});
+				chunk->rows.push_back(rows.value_or(0));
+			}
+			std::lock_guard lock(finished->mutex);
+			finished->chunks.push_back(chunk);
+		});
+	}
+}
+
+void VisualRows::edit(const TextStateBase &text, const LineEdit &edit, FontAtlas &font) {
+	// counts for another text are replaced by the next update anyway
+	if (rows.getLineCount() + edit.inserted != text.getLineCount() + edit.removed) return;
+	std::size_t editEnd = edit.first + edit.removed;
+	int64_t		delta	= (int64_t)edit.inserted - edit.removed;
+
+	// the parts of a range outside of the edit, in the line numbers after it
+	std::vector<std::pair<std::size_t, std::size_t>> ranges;
+	auto keepOutside = [&](std::size_t first, std::size_t last) {
+		if (first < edit.first) ranges.push_back({first, std::min<std::size_t>(last, edit.first)});
+		if (last > editEnd) ranges.push_back({std::max(first, editEnd) + delta, last + delta});
+	};
+	for (auto [first, last] : stale) {
+		keepOutside(first, last);
+	}
+	// chunks after the edit only move, the ones it touches are measured again without the edited lines
+	std::erase_if(inFlight, [&](const std::shared_ptr<Chunk> &chunk) {
+		std::size_t last = chunk->first + chunk->lines.size();
+		if (last <= edit.first) return false;
+		if (chunk->first >= editEnd) {
+			chunk->first += delta;
+			return false;
+		}
+		chunk->cancelled = true;
+		keepOutside(chunk->first, last);
+		return true;
+	});
+
+	std::vector<uint32_t> counts(edit.inserted, 1);
+	if (edit.inserted <= maxMeasuredEdit) {
+		for (uint32_t i = 0; i < edit.inserted; ++i) {
+			counts[i] = countRows(text.getLine(edit.first + i), font);
+		}
+	} else if (wrapWidth > 0) {
+		ranges.push_back({edit.first, edit.first + edit.inserted});
+	}
+	rows.replace(edit.first, edit.removed, counts);
+	std::ranges::sort(ranges);
+	mergeRanges(ranges);
+	stale = std::move(ranges);
+}
+
+bool VisualRows::update(const TextStateBase &text, FontAtlas &font, float lineWidth, uint32_t fontVersion) {
+	float width	  = lineWidth > 0 ? lineWidth / font.getFontSize() : 0;
+	bool  changed = false;
+	if (width != wrapWidth || fontVersion != this->fontVersion || rows.getLineCount() != text.getLineCount()) {
+		reset(text, font, width, fontVersion);
+		changed = true;
+	}
+	changed = collect(font) || changed;
+	dispatch(text);
+	return changed;
+}
+
+bool VisualRows::measure(const TextStateBase &text, std::size_t first, std::size_t last, FontAtlas &font) {
+	last = std::min(last, rows.getLineCount());
+	if (first >= last || !isMeasuring()) return false;
+
+	// lines waiting for a worker or still with one, a chunk that finishes later brings the same counts
+	std::vector<std::pair<std::size_t, std::size_t>> ranges;
+	for (auto [rangeFirst, rangeLast] : stale) {
+		ranges.push_back({std::max(rangeFirst, first), std::min(rangeLast, last)});
+	}
+	for (auto &chunk : inFlight) {
+		ranges.push_back({std::max(chunk->first, first), std::min(chunk->first + chunk->lines.size(), last)});
+	}
+	bool changed = false;
+	for (auto [rangeFirst, rangeLast] : ranges) {
+		if (rangeFirst >= rangeLast) continue;
+		std::vector<uint32_t> counts;
+		counts.reserve(rangeLast - rangeFirst);
+		for (std::size_t line = rangeFirst; line < rangeLast; ++line) {
+			counts.push_back(countRows(text.getLine(line), font));
+			changed = changed || counts.back() != rows.getLineLength(line);
+		}
+		rows.replace(rangeFirst, counts.size(), counts);
+	}
+
+	std::vector<std::pair<std::size_t, std::size_t>> rest;
+	for (auto [rangeFirst, rangeLast] : stale) {
+		if (rangeFirst < first) rest.push_back({rangeFirst, std::min(rangeLast, first)});
+		if (rangeLast > last) rest.push_back({std::max(rangeFirst, last), rangeLast});
+	}
+	stale = std::move(rest);
+	return changed;
+}
+
+glm::vec2 VisualRows::getColumnPosition(std::u32string_view line, std::size_t lineIndex, std::size_t column,
+										FontAtlas &font) const {
+	float		lineHeight = 1.2f;
+	std::size_t row		   = lineToRow(lineIndex);
+	float		x		   = 0.f;
+	for (std::size_t i = 0; i < column && i < line.size(); ++i) {
+		if (line[i] == 0 || line[i] == 13) continue;
+		auto [box, index] = font.getGlyphBox(line[i]);
+		if (wrapWidth > 0 && x + box.advance >= wrapWidth) {
+			++row;
+			x = 0.f;
+		}
+		if (index == -1) continue;
+		x += box.advance;
+	}
+	return {x, row * lineHeight};
+}
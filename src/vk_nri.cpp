@@ -1,4 +1,6 @@
 #include "vk_nri.hpp"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <ostream>
 #include <fstream>
@@ -24,6 +26,8 @@
 #endif
 
 #include "dxc_include_handler.hpp"
+#include "file_utils.hpp"
+#include "thread_pool.hpp"
 #include "nriFactory.hpp"
 #include "nri.hpp"
 
@@ -324,7 +328,8 @@ VulkanNRI::VulkanNRI(CreateBits createBits)
 	  physicalDevice(),
 	  device(),
 	  defaultCommandPool(nullptr),
-	  descriptorAllocator(std::nullopt) {
+	  descriptorAllocator(std::nullopt),
+	  pipelineCache(nullptr) {
 	if (createBits & CreateBits::GLFW) { prepareGLFW(); }
 
 	createInstance();
@@ -334,6 +339,8 @@ VulkanNRI::VulkanNRI(CreateBits createBits)
 	auto dcp		   = createCommandPool();
 	defaultCommandPool = std::move(static_cast<VulkanCommandPool &>(*dcp));
 	descriptorAllocator.emplace(*this);
+	memoryAllocator = std::make_shared<VulkanMemoryAllocator>(*this);
+	createPipelineCache();
 
 	vk::PhysicalDeviceProperties physicalDeviceProperties;
 	vkGetPhysicalDeviceProperties(physicalDevice, &*physicalDeviceProperties);
@@ -342,8 +349,62 @@ VulkanNRI::VulkanNRI(CreateBits createBits)
 
 VulkanNRI::~VulkanNRI() {
 	vkDeviceWaitIdle(device);
+	savePipelineCache();
 	// VulkanMemoryCache::destroy();
 }
+std::filesystem::path VulkanNRI::getPipelineCachePath() const {
+	const auto &cacheDir = fxed::getCacheDirectory();
+	if (cacheDir.empty()) return {};
+
+	// the driver rejects data from another device or driver version anyway, keying the file by its UUID keeps
+	// caches for multiple GPUs from overwriting each other
+	vk::PhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &*properties);
+	std::string uuid;
+	for (uint8_t byte : properties.pipelineCacheUUID) {
+		const char *digits = "0123456789abcdef";
+		uuid += digits[byte >> 4];
+		uuid += digits[byte & 0xf];
+	}
+	return cacheDir / ("pipelines_" + uuid + ".bin");
+}
+
+void VulkanNRI::createPipelineCache() {
+	auto			 path = getPipelineCachePath();
+	fxed::MappedFile file;
+	if (!path.empty()) file = fxed::MappedFile(path);
+
+	vk::PipelineCacheCreateInfo cacheInfo({}, file.getSize(), file.getData());
+	vk::PipelineCache			cache	 = nullptr;
+	vk::Result result = (vk::Result)vkCreatePipelineCache(device, &*cacheInfo, nullptr, (VkPipelineCache *)&cache);
+	if (result != vk::Result::eSuccess && file.isOpen()) {
+		// a corrupt file must not keep the editor from starting, start with an empty cache instead
+		dbLog(dbg::LOG_WARNING, "Discarding pipeline cache ", path, ": ", vk::to_string(result));
+		cacheInfo = vk::PipelineCacheCreateInfo();
+		result	  = (vk::Result)vkCreatePipelineCache(device, &*cacheInfo, nullptr, (VkPipelineCache *)&cache);
+	}
+	if (result != vk::Result::eSuccess) {
+		dbLog(dbg::LOG_WARNING, "Failed to create pipeline cache: ", vk::to_string(result));
+		return;
+	}
+	if (file.isOpen()) dbLog(dbg::LOG_INFO, "Loaded ", file.getSize(), " bytes of pipeline cache from ", path);
+	pipelineCache = vkraii::PipelineCache(device.device, cache);
+}
+
+void VulkanNRI::savePipelineCache() const {
+	if (pipelineCache == nullptr) return;
+	auto path = getPipelineCachePath();
+	if (path.empty()) return;
+
+	std::size_t size = 0;
+	vkGetPipelineCacheData(device, *pipelineCache, &size, nullptr);
+	std::vector<char> data(size);
+	if (size == 0 || vkGetPipelineCacheData(device, *pipelineCache, &size, data.data()) != VK_SUCCESS) return;
+	data.resize(size);
+
+	if (fxed::writeFileAtomic(path, data)) dbLog(dbg::LOG_INFO, "Saved ", size, " bytes of pipeline cache to ", path);
+}
+
 VulkanDescriptorAllocator::VulkanDescriptorAllocator(VulkanNRI &nri)
 	: nri(nri), pool(nullptr), descriptorSetLayout(nullptr), bigDescriptorSet(nullptr) {
 	// query the maximum number of descriptors we can allocate for each type
@@ -472,48 +533,169 @@ vk::MemoryPropertyFlags typeRequest2vkMemoryProperty[] = {
 	vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
 	vk::MemoryPropertyFlagBits::eDeviceLocal};
 
-VulkanAllocation::VulkanAllocation(VulkanNRI &nri, MemoryRequirements memoryRequirements)
-	: memory(nullptr), device(nri.getDevice()), size(memoryRequirements.size) {
-	assert(memoryRequirements.typeRequest >= 0);
-	assert(memoryRequirements.typeRequest < MemoryTypeRequest::_MEMORY_TYPE_NUM);
-	vk::MemoryPropertyFlags properties = typeRequest2vkMemoryProperty[(uint32_t)memoryRequirements.typeRequest];
-
-	vk::PhysicalDeviceMemoryProperties memProperties;
-	vkGetPhysicalDeviceMemoryProperties(nri.getPhysicalDevice(), &*memProperties);
-
-	uint32_t memoryTypeIndex = -1;
-	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-		if ((memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-			memoryTypeIndex = i;
-			break;
+VulkanMemoryAllocator::VulkanMemoryAllocator(VulkanNRI &nri) : device(nri.getDevice()) {
+	vkGetPhysicalDeviceMemoryProperties(nri.getPhysicalDevice(), &*memoryProperties);
+
+	// buffers and images share blocks, keep them apart by the linear/optimal granularity
+	vk::PhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(nri.getPhysicalDevice(), &*properties);
+	granularity = std::max<std::size_t>(properties.limits.bufferImageGranularity, 1);
+}
+
+uint32_t VulkanMemoryAllocator::findMemoryType(MemoryTypeRequest typeRequest) const {
+	assert(typeRequest >= 0);
+	assert(typeRequest < MemoryTypeRequest::_MEMORY_TYPE_NUM);
+	vk::MemoryPropertyFlags properties = typeRequest2vkMemoryProperty[(uint32_t)typeRequest];
+
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		if ((memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) return i;
+	}
+	throw std::runtime_error("Failed to find suitable memory type!");
+}
+
+VulkanMemoryAllocator::Block *VulkanMemoryAllocator::createBlock(uint32_t memoryTypeIndex, std::size_t size) {
+	vk::MemoryAllocateFlagsInfo allocFlagsInfo(vk::MemoryAllocateFlagBits::eDeviceAddress, {});
+	vk::MemoryAllocateInfo		allocInfo(size, memoryTypeIndex, &allocFlagsInfo);
+
+	vk::DeviceMemory allocatedMemory = nullptr;
+	vk::Result		 result =
+		(vk::Result)vkAllocateMemory(device, &*allocInfo, nullptr, (VkDeviceMemory *)&allocatedMemory);
+	if (result != vk::Result::eSuccess) {
+		dbLog(dbg::LOG_ERROR, "Failed to allocate ", size, " bytes of device memory: ", vk::to_string(result));
+		throw std::runtime_error("Failed to allocate device memory!");
+	}
+
+	auto block			   = std::make_unique<Block>();
+	block->memoryTypeIndex = memoryTypeIndex;
+	block->memory		   = vkraii::DeviceMemory(device, allocatedMemory);
+	block->size			   = size;
+	block->freeRanges[0]   = size;
+	auto propertyFlags	   = memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+	if (propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible) {
+		void *data = nullptr;
+		vkMapMemory(device, allocatedMemory, 0, VK_WHOLE_SIZE, 0, &data);
+		if (data == nullptr) { throw std::runtime_error("Failed to map memory!"); }
+		block->mapped = (char *)data;
+	}
+	dbLog(dbg::LOG_DEBUG, "Allocated memory block of ", size, " bytes with memory type ", memoryTypeIndex);
+
+	blocks.push_back(std::move(block));
+	return blocks.back().get();
+}
+
+VulkanMemoryAllocator::Range VulkanMemoryAllocator::allocate(const MemoryRequirements &memoryRequirements) {
+	uint32_t	memoryTypeIndex = findMemoryType(memoryRequirements.typeRequest);
+	std::size_t alignment		= std::max(memoryRequirements.alignment, granularity);
+	std::size_t size			= (memoryRequirements.size + granularity - 1) / granularity * granularity;
+
+	std::lock_guard lock(mutex);
+
+	// best fit over all free ranges of the memory type, so small meshes fill the holes left by closed tabs
+	Range		bestRange;
+	std::size_t bestWaste = SIZE_MAX;
+	for (auto &block : blocks) {
+		if (block->memoryTypeIndex != memoryTypeIndex) continue;
+		for (auto [offset, freeSize] : block->freeRanges) {
+			std::size_t alignedOffset = (offset + alignment - 1) / alignment * alignment;
+			if (alignedOffset + size > offset + freeSize) continue;
+			std::size_t waste = freeSize - size;
+			if (waste < bestWaste) {
+				bestRange = {block.get(), alignedOffset, size};
+				bestWaste = waste;
+			}
+		}
+	}
+	// allocations larger than a block get a block of their own
+	if (bestRange.block == nullptr) {
+		auto *block = createBlock(memoryTypeIndex, std::max(BLOCK_SIZE, size));
+		bestRange	= {block, 0, size};
+	}
+
+	// carve the range out of its free range, keeping what is left on either side
+	auto	   &freeRanges = bestRange.block->freeRanges;
+	auto		it		   = std::prev(freeRanges.upper_bound(bestRange.offset));
+	std::size_t freeOffset = it->first;
+	std::size_t freeEnd	   = it->first + it->second;
+	std::size_t rangeEnd   = bestRange.offset + bestRange.size;
+	freeRanges.erase(it);
+	if (bestRange.offset > freeOffset) freeRanges[freeOffset] = bestRange.offset - freeOffset;
+	if (rangeEnd < freeEnd) freeRanges[rangeEnd] = freeEnd - rangeEnd;
+	bestRange.block->usedSize += bestRange.size;
+
+	return bestRange;
+}
+
+void VulkanMemoryAllocator::free(const Range &range) {
+	std::lock_guard lock(mutex);
+	auto		   &freeRanges = range.block->freeRanges;
+
+	// merge with the neighbouring free ranges so the block does not fragment over time
+	std::size_t offset = range.offset;
+	std::size_t size   = range.size;
+	auto		next   = freeRanges.lower_bound(offset);
+	if (next != freeRanges.begin()) {
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == offset) {
+			offset = prev->first;
+			size += prev->second;
+			freeRanges.erase(prev);
 		}
 	}
+	if (next != freeRanges.end() && next->first == range.offset + range.size) {
+		size += next->second;
+		freeRanges.erase(next);
+	}
+	freeRanges[offset] = size;
+	range.block->usedSize -= range.size;
+
+	if (range.block->usedSize != 0) return;
+	// keep one empty block per memory type around, release the rest
+	bool hasOtherEmpty = std::ranges::any_of(blocks, [&](const auto &block) {
+		return block.get() != range.block && block->usedSize == 0 &&
+			   block->memoryTypeIndex == range.block->memoryTypeIndex;
+	});
+	if (hasOtherEmpty || range.block->size != BLOCK_SIZE) {
+		std::erase_if(blocks, [&](const auto &block) { return block.get() == range.block; });
+	}
+}
 
-	if (memoryTypeIndex == -1u) { throw std::runtime_error("Failed to find suitable memory type!"); }
+VulkanAllocation::VulkanAllocation(VulkanNRI &nri, MemoryRequirements memoryRequirements)
+	: allocator(nri.getMemoryAllocator()), device(nri.getDevice()), size(memoryRequirements.size) {
+	range = allocator->allocate(memoryRequirements);
+}
 
-	vk::MemoryAllocateFlagsInfo allocFlagsInfo(vk::MemoryAllocateFlagBits::eDeviceAddress, {});
-	vk::MemoryAllocateInfo		allocInfo(memoryRequirements.size, memoryTypeIndex, &allocFlagsInfo);
+VulkanAllocation::VulkanAllocation(VulkanAllocation &&other) noexcept
+	: allocator(std::move(other.allocator)), range(other.range), device(other.device), size(other.size) {
+	other.range = {};
+}
+
+VulkanAllocation &VulkanAllocation::operator=(VulkanAllocation &&other) noexcept {
+	if (this != &other) {
+		if (range.block != nullptr) allocator->free(range);
+		allocator	= std::move(other.allocator);
+		range		= other.range;
+		device		= other.device;
+		size		= other.size;
+		other.range = {};
+	}
+	return *this;
+}
 
-	vk::DeviceMemory allocatedMemory;
-	vkAllocateMemory(nri.getDevice(), &*allocInfo, nullptr, (VkDeviceMemory *)&allocatedMemory);
-	memory = vkraii::DeviceMemory(nri.getDevice().device, allocatedMemory);
+VulkanAllocation::~VulkanAllocation() {
+	if (range.block != nullptr) allocator->free(range);
 }
 
 void *VulkanAllocation::map() {
-	assert(memory != nullptr);
-	void *data = nullptr;
-	vkMapMemory(device, memory, 0, size, 0, &data);
-	if (data == nullptr) {
+	assert(range.block != nullptr);
+	if (range.block->mapped == nullptr) {
 		dbLog(dbg::LOG_ERROR, "Failed to map memory!");
 		throw std::runtime_error("Failed to map memory!");
 	}
-	return data;
+	return range.block->mapped + range.offset;
 }
 
-void VulkanAllocation::unmap() {
-	assert(memory != nullptr);
-	vkUnmapMemory(device, memory);
-}
+// blocks stay mapped until they are freed
+void VulkanAllocation::unmap() { assert(range.block != nullptr); }
 
 ResourceHandle VulkanBuffer::createHandle() const {
 	if (usage & BufferUsage::BUFFER_USAGE_UNIFORM)
@@ -558,25 +740,20 @@ void VulkanBuffer::bindMemory(Allocation &allocation, std::size_t offset) {
 	VulkanAllocation &vulkanAllocation = static_cast<VulkanAllocation &>(allocation);
 	this->offset					   = offset;
 
-	vkBindBufferMemory(nri->getDevice(), buffer, vulkanAllocation.getMemory(), offset);
+	vkBindBufferMemory(nri->getDevice(), buffer, vulkanAllocation.getMemory(),
+					   vulkanAllocation.getMemoryOffset() + offset);
 	this->allocation = &vulkanAllocation;
 }
 void *VulkanBuffer::map(std::size_t offset, std::size_t size) {
 	assert(allocation != nullptr);
-	void *data = nullptr;
-	vkMapMemory(allocation->getDevice(), allocation->getMemory(), offset, size, 0, &data);
-	if (data == nullptr) { throw std::runtime_error("Failed to map buffer memory."); }
-	return data;
+	assert(offset + size <= this->size);
+	static_cast<void>(size);
+	return (char *)allocation->map() + this->offset + offset;
 }
 
 void VulkanBuffer::unmap() {
 	assert(allocation != nullptr);
-
-	// vk::MappedMemoryRange memoryRange(allocation->getMemory(), offset, VK_WHOLE_SIZE);
-	// auto				  res = allocation->getDevice().flushMappedMemoryRanges(1, &memoryRange);
-	// assert(res == vk::Result::eSuccess);
-
-	vkUnmapMemory(allocation->getDevice(), allocation->getMemory());
+	allocation->unmap();
 }
 
 std::size_t VulkanBuffer::getSize() const { return this->size; }
@@ -724,7 +901,7 @@ MemoryRequirements VulkanImage2D::getMemoryRequirements() {
 void VulkanImage2D::bindMemory(Allocation &allocation, std::size_t offset) {
 	VulkanAllocation &vulkanAllocation = static_cast<VulkanAllocation &>(allocation);
 
-	vkBindImageMemory(*device, image.get(), vulkanAllocation.getMemory(), offset);
+	vkBindImageMemory(*device, image.get(), vulkanAllocation.getMemory(), vulkanAllocation.getMemoryOffset() + offset);
 }
 
 void VulkanImage2D::clear(CommandBuffer &commandBuffer, glm::vec4 color) {
@@ -891,34 +1068,35 @@ std::unique_ptr<CommandQueue> VulkanNRI::createCommandQueue() {
 };
 
 VulkanWindow::VulkanWindow(VulkanNRI &nri, Window::SurfaceSizeGetter surfaceSizeGetter)
-	: Window(nri, surfaceSizeGetter),
-	  surface(nullptr),
-	  swapChain(),
-	  presentQueue(nullptr),
-	  imageAvailableSemaphore(nullptr),
-	  renderFinishedSemaphore(nullptr),
-	  inFlightFence(nullptr) {
-	vk::Semaphore			semaphore = nullptr;
-	vk::SemaphoreCreateInfo semaphoreInfo;
-	vkCreateSemaphore(nri.getDevice(), (VkSemaphoreCreateInfo *)&semaphoreInfo, nullptr, (VkSemaphore *)&semaphore);
-	imageAvailableSemaphore = vkraii::Semaphore(nri.getDevice().device, semaphore);
-
-	vkCreateSemaphore(nri.getDevice(), (VkSemaphoreCreateInfo *)&semaphoreInfo, nullptr, (VkSemaphore *)&semaphore);
-	renderFinishedSemaphore = vkraii::Semaphore(nri.getDevice().device, semaphore);
+	: Window(nri, surfaceSizeGetter), surface(nullptr), swapChain(), presentQueue(nullptr) {
+	for (auto &frame : frames) {
+		frame.imageAvailableSemaphore = createSemaphore();
 
-	vk::FenceCreateInfo fenceInfo(vk::FenceCreateFlagBits::eSignaled);
-	vk::Fence			fence = nullptr;
-	vkCreateFence(nri.getDevice(), (VkFenceCreateInfo *)&fenceInfo, nullptr, (VkFence *)&fence);
-	inFlightFence = vkraii::Fence(nri.getDevice().device, fence);
+		vk::FenceCreateInfo fenceInfo(vk::FenceCreateFlagBits::eSignaled);
+		vk::Fence			fence = nullptr;
+		vkCreateFence(nri.getDevice(), (VkFenceCreateInfo *)&fenceInfo, nullptr, (VkFence *)&fence);
+		frame.inFlightFence = vkraii::Fence(nri.getDevice().device, fence);
 
-	if (imageAvailableSemaphore == nullptr || renderFinishedSemaphore == nullptr || inFlightFence == nullptr) {
-		throw std::runtime_error("Failed to create synchronization objects for a frame!");
+		if (frame.imageAvailableSemaphore == nullptr || frame.inFlightFence == nullptr) {
+			throw std::runtime_error("Failed to create synchronization objects for a frame!");
+		}
+		frame.commandBuffer = std::unique_ptr<VulkanCommandBuffer>(
+			(VulkanCommandBuffer *)nri.createCommandBuffer(nri.getDefaultCommandPool()).release());
 	}
-	commandBuffer = std::unique_ptr<VulkanCommandBuffer>(
-		(VulkanCommandBuffer *)nri.createCommandBuffer(nri.getDefaultCommandPool()).release());
+}
+
+vkraii::Semaphore VulkanWindow::createSemaphore() {
+	auto &nri = static_cast<VulkanNRI &>(this->nri);
+
+	vk::Semaphore			semaphore = nullptr;
+	vk::SemaphoreCreateInfo semaphoreInfo;
+	vkCreateSemaphore(nri.getDevice(), (VkSemaphoreCreateInfo *)&semaphoreInfo, nullptr, (VkSemaphore *)&semaphore);
+	return vkraii::Semaphore(nri.getDevice().device, semaphore);
 }
 
 VulkanWindow::~VulkanWindow() {
+	// frames may still be in flight, their semaphores and fences are destroyed with the window
+	vkDeviceWaitIdle(static_cast<VulkanNRI &>(this->nri).getDevice());
 	if (swapChain) vkb::destroy_swapchain(swapChain);
 }
 
@@ -1014,6 +1192,12 @@ void VulkanWindow::createSwapChain(uint32_t &width, uint32_t &height) {
 	swapChainImages.resize(imageCount);
 	vkGetSwapchainImagesKHR(nri.getDevice(), swapChain, &imageCount, (VkImage *)swapChainImages.data());
 
+	while (renderFinishedSemaphores.size() < imageCount) {
+		renderFinishedSemaphores.push_back(createSemaphore());
+		if (renderFinishedSemaphores.back() == nullptr) { THROW_RUNTIME_ERR("Failed to create swapchain semaphore!"); }
+	}
+
+	auto &commandBuffer = frames[currentFrame].commandBuffer;
 	for (const auto &image : swapChainImages) {
 		VulkanImage2D nriImage =
 			VulkanImage2D(nri, image, vk::ImageLayout::eUndefined, vk::PipelineStageFlagBits::eColorAttachmentOutput,
@@ -1030,26 +1214,31 @@ void VulkanWindow::createSwapChain(uint32_t &width, uint32_t &height) {
 }
 
 bool VulkanWindow::beginFrame() {
-	auto &nri = static_cast<const VulkanNRI &>(this->nri);
+	auto &nri	= static_cast<const VulkanNRI &>(this->nri);
+	auto &frame = frames[currentFrame];
 
+	// only waits for the frame that last used this slot, the ones after it keep running on the GPU
 	vk::Result result =
-		(vk::Result)vkWaitForFences(nri.getDevice(), 1, (VkFence *)&*inFlightFence, VK_TRUE, UINT64_MAX);
+		(vk::Result)vkWaitForFences(nri.getDevice(), 1, (VkFence *)&*frame.inFlightFence, VK_TRUE, UINT64_MAX);
 	assert(result == vk::Result::eSuccess);
+	resetUploads(frame);
 
 	if (swapChain == nullptr) {
 		createSwapChain(this->width, this->height);
 		return false;
 	}
-	result = (vk::Result)vkResetFences(nri.getDevice(), 1, (VkFence *)&*inFlightFence);
-	assert(result == vk::Result::eSuccess);
 
 	uint32_t imageIndex;
-	result = (vk::Result)vkAcquireNextImageKHR(nri.getDevice(), swapChain, UINT64_MAX, *imageAvailableSemaphore,
+	result = (vk::Result)vkAcquireNextImageKHR(nri.getDevice(), swapChain, UINT64_MAX, *frame.imageAvailableSemaphore,
 											   nullptr, &imageIndex);
 	assert(result == vk::Result::eSuccess || result == vk::Result::eSuboptimalKHR);
 	this->currentImageIndex = imageIndex;
 
-	swapChainImages[imageIndex].image.transitionLayout(*commandBuffer, vk::ImageLayout::eColorAttachmentOptimal,
+	// reset only once work is sure to be submitted with this fence, otherwise the next wait would never return
+	result = (vk::Result)vkResetFences(nri.getDevice(), 1, (VkFence *)&*frame.inFlightFence);
+	assert(result == vk::Result::eSuccess);
+
+	swapChainImages[imageIndex].image.transitionLayout(*frame.commandBuffer, vk::ImageLayout::eColorAttachmentOptimal,
 													   vk::AccessFlagBits::eColorAttachmentWrite,
 													   vk::PipelineStageFlagBits::eColorAttachmentOutput);
 	return true;
@@ -1059,7 +1248,7 @@ ImageAndViewRef VulkanWindow::getCurrentRenderTarget() {
 	auto &sci = swapChainImages[currentImageIndex];
 	return ImageAndViewRef(sci.image, sci.view);
 }
-CommandBuffer &VulkanWindow::getCurrentCommandBuffer() { return *commandBuffer; }
+CommandBuffer &VulkanWindow::getCurrentCommandBuffer() { return *frames[currentFrame].commandBuffer; }
 
 void VulkanWindow::endFrame() {
 	if (swapChain == nullptr) {
@@ -1067,17 +1256,22 @@ void VulkanWindow::endFrame() {
 		return;
 	}
 
-	getCurrentRenderTarget().image.prepareForPresent(*commandBuffer);
+	auto &frame			 = frames[currentFrame];
+	auto &renderFinished = renderFinishedSemaphores[currentImageIndex];
+	getCurrentRenderTarget().image.prepareForPresent(*frame.commandBuffer);
 
-	commandBuffer->end();
+	frame.commandBuffer->end();
 	auto				  &nri	  = static_cast<const VulkanNRI &>(this->nri);
 	vk::PipelineStageFlags stages = {vk::PipelineStageFlagBits::eColorAttachmentOutput};
-	vk::SubmitInfo		   submitInfo(1, &(*imageAvailableSemaphore), &stages, 1, &*commandBuffer->commandBuffer, 1,
-									  &(*renderFinishedSemaphore));
-	vkQueueSubmit(*presentQueue.queue, 1, &*submitInfo, *inFlightFence);
+	vk::SubmitInfo		   submitInfo(1, &(*frame.imageAvailableSemaphore), &stages, 1,
+									  &*frame.commandBuffer->commandBuffer, 1, &(*renderFinished));
+	vkQueueSubmit(*presentQueue.queue, 1, &*submitInfo, *frame.inFlightFence);
 
 	vk::PresentInfoKHR presentInfo = vk::PresentInfoKHR(
-		1, &*renderFinishedSemaphore, 1, (vk::SwapchainKHR *)&swapChain.swapchain, &currentImageIndex, nullptr);
+		1, &*renderFinished, 1, (vk::SwapchainKHR *)&swapChain.swapchain, &currentImageIndex, nullptr);
+
+	// the next frame records into its own command buffer while this one executes
+	currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 
 	vk::Result res = (vk::Result)vkQueuePresentKHR(*presentQueue.queue, &*presentInfo);
 	switch (res) {
@@ -1095,8 +1289,52 @@ void VulkanWindow::endFrame() {
 		vkDeviceWaitIdle(nri.getDevice());
 		createSwapChain(this->width, this->height);
 	}
+}
+
+VulkanWindow::UploadChunk VulkanWindow::createUploadChunk(std::size_t size) {
+	UploadChunk chunk;
+	// storage too, so per-draw data can be read through the chunk's bindless handle
+	chunk.buffer	 = nri.createBuffer(size, BUFFER_USAGE_VERTEX | BUFFER_USAGE_INDEX | BUFFER_USAGE_STORAGE);
+	chunk.allocation = nri.allocateMemory(
+		chunk.buffer->getMemoryRequirements().setTypeRequest(MemoryTypeRequest::MEMORY_TYPE_UPLOAD));
+	chunk.buffer->bindMemory(*chunk.allocation, 0);
+	chunk.data = (char *)chunk.buffer->map(0, size);
+	return chunk;
+}
+
+void VulkanWindow::resetUploads(FrameData &frame) {
+	// the GPU is done with this slot. If it overflowed into several chunks, replace them with one that fits it all
+	auto &chunks = frame.uploadChunks;
+	if (chunks.size() > 1) {
+		std::size_t totalSize = 0;
+		for (const auto &chunk : chunks) {
+			totalSize += chunk.buffer->getSize();
+		}
+		chunks.clear();
+		chunks.push_back(createUploadChunk(totalSize));
+	}
+	for (auto &chunk : chunks) {
+		chunk.used = 0;
+	}
+}
 
-	vkQueueWaitIdle(*presentQueue.queue);
+UploadSlice VulkanWindow::allocateUpload(std::size_t size, std::size_t alignment) {
+	auto &chunks = frames[currentFrame].uploadChunks;
+	if (!chunks.empty()) {
+		auto	   &chunk  = chunks.back();
+		std::size_t offset = (chunk.used + alignment - 1) / alignment * alignment;
+		if (offset + size <= chunk.buffer->getSize()) {
+			chunk.used = offset + size;
+			return {chunk.buffer.get(), offset, chunk.data + offset};
+		}
+	}
+
+	// earlier slices of this frame are already recorded, so chain a new chunk instead of growing the old one
+	std::size_t chunkSize = chunks.empty() ? UPLOAD_CHUNK_SIZE : chunks.back().buffer->getSize() * 2;
+	chunks.push_back(createUploadChunk(std::max(chunkSize, size)));
+	auto &chunk = chunks.back();
+	chunk.used	= size;
+	return {chunk.buffer.get(), 0, chunk.data};
 }
 
 void VulkanWindow::beginRendering(CommandBuffer &cmdBuf, const ImageAndViewRef &renderTarget) {
@@ -1143,156 +1381,233 @@ vk::PrimitiveTopology nriPrimitiveType2vkTopology[] = {
 	vk::PrimitiveTopology::eLineStrip,	  vk::PrimitiveTopology::ePointList,
 };
 
-std::pair<std::vector<vkraii::ShaderModule>, std::vector<vk::PipelineShaderStageCreateInfo>> VulkanProgramBuilder::
-	createShaderModules(std::vector<ShaderCreateInfo> &&stagesInfo, const vkb::Device &device) {
-	std::vector<vk::PipelineShaderStageCreateInfo> shaderStages;
-	std::vector<vkraii::ShaderModule>			   shaderModules;
+/// shadercache file name of a stage, e.g. "text_hlsl_VSMain.spv". Formats into the caller's buffer, so release builds
+/// can look up the embedded shaders without allocating.
+static std::string_view getShaderCacheFileName(const ShaderCreateInfo &stageInfo, std::span<char> buffer) {
+	std::string_view sourceName = stageInfo.sourceFile;
+	sourceName					= sourceName.substr(sourceName.find_last_of("/\\") + 1);
+
+	auto result = std::format_to_n(buffer.data(), buffer.size(), "{}_{}.spv", sourceName, stageInfo.entryPoint);
+	auto length = std::min<std::size_t>(result.size, buffer.size());
+	std::replace(buffer.data(), buffer.data() + std::min(sourceName.size(), length), '.', '_');
+	return {buffer.data(), length};
+}
 
-	CComPtr<IDxcCompiler3> compiler;
 #ifndef NDEBUG
-	HRESULT hr = DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&compiler));
-#endif
+/// DXC arguments for a stage. They are part of the shader cache key, so any change here recompiles everything.
+static std::vector<std::wstring> getShaderCompileArguments(const ShaderCreateInfo &stageInfo) {
+	std::wstring target;
+	switch (stageInfo.shaderType) {
+		case ShaderType::SHADER_TYPE_VERTEX: target = L"vs_6_6"; break;
+		case ShaderType::SHADER_TYPE_FRAGMENT: target = L"ps_6_6"; break;
+		case ShaderType::SHADER_TYPE_COMPUTE: target = L"cs_6_6"; break;
+		case ShaderType::SHADER_TYPE_RAYGEN: target = L"lib_6_6"; break;
+		case ShaderType::SHADER_TYPE_CLOSEST_HIT: target = L"lib_6_6"; break;
+		case ShaderType::SHADER_TYPE_ANY_HIT: target = L"lib_6_6"; break;
+		case ShaderType::SHADER_TYPE_MISS: target = L"lib_6_6"; break;
+		default:
+			dbLog(dbg::LOG_ERROR, "Unsupported shader type: ", static_cast<int>(stageInfo.shaderType));
+			throw std::runtime_error("Unsupported shader stage!");
+	}
+	return {
+		L"-E",
+		std::wstring(stageInfo.entryPoint.begin(), stageInfo.entryPoint.end()),
+		L"-T",
+		target,
+		L"-spirv",
+		L"-D",
+		L"VULKAN",
+		L"-D",
+		L"SHADER",
+		L"-I",
+		L"./shaders/",
+		L"-fvk-use-dx-layout",
+		L"-fspv-target-env=vulkan1.2",
+		L"-HV",
+		L"2021",
+	};
+}
+
+/// hashes the contents of a shader source and of everything it includes, recursively. Includes are resolved like DXC
+/// does: next to the including file first, then in ./shaders/. Includes inside disabled #if blocks are hashed too,
+/// which can only cause an unneeded recompile.
+static uint64_t hashShaderSource(const std::filesystem::path &path, std::unordered_set<std::string> &visited,
+								 uint64_t seed) {
+	std::error_code ec;
+	auto			canonical = std::filesystem::canonical(path, ec);
+	// a missing include only changes the key, DXC reports the actual error
+	if (ec) return fxed::hashString(path.string(), seed);
+	if (!visited.insert(canonical.string()).second) return seed;
+
+	fxed::MappedFile file(canonical);
+	std::string_view source(file.getData(), file.getSize());
+	seed = fxed::hashString(source, seed);
+
+	constexpr std::string_view directive = "#include";
+	std::size_t				   pos		 = 0;
+	while ((pos = source.find(directive, pos)) != std::string_view::npos) {
+		pos += directive.size();
+		std::size_t open = source.find_first_of("<\"\n", pos);
+		if (open == std::string_view::npos || source[open] == '\n') continue;
+		std::size_t close = source.find(source[open] == '<' ? '>' : '"', open + 1);
+		if (close == std::string_view::npos) break;
+
+		std::string_view name = source.substr(open + 1, close - open - 1);
+		auto			 includePath = canonical.parent_path() / name;
+		if (!std::filesystem::exists(includePath, ec)) includePath = std::filesystem::path("shaders") / name;
+		seed = hashShaderSource(includePath, visited, fxed::hashString(name, seed));
+		pos	 = close;
+	}
+	return seed;
+}
+
+static std::string getShaderCacheKey(const ShaderCreateInfo &stageInfo, const std::vector<std::wstring> &arguments) {
+	std::unordered_set<std::string> visited;
+	uint64_t						key = hashShaderSource(stageInfo.sourceFile, visited, fxed::FNV_OFFSET_BASIS);
+	for (const auto &argument : arguments) {
+		key = fxed::hashValue(argument.size(), key);
+		key = fxed::hashBytes(argument.data(), argument.size() * sizeof(wchar_t), key);
+	}
+	return std::format("{:016x}", key);
+}
+
+static std::vector<uint32_t> compileShader(const ShaderCreateInfo &stageInfo,
+										   const std::vector<std::wstring> &arguments) {
+	// stages compile concurrently, so every compile gets its own DXC instances
+	CComPtr<IDxcCompiler3> compiler;
+	HRESULT				   hr = DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&compiler));
 	assert(SUCCEEDED(hr) && "Failed to create DX Compiler.");
 
 	CComPtr<IDxcUtils> utils;
-#ifndef NDEBUG
 	hr = DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(&utils));
-#endif
 	assert(SUCCEEDED(hr) && "Failed to create DX Utils.");
 
-	auto includeHandler = std::make_unique<CustomIncludeHandler>(utils);
+	CustomIncludeHandler includeHandler(utils);
+	CComPtr<IDxcBlob>	 sourceBlob;
+	std::wstring		 wSourceFile = std::wstring(stageInfo.sourceFile.begin(), stageInfo.sourceFile.end());
+	hr								 = includeHandler.LoadSource(wSourceFile.c_str(), &sourceBlob);
+	if (FAILED(hr)) {
+		dbLog(dbg::LOG_ERROR, "Failed to load shader source file: ", stageInfo.sourceFile);
+		THROW_RUNTIME_ERR(std::format("Failed to load shader source file: {}", stageInfo.sourceFile));
+	}
+
+	std::vector<LPCWSTR> argumentPtrs;
+	for (const auto &argument : arguments) {
+		argumentPtrs.push_back(argument.c_str());
+	}
+
+	DxcBuffer buffer{};
+	buffer.Ptr		= sourceBlob->GetBufferPointer();
+	buffer.Size		= sourceBlob->GetBufferSize();
+	buffer.Encoding = 0;
+
+	dbLog(dbg::LOG_DEBUG, "\n\tCompiling shader: ", stageInfo.sourceFile, "\n\tEntry point: ", stageInfo.entryPoint);
+
+	includeHandler.reset();
+	CComPtr<IDxcResult> result;
+	hr = compiler->Compile(&buffer, argumentPtrs.data(), static_cast<UINT32>(argumentPtrs.size()), &includeHandler,
+						   IID_PPV_ARGS(&result));
+	if (FAILED(hr)) {
+		throw std::runtime_error(std::format("Failed to compile shader: {}", stageInfo.sourceFile));
+	}
+
+	CComPtr<IDxcBlobEncoding> errorBuffer;
+	result->GetErrorBuffer(&errorBuffer);
+	if (errorBuffer != nullptr && errorBuffer->GetBufferSize() > 0) {
+		std::string errorMessage(reinterpret_cast<const char *>(errorBuffer->GetBufferPointer()),
+								 errorBuffer->GetBufferSize());
+		std::cerr << "Shader compilation warnings/errors: " << errorMessage << std::endl;
+	}
 
+	CComPtr<IDxcBlob> spirvBlob;
+	result->GetOutput(DXC_OUT_OBJECT, IID_PPV_ARGS(&spirvBlob), nullptr);
+	if (spirvBlob == nullptr || spirvBlob->GetBufferSize() == 0) {
+		THROW_RUNTIME_ERR(std::format("Failed to compile shader: {} ({})", stageInfo.sourceFile, stageInfo.entryPoint));
+	}
+
+	std::vector<uint32_t> spirv(spirvBlob->GetBufferSize() / sizeof(uint32_t));
+	std::memcpy(spirv.data(), spirvBlob->GetBufferPointer(), spirv.size() * sizeof(uint32_t));
+	return spirv;
+}
+
+/// loads a stage from the shader cache if its key still matches the sources and arguments, otherwise compiles it and
+/// refreshes the cache. The key lives next to the binary in a .key file.
+static std::vector<uint32_t> loadOrCompileShader(const ShaderCreateInfo &stageInfo,
+												 const std::filesystem::path &cachePath) {
+	auto arguments = getShaderCompileArguments(stageInfo);
+	auto key	   = getShaderCacheKey(stageInfo, arguments);
+	auto keyPath   = cachePath;
+	keyPath += ".key";
+
+	fxed::MappedFile cachedKey(keyPath);
+	if (cachedKey.isOpen() && std::string_view(cachedKey.getData(), cachedKey.getSize()) == key) {
+		fxed::MappedFile cached(cachePath);
+		if (cached.isOpen() && cached.getSize() % sizeof(uint32_t) == 0) {
+			std::vector<uint32_t> spirv(cached.getSize() / sizeof(uint32_t));
+			std::memcpy(spirv.data(), cached.getData(), cached.getSize());
+			dbLog(dbg::LOG_DEBUG, "Loaded shader from cache: ", cachePath);
+			return spirv;
+		}
+	}
+
+	auto			spirv = compileShader(stageInfo, arguments);
+	std::error_code ec;
+	std::filesystem::create_directories(cachePath.parent_path(), ec);
+	// drop the old key first, so an interrupted write never pairs it with a new binary
+	std::filesystem::remove(keyPath, ec);
+	auto bytes = std::span(reinterpret_cast<const char *>(spirv.data()), spirv.size() * sizeof(uint32_t));
+	if (fxed::writeFileAtomic(cachePath, bytes)) fxed::writeFileAtomic(keyPath, key);
+	return spirv;
+}
+#endif
+
+std::pair<std::vector<vkraii::ShaderModule>, std::vector<vk::PipelineShaderStageCreateInfo>> VulkanProgramBuilder::
+	createShaderModules(std::vector<ShaderCreateInfo> &&stagesInfo, const vkb::Device &device) {
+	std::vector<vk::PipelineShaderStageCreateInfo> shaderStages;
+	std::vector<vkraii::ShaderModule>			   shaderModules;
+
+	std::vector<vk::ShaderStageFlagBits> stages;
 	for (const auto &stageInfo : stagesInfo) {
-		vk::ShaderStageFlagBits stage;
 		switch (stageInfo.shaderType) {
-			case ShaderType::SHADER_TYPE_VERTEX: stage = vk::ShaderStageFlagBits::eVertex; break;
-			case ShaderType::SHADER_TYPE_FRAGMENT: stage = vk::ShaderStageFlagBits::eFragment; break;
-			case ShaderType::SHADER_TYPE_COMPUTE: stage = vk::ShaderStageFlagBits::eCompute; break;
-			case ShaderType::SHADER_TYPE_RAYGEN: stage = vk::ShaderStageFlagBits::eRaygenKHR; break;
-			case ShaderType::SHADER_TYPE_CLOSEST_HIT: stage = vk::ShaderStageFlagBits::eClosestHitKHR; break;
-			case ShaderType::SHADER_TYPE_ANY_HIT: stage = vk::ShaderStageFlagBits::eAnyHitKHR; break;
-			case ShaderType::SHADER_TYPE_MISS: stage = vk::ShaderStageFlagBits::eMissKHR; break;
+			case ShaderType::SHADER_TYPE_VERTEX: stages.push_back(vk::ShaderStageFlagBits::eVertex); break;
+			case ShaderType::SHADER_TYPE_FRAGMENT: stages.push_back(vk::ShaderStageFlagBits::eFragment); break;
+			case ShaderType::SHADER_TYPE_COMPUTE: stages.push_back(vk::ShaderStageFlagBits::eCompute); break;
+			case ShaderType::SHADER_TYPE_RAYGEN: stages.push_back(vk::ShaderStageFlagBits::eRaygenKHR); break;
+			case ShaderType::SHADER_TYPE_CLOSEST_HIT: stages.push_back(vk::ShaderStageFlagBits::eClosestHitKHR); break;
+			case ShaderType::SHADER_TYPE_ANY_HIT: stages.push_back(vk::ShaderStageFlagBits::eAnyHitKHR); break;
+			case ShaderType::SHADER_TYPE_MISS: stages.push_back(vk::ShaderStageFlagBits::eMissKHR); break;
 			default:
 				dbLog(dbg::LOG_ERROR, "Unsupported shader type: ", static_cast<int>(stageInfo.shaderType));
 				throw std::runtime_error("Unsupported shader stage!");
 		}
-		const std::filesystem::path sourceFile{stageInfo.sourceFile};
+	}
 
-		std::string filename = sourceFile.filename().string();
-		std::replace(filename.begin(), filename.end(), '.', '_');
-		std::string cacheFileName = std::format("{}_{}.spv", filename, stageInfo.entryPoint);
 #ifndef NDEBUG
-		std::filesystem::path	   cachePath = std::filesystem::path("shadercache") / cacheFileName;
-		vk::ShaderModuleCreateInfo shaderModuleInfo;
-		CComPtr<IDxcBlob>		   spirvBlob;
-		std::unique_ptr<char[]>	   spirvData;
-		// check timestamps of source and cache files
-		bool cacheValid = false;
-		if (std::filesystem::exists(cachePath)) {
-			auto sourceTime = std::filesystem::last_write_time(sourceFile);
-			auto cacheTime	= std::filesystem::last_write_time(cachePath);
-			cacheValid		= cacheTime >= sourceTime;
-		}
-
-		if (!cacheValid) {
-			CComPtr<IDxcBlob> sourceBlob;
-			std::wstring	  wSourceFile = std::wstring(stageInfo.sourceFile.begin(), stageInfo.sourceFile.end());
-			HRESULT			  hr		  = includeHandler->LoadSource(wSourceFile.c_str(), &sourceBlob);
-
-			if (FAILED(hr)) {
-				dbLog(dbg::LOG_ERROR, "Failed to load shader source file: ", stageInfo.sourceFile);
-				THROW_RUNTIME_ERR(std::format("Failed to load shader source file: {}", stageInfo.sourceFile));
-			}
-
-			std::vector<LPCWSTR> arguments;
-			arguments.push_back(L"-E");
-			std::wstring entryPoint = std::wstring(stageInfo.entryPoint.begin(), stageInfo.entryPoint.end());
-			arguments.push_back(entryPoint.c_str());
-			arguments.push_back(L"-T");
-			switch (stageInfo.shaderType) {
-				case ShaderType::SHADER_TYPE_VERTEX: arguments.push_back(L"vs_6_6"); break;
-				case ShaderType::SHADER_TYPE_FRAGMENT: arguments.push_back(L"ps_6_6"); break;
-				case ShaderType::SHADER_TYPE_COMPUTE: arguments.push_back(L"cs_6_6"); break;
-				case ShaderType::SHADER_TYPE_RAYGEN: arguments.push_back(L"lib_6_6"); break;
-				case ShaderType::SHADER_TYPE_CLOSEST_HIT: arguments.push_back(L"lib_6_6"); break;
-				case ShaderType::SHADER_TYPE_ANY_HIT: arguments.push_back(L"lib_6_6"); break;
-				case ShaderType::SHADER_TYPE_MISS: arguments.push_back(L"lib_6_6"); break;
-				default:
-					dbLog(dbg::LOG_ERROR, "Unsupported shader type: ", static_cast<int>(stageInfo.shaderType));
-					throw std::runtime_error("Unsupported shader stage!");
-			}
-			arguments.push_back(L"-spirv");
-			arguments.push_back(L"-D");
-			arguments.push_back(L"VULKAN");
-			arguments.push_back(L"-D");
-			arguments.push_back(L"SHADER");
-			arguments.push_back(L"-I");
-			arguments.push_back(L"./shaders/");
-			arguments.push_back(L"-fvk-use-dx-layout");
-			arguments.push_back(L"-fspv-target-env=vulkan1.2");
-			arguments.push_back(L"-HV");
-			arguments.push_back(L"2021");
-
-			DxcBuffer buffer{};
-			buffer.Ptr		= sourceBlob->GetBufferPointer();
-			buffer.Size		= sourceBlob->GetBufferSize();
-			buffer.Encoding = 0;
-
-			dbLog(dbg::LOG_DEBUG, "\n\tCompiling shader: ", stageInfo.sourceFile,
-				  "\n\tEntry point: ", stageInfo.entryPoint);
-
-			includeHandler->reset();
-			CComPtr<IDxcResult> result;
-			hr = compiler->Compile(&buffer, arguments.data(), static_cast<UINT32>(arguments.size()),
-								   includeHandler.get(), IID_PPV_ARGS(&result));
-			if (FAILED(hr)) {
-				throw std::runtime_error(std::format("Failed to compile shader: {}", stageInfo.sourceFile));
-			}
-
-			CComPtr<IDxcBlobEncoding> errorBuffer;
-			result->GetErrorBuffer(&errorBuffer);
-			if (errorBuffer != nullptr && errorBuffer->GetBufferSize() > 0) {
-				std::string errorMessage(reinterpret_cast<const char *>(errorBuffer->GetBufferPointer()),
-										 errorBuffer->GetBufferSize());
-				std::cerr << "Shader compilation warnings/errors: " << errorMessage << std::endl;
-			}
+	// hash, and if needed compile, all stages in parallel. The tasks get their own copy of the stage info, so they stay
+	// valid even if an earlier stage throws and this function returns before they finish.
+	auto										   &pool = fxed::ThreadPool::getInstance();
+	std::vector<std::future<std::vector<uint32_t>>> spirvFutures;
+	for (const auto &stageInfo : stagesInfo) {
+		char cacheFileName[256];
+		auto cachePath = std::filesystem::path("shadercache") / getShaderCacheFileName(stageInfo, cacheFileName);
+		spirvFutures.push_back(
+			pool.submit([stageInfo, cachePath]() { return loadOrCompileShader(stageInfo, cachePath); }));
+	}
+#endif
 
-			result->GetOutput(DXC_OUT_OBJECT, IID_PPV_ARGS(&spirvBlob), nullptr);
-
-			// write to shader cache
-			std::filesystem::create_directories(cachePath.parent_path());
-			std::ofstream ofs(cachePath, std::ios::binary);
-			ofs.write(reinterpret_cast<const char *>(spirvBlob->GetBufferPointer()), spirvBlob->GetBufferSize());
-			ofs.close();
-			shaderModuleInfo = {
-				{}, spirvBlob->GetBufferSize(), reinterpret_cast<const uint32_t *>(spirvBlob->GetBufferPointer())};
-		} else {
-			// load from cache
-			std::ifstream ifs(cachePath, std::ios::binary | std::ios::ate);
-			if (!ifs) {
-				dbLog(dbg::LOG_ERROR, "Failed to open shader cache file: ", cachePath);
-				THROW_RUNTIME_ERR(std::format("Failed to open shader cache file: {}", cachePath.string()));
-			}
-			std::streamsize size = ifs.tellg();
-			ifs.seekg(0, std::ios::beg);
-			spirvBlob = nullptr;
-			spirvData = std::make_unique<char[]>(size);
-			ifs.read(reinterpret_cast<char *>(spirvData.get()), size);
-			if (!ifs) {
-				dbLog(dbg::LOG_ERROR, "Failed to read shader cache file: ", cachePath);
-				THROW_RUNTIME_ERR(std::format("Failed to read shader cache file: {}", cachePath.string()));
-			}
-			ifs.close();
-			shaderModuleInfo = {{}, static_cast<size_t>(size), reinterpret_cast<const uint32_t *>(spirvData.get())};
-			dbLog(dbg::LOG_DEBUG, "Loaded shader from cache: ", cachePath);
-		}
+	for (std::size_t i = 0; i < stagesInfo.size(); ++i) {
+		const auto &stageInfo = stagesInfo[i];
+#ifndef NDEBUG
+		auto					   spirv = pool.await(spirvFutures[i]);
+		vk::ShaderModuleCreateInfo shaderModuleInfo({}, spirv.size() * sizeof(uint32_t), spirv.data());
 #else	  // NDEBUG
-		auto it = g_shaders.find(cacheFileName);
-		if (it == g_shaders.end()) {
+		char			 nameBuffer[256];
+		std::string_view cacheFileName = getShaderCacheFileName(stageInfo, nameBuffer);
+		ShaderData		 shaderdata	   = findShader(cacheFileName);
+		if (shaderdata.data == nullptr) {
 			dbLog(dbg::LOG_ERROR, "Shader cache not found for: ", cacheFileName);
 			THROW_RUNTIME_ERR(std::format("Shader cache not found for: {}", cacheFileName));
 		}
-		auto					  &shaderdata = it->second;
 		vk::ShaderModuleCreateInfo shaderModuleInfo({}, shaderdata.length,
 													reinterpret_cast<const uint32_t *>(shaderdata.data));
 #endif
@@ -1301,7 +1616,7 @@ std::pair<std::vector<vkraii::ShaderModule>, std::vector<vk::PipelineShaderStage
 		vkCreateShaderModule(device, &*shaderModuleInfo, nullptr, (VkShaderModule *)&shaderModule);
 		shaderModules.push_back(vkraii::ShaderModule(device.device, shaderModule));
 
-		vk::PipelineShaderStageCreateInfo shaderStageInfo({}, stage, *shaderModules.back(),
+		vk::PipelineShaderStageCreateInfo shaderStageInfo({}, stages[i], *shaderModules.back(),
 														  stageInfo.entryPoint.c_str());
 		shaderStages.push_back(shaderStageInfo);
 	}
@@ -1392,7 +1707,8 @@ std::unique_ptr<GraphicsProgram> VulkanProgramBuilder::buildGraphicsProgram() {
 		&pipelineRenderingInfo);
 
 	vk::Pipeline pipeline = nullptr;
-	vkCreateGraphicsPipelines(nri.getDevice(), nullptr, 1, &*pipelineInfo, nullptr, (VkPipeline *)&pipeline);
+	vkCreateGraphicsPipelines(nri.getDevice(), nri.getPipelineCache(), 1, &*pipelineInfo, nullptr,
+							  (VkPipeline *)&pipeline);
 
 	return std::make_unique<VulkanGraphicsProgram>(nri, vkraii::Pipeline(nri.getDevice().device, pipeline),
 												   vkraii::PipelineLayout(nri.getDevice().device, pipelineLayout));
@@ -1409,7 +1725,8 @@ std::unique_ptr<ComputeProgram> VulkanProgramBuilder::buildComputeProgram() {
 	vk::ComputePipelineCreateInfo pipelineInfo({}, shaderStages[0], pipelineLayout);
 
 	vk::Pipeline pipeline = nullptr;
-	vkCreateComputePipelines(nri.getDevice(), nullptr, 1, &*pipelineInfo, nullptr, (VkPipeline *)&pipeline);
+	vkCreateComputePipelines(nri.getDevice(), nri.getPipelineCache(), 1, &*pipelineInfo, nullptr,
+							 (VkPipeline *)&pipeline);
 	return std::make_unique<VulkanComputeProgram>(nri, vkraii::Pipeline(nri.getDevice().device, pipeline),
 												  vkraii::PipelineLayout(nri.getDevice().device, pipelineLayout));
 }